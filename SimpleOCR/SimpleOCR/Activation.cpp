@@ -0,0 +1,581 @@
+﻿#include "pch.h"
+#include "Activation.h"
+
+#include "GemmKernel.h"
+
+#include <bit>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define OCR_ACTIVATION_X64 1
+#include <immintrin.h>
+#else
+#define OCR_ACTIVATION_X64 0
+#endif
+
+// MSVC は関数単位の指定なしで AVX 命令を生成できるが、GCC/Clang は target 属性が必要
+#if defined(__GNUC__)
+#define OCR_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define OCR_TARGET_AVX512 __attribute__((target("avx512f")))
+#else
+#define OCR_TARGET_AVX2
+#define OCR_TARGET_AVX512
+#endif
+
+using namespace ocr;
+
+namespace
+{
+    // exp(x) = 2^n * exp(r), n = round(x / ln2), r = x - n * ln2 (Cephes の expf と同じ分解と係数)
+    // 上限は x / ln2 が 127.5 を超えない (2^n が float の指数に収まる) 値、下限は 2^n が正規化数になる値
+
+    constexpr float expMin = -87.3365447504f;
+
+    constexpr float expMax = 88.3762626647949f;
+
+    constexpr float log2e = 1.44269504088896341f;
+
+    // ln2 を 2 つに分け、n * ln2Hi を誤差なしで引く
+    constexpr float ln2Hi = 0.693359375f;
+
+    constexpr float ln2Lo = -2.12194440e-4f;
+
+    constexpr float expCoefficients[] = {
+        1.9875691500e-4f, 1.3981999507e-3f, 8.3334519073e-3f, 4.1665795894e-2f, 1.6666665459e-1f, 5.0000001201e-1f
+    };
+
+    // log(x) = e * ln2 + log(m), m は [√0.5, √2) (Cephes の logf と同じ分解と係数)
+
+    constexpr float sqrtHalf = 0.707106781186547524f;
+
+    constexpr float logCoefficients[] = {
+        7.0376836292e-2f, -1.1514610310e-1f, 1.1676998740e-1f, -1.2420140846e-1f, 1.4249322787e-1f,
+        -1.6668057665e-1f, 2.0000714765e-1f, -2.4999993993e-1f, 3.3333331174e-1f
+    };
+
+    /// @brief FastExp() のスカラー版 (FMA を使わないので、SIMD 版と最後の 1 ビットが異なることがある)
+    float expScalar(float x)
+    {
+        x = std::min(std::max(x, expMin), expMax);
+
+        const float n = std::nearbyint(x * log2e);
+        const float r = (x - n * ln2Hi) - n * ln2Lo;
+
+        float p = expCoefficients[0];
+        for (size_t i = 1; i < std::size(expCoefficients); ++i)
+        {
+            p = p * r + expCoefficients[i];
+        }
+
+        const float y = p * (r * r) + r + 1.0f;
+        const uint32_t scale = static_cast<uint32_t>(static_cast<int>(n) + 127) << 23;
+        return y * std::bit_cast<float>(scale);
+    }
+
+    float logScalar(float x)
+    {
+        const uint32_t bits = std::bit_cast<uint32_t>(x);
+
+        // m は [0.5, 1)。√0.5 未満なら 2 倍して指数を 1 つ減らす
+        float e = static_cast<float>(static_cast<int>(bits >> 23) - 126);
+        const float m = std::bit_cast<float>((bits & 0x007fffffu) | 0x3f000000u);
+        float t = m - 1.0f;
+        if (m < sqrtHalf)
+        {
+            t += m;
+            e -= 1.0f;
+        }
+
+        const float z = t * t;
+        float p = logCoefficients[0];
+        for (size_t i = 1; i < std::size(logCoefficients); ++i)
+        {
+            p = p * t + logCoefficients[i];
+        }
+
+        float y = p * t * z;
+        y += e * ln2Lo;
+        y -= 0.5f * z;
+        return (t + y) + e * ln2Hi;
+    }
+
+    float sigmoidScalar(float x)
+    {
+        return 1.0f / (1.0f + expScalar(-x));
+    }
+
+    using ArrayFunction = void(*)(float* values, size_t count);
+
+    template <float (*Function)(float)>
+    void applyScalar(float* values, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            values[i] = Function(values[i]);
+        }
+    }
+
+#if OCR_ACTIVATION_X64
+    // ----------------------------------------------- AVX2 + FMA
+
+    OCR_TARGET_AVX2 __m256 expAvx2(__m256 x)
+    {
+        x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(expMin)), _mm256_set1_ps(expMax));
+
+        const __m256 n = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(log2e)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        __m256 r = _mm256_fnmadd_ps(n, _mm256_set1_ps(ln2Hi), x);
+        r = _mm256_fnmadd_ps(n, _mm256_set1_ps(ln2Lo), r);
+
+        __m256 p = _mm256_set1_ps(expCoefficients[0]);
+        for (size_t i = 1; i < std::size(expCoefficients); ++i)
+        {
+            p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(expCoefficients[i]));
+        }
+
+        const __m256 y = _mm256_add_ps(_mm256_fmadd_ps(p, _mm256_mul_ps(r, r), r), _mm256_set1_ps(1.0f));
+
+        // 2^n は n + 127 を指数のビットに置いて作る
+        const __m256i scale = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+        return _mm256_mul_ps(y, _mm256_castsi256_ps(scale));
+    }
+
+    OCR_TARGET_AVX2 __m256 logAvx2(__m256 x)
+    {
+        const __m256i bits = _mm256_castps_si256(x);
+
+        __m256 e = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(126)));
+        const __m256 m = _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007fffff)),
+                                                             _mm256_set1_epi32(0x3f000000)));
+
+        const __m256 small = _mm256_cmp_ps(m, _mm256_set1_ps(sqrtHalf), _CMP_LT_OQ);
+        const __m256 t = _mm256_add_ps(_mm256_sub_ps(m, _mm256_set1_ps(1.0f)), _mm256_and_ps(small, m));
+        e = _mm256_sub_ps(e, _mm256_and_ps(small, _mm256_set1_ps(1.0f)));
+
+        const __m256 z = _mm256_mul_ps(t, t);
+        __m256 p = _mm256_set1_ps(logCoefficients[0]);
+        for (size_t i = 1; i < std::size(logCoefficients); ++i)
+        {
+            p = _mm256_fmadd_ps(p, t, _mm256_set1_ps(logCoefficients[i]));
+        }
+
+        __m256 y = _mm256_mul_ps(_mm256_mul_ps(p, t), z);
+        y = _mm256_fmadd_ps(e, _mm256_set1_ps(ln2Lo), y);
+        y = _mm256_fnmadd_ps(_mm256_set1_ps(0.5f), z, y);
+        return _mm256_fmadd_ps(e, _mm256_set1_ps(ln2Hi), _mm256_add_ps(t, y));
+    }
+
+    OCR_TARGET_AVX2 __m256 sigmoidAvx2(__m256 x)
+    {
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256 negative = _mm256_sub_ps(_mm256_setzero_ps(), x);
+        return _mm256_div_ps(one, _mm256_add_ps(one, expAvx2(negative)));
+    }
+
+    /// @brief 先頭 n 要素 (1 <= n < 8) を読み書きするマスク
+    OCR_TARGET_AVX2 __m256i avx2TailMask(size_t n)
+    {
+        const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        return _mm256_cmpgt_epi32(_mm256_set1_epi32(static_cast<int>(n)), lanes);
+    }
+
+    template <__m256 (*Function)(__m256)>
+    OCR_TARGET_AVX2 void applyAvx2(float* values, size_t count)
+    {
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            _mm256_storeu_ps(values + i, Function(_mm256_loadu_ps(values + i)));
+        }
+
+        if (i < count)
+        {
+            // 端数のレーンには 1 を入れて、log に 0 を渡さない
+            const __m256i mask = avx2TailMask(count - i);
+            const __m256 x = _mm256_blendv_ps(_mm256_set1_ps(1.0f), _mm256_maskload_ps(values + i, mask), _mm256_castsi256_ps(mask));
+            _mm256_maskstore_ps(values + i, mask, Function(x));
+        }
+    }
+
+    // ----------------------------------------------- AVX-512 (AVX2 版と同じ演算の順で、結果も同じ)
+
+    OCR_TARGET_AVX512 __m512 expAvx512(__m512 x)
+    {
+        x = _mm512_min_ps(_mm512_max_ps(x, _mm512_set1_ps(expMin)), _mm512_set1_ps(expMax));
+
+        const __m512 n = _mm512_roundscale_ps(_mm512_mul_ps(x, _mm512_set1_ps(log2e)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        __m512 r = _mm512_fnmadd_ps(n, _mm512_set1_ps(ln2Hi), x);
+        r = _mm512_fnmadd_ps(n, _mm512_set1_ps(ln2Lo), r);
+
+        __m512 p = _mm512_set1_ps(expCoefficients[0]);
+        for (size_t i = 1; i < std::size(expCoefficients); ++i)
+        {
+            p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(expCoefficients[i]));
+        }
+
+        const __m512 y = _mm512_add_ps(_mm512_fmadd_ps(p, _mm512_mul_ps(r, r), r), _mm512_set1_ps(1.0f));
+
+        const __m512i scale = _mm512_slli_epi32(_mm512_add_epi32(_mm512_cvtps_epi32(n), _mm512_set1_epi32(127)), 23);
+        return _mm512_mul_ps(y, _mm512_castsi512_ps(scale));
+    }
+
+    OCR_TARGET_AVX512 __m512 logAvx512(__m512 x)
+    {
+        const __m512i bits = _mm512_castps_si512(x);
+
+        __m512 e = _mm512_cvtepi32_ps(_mm512_sub_epi32(_mm512_srli_epi32(bits, 23), _mm512_set1_epi32(126)));
+        const __m512 m = _mm512_castsi512_ps(_mm512_or_si512(_mm512_and_si512(bits, _mm512_set1_epi32(0x007fffff)),
+                                                             _mm512_set1_epi32(0x3f000000)));
+
+        const __mmask16 small = _mm512_cmp_ps_mask(m, _mm512_set1_ps(sqrtHalf), _CMP_LT_OQ);
+        const __m512 t = _mm512_mask_add_ps(_mm512_sub_ps(m, _mm512_set1_ps(1.0f)), small, _mm512_sub_ps(m, _mm512_set1_ps(1.0f)), m);
+        e = _mm512_mask_sub_ps(e, small, e, _mm512_set1_ps(1.0f));
+
+        const __m512 z = _mm512_mul_ps(t, t);
+        __m512 p = _mm512_set1_ps(logCoefficients[0]);
+        for (size_t i = 1; i < std::size(logCoefficients); ++i)
+        {
+            p = _mm512_fmadd_ps(p, t, _mm512_set1_ps(logCoefficients[i]));
+        }
+
+        __m512 y = _mm512_mul_ps(_mm512_mul_ps(p, t), z);
+        y = _mm512_fmadd_ps(e, _mm512_set1_ps(ln2Lo), y);
+        y = _mm512_fnmadd_ps(_mm512_set1_ps(0.5f), z, y);
+        return _mm512_fmadd_ps(e, _mm512_set1_ps(ln2Hi), _mm512_add_ps(t, y));
+    }
+
+    OCR_TARGET_AVX512 __m512 sigmoidAvx512(__m512 x)
+    {
+        const __m512 one = _mm512_set1_ps(1.0f);
+        const __m512 negative = _mm512_sub_ps(_mm512_setzero_ps(), x);
+        return _mm512_div_ps(one, _mm512_add_ps(one, expAvx512(negative)));
+    }
+
+    template <__m512 (*Function)(__m512)>
+    OCR_TARGET_AVX512 void applyAvx512(float* values, size_t count)
+    {
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+        {
+            _mm512_storeu_ps(values + i, Function(_mm512_loadu_ps(values + i)));
+        }
+
+        if (i < count)
+        {
+            const __mmask16 mask = static_cast<__mmask16>((1u << (count - i)) - 1);
+            const __m512 x = _mm512_mask_loadu_ps(_mm512_set1_ps(1.0f), mask, values + i);
+            _mm512_mask_storeu_ps(values + i, mask, Function(x));
+        }
+    }
+
+    /// @brief GEMM と同じ命令セットで計算する関数を選ぶ
+    ArrayFunction selectArrayFunction(ArrayFunction scalar, ArrayFunction avx2, ArrayFunction avx512)
+    {
+        switch (GetGemmKernelType())
+        {
+        case GemmKernelType::Avx512:
+            return avx512;
+        case GemmKernelType::Avx2:
+            return avx2;
+        default:
+            return scalar;
+        }
+    }
+#endif
+
+    void fastExp(float* values, size_t count)
+    {
+#if OCR_ACTIVATION_X64
+        static const ArrayFunction function =
+            selectArrayFunction(applyScalar<expScalar>, applyAvx2<expAvx2>, applyAvx512<expAvx512>);
+        function(values, count);
+#else
+        applyScalar<expScalar>(values, count);
+#endif
+    }
+
+    void fastLog(float* values, size_t count)
+    {
+#if OCR_ACTIVATION_X64
+        static const ArrayFunction function =
+            selectArrayFunction(applyScalar<logScalar>, applyAvx2<logAvx2>, applyAvx512<logAvx512>);
+        function(values, count);
+#else
+        applyScalar<logScalar>(values, count);
+#endif
+    }
+
+    void fastSigmoid(float* values, size_t count)
+    {
+#if OCR_ACTIVATION_X64
+        static const ArrayFunction function =
+            selectArrayFunction(applyScalar<sigmoidScalar>, applyAvx2<sigmoidAvx2>, applyAvx512<sigmoidAvx512>);
+        function(values, count);
+#else
+        applyScalar<sigmoidScalar>(values, count);
+#endif
+    }
+
+    float rowMax(const float* row, int cols)
+    {
+        float alpha = row[0];
+        for (int j = 1; j < cols; ++j)
+        {
+            if (row[j] > alpha) alpha = row[j];
+        }
+
+        return alpha;
+    }
+
+    /// @brief 1 回の SIMD の関数呼び出しで扱う、スタック上の作業領域の要素数
+    constexpr int chunkSize = 256;
+}
+
+namespace ocr
+{
+    const char* ActivationModeName(ActivationMode mode)
+    {
+        switch (mode)
+        {
+        case ActivationMode::Exact: return "Exact";
+        case ActivationMode::Fast: return "Fast";
+        default: return "Unknown";
+        }
+    }
+
+    float FastExp(float x)
+    {
+        fastExp(&x, 1);
+        return x;
+    }
+
+    float FastLog(float x)
+    {
+        fastLog(&x, 1);
+        return x;
+    }
+
+    void ExpInPlace(float* values, size_t count, ActivationMode mode)
+    {
+        if (mode == ActivationMode::Fast)
+        {
+            fastExp(values, count);
+            return;
+        }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            values[i] = std::expf(values[i]);
+        }
+    }
+
+    void LogInPlace(float* values, size_t count, ActivationMode mode)
+    {
+        if (mode == ActivationMode::Fast)
+        {
+            fastLog(values, count);
+            return;
+        }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            values[i] = std::logf(values[i]);
+        }
+    }
+
+    void SigmoidInPlace(float* values, size_t count, ActivationMode mode)
+    {
+        if (mode == ActivationMode::Fast)
+        {
+            fastSigmoid(values, count);
+            return;
+        }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            values[i] = 1.0f / (1.0f + std::expf(-values[i]));
+        }
+    }
+
+    void SigmoidInPlace(Matrix& a, ActivationMode mode)
+    {
+        if (a.isContiguous())
+        {
+            SigmoidInPlace(a[0], static_cast<size_t>(a.rows()) * a.cols(), mode);
+            return;
+        }
+
+        // 行の末尾の隙間は 0 のまま残す
+        for (int i = 0; i < a.rows(); ++i)
+        {
+            SigmoidInPlace(a[i], a.cols(), mode);
+        }
+    }
+
+    void SoftmaxRowsInPlace(float* a, int rows, int cols, ActivationMode mode)
+    {
+        if (mode == ActivationMode::Fast)
+        {
+            for (int i = 0; i < rows; ++i)
+            {
+                float* row = a + static_cast<size_t>(i) * cols;
+                const float alpha = rowMax(row, cols);
+                for (int j = 0; j < cols; ++j)
+                {
+                    row[j] -= alpha;
+                }
+            }
+
+            fastExp(a, static_cast<size_t>(rows) * cols);
+
+            for (int i = 0; i < rows; ++i)
+            {
+                float* row = a + static_cast<size_t>(i) * cols;
+                float sum{};
+                for (int j = 0; j < cols; ++j)
+                {
+                    sum += row[j];
+                }
+
+                const float inverse = 1.0f / sum;
+                for (int j = 0; j < cols; ++j)
+                {
+                    row[j] *= inverse;
+                }
+            }
+
+            return;
+        }
+
+        for (int i = 0; i < rows; ++i)
+        {
+            float* row = a + static_cast<size_t>(i) * cols;
+            const float alpha = rowMax(row, cols);
+
+            float sum{};
+            for (int j = 0; j < cols; ++j)
+            {
+                row[j] = std::expf(row[j] - alpha);
+                sum += row[j];
+            }
+
+            for (int j = 0; j < cols; ++j)
+            {
+                row[j] = row[j] / sum;
+            }
+        }
+    }
+
+    void SoftmaxRowsInPlace(Matrix& a, ActivationMode mode)
+    {
+        if (a.isContiguous())
+        {
+            SoftmaxRowsInPlace(a[0], a.rows(), a.cols(), mode);
+            return;
+        }
+
+        for (int i = 0; i < a.rows(); ++i)
+        {
+            SoftmaxRowsInPlace(a[i], 1, a.cols(), mode);
+        }
+    }
+
+    void LogSoftmaxRowsInPlace(float* a, int rows, int cols, ActivationMode mode)
+    {
+        // 最大値を引いた値を残しつつ、exp の和は作業領域で求める。
+        // 作業領域に収まるだけの行をまとめて exp を取り、列が少なくても SIMD のレーンを埋める
+        float exps[chunkSize];
+        float logSums[chunkSize];
+        const int rowsPerChunk = std::max(1, chunkSize / cols);
+        for (int firstRow = 0; firstRow < rows; firstRow += rowsPerChunk)
+        {
+            const int rowCount = std::min(rowsPerChunk, rows - firstRow);
+            float* chunk = a + static_cast<size_t>(firstRow) * cols;
+            for (int i = 0; i < rowCount; ++i)
+            {
+                float* row = chunk + static_cast<size_t>(i) * cols;
+                const float alpha = rowMax(row, cols);
+                for (int j = 0; j < cols; ++j)
+                {
+                    row[j] -= alpha;
+                }
+
+                // 1 行が作業領域より長いときは、行を区切って exp の和を取る
+                logSums[i] = 0.0f;
+                for (int first = 0; cols > chunkSize && first < cols; first += chunkSize)
+                {
+                    const int count = std::min(chunkSize, cols - first);
+                    std::copy_n(row + first, count, exps);
+                    ExpInPlace(exps, count, mode);
+                    logSums[i] = std::accumulate(exps, exps + count, logSums[i]);
+                }
+            }
+
+            if (cols <= chunkSize)
+            {
+                const int count = rowCount * cols;
+                std::copy_n(chunk, count, exps);
+                ExpInPlace(exps, count, mode);
+                for (int i = 0; i < rowCount; ++i)
+                {
+                    logSums[i] = std::accumulate(exps + i * cols, exps + (i + 1) * cols, 0.0f);
+                }
+            }
+
+            LogInPlace(logSums, rowCount, mode);
+            for (int i = 0; i < rowCount; ++i)
+            {
+                float* row = chunk + static_cast<size_t>(i) * cols;
+                for (int j = 0; j < cols; ++j)
+                {
+                    row[j] -= logSums[i];
+                }
+            }
+        }
+    }
+
+    void LogSoftmaxRowsInPlace(Matrix& a, ActivationMode mode)
+    {
+        if (a.isContiguous())
+        {
+            LogSoftmaxRowsInPlace(a[0], a.rows(), a.cols(), mode);
+            return;
+        }
+
+        for (int i = 0; i < a.rows(); ++i)
+        {
+            LogSoftmaxRowsInPlace(a[i], 1, a.cols(), mode);
+        }
+    }
+
+    float CrossEntropyError(const Matrix& y, const int* trueLabels, ActivationMode mode)
+    {
+        float crossEntropyError = 0.0f;
+        if (mode == ActivationMode::Exact)
+        {
+            for (int n = 0; n < y.rows(); ++n)
+            {
+                crossEntropyError -= std::logf(y[n][trueLabels[n]] + 1e-7f); // Add small value to avoid log(0)
+            }
+
+            return crossEntropyError;
+        }
+
+        // 正解ラベルの確率を集めてから、まとめて log を取る
+        float probabilities[chunkSize];
+        for (int first = 0; first < y.rows(); first += chunkSize)
+        {
+            const int count = std::min(chunkSize, y.rows() - first);
+            for (int n = 0; n < count; ++n)
+            {
+                probabilities[n] = y[first + n][trueLabels[first + n]] + 1e-7f;
+            }
+
+            fastLog(probabilities, count);
+            for (int n = 0; n < count; ++n)
+            {
+                crossEntropyError -= probabilities[n];
+            }
+        }
+
+        return crossEntropyError;
+    }
+}
@@ -0,0 +1,57 @@
+﻿#pragma once
+#include "Matrix.h"
+
+namespace ocr
+{
+    /// @brief 活性化関数と損失の exp / log の計算方法
+    enum class ActivationMode
+    {
+        /// @brief 標準ライブラリの expf / logf を 1 要素ずつ呼ぶ (これまでと同じ結果になる)
+        Exact,
+
+        /// @brief 多項式近似の exp / log を AVX2 / AVX-512 で 8 / 16 要素ずつ計算する (GEMM と同じ命令セットを使う)
+        Fast,
+    };
+
+    const char* ActivationModeName(ActivationMode mode);
+
+    /// @brief Fast モードの exp。入力を [-87.34, 88.38] に切り詰め、2^n と [-ln2/2, ln2/2] の 6 次の多項式に分解する
+    /// @details 切り詰めた範囲内での誤差は最大 1 ULP (範囲内の全ての float で、倍精度の exp を float に丸めた値と比べた)。
+    /// 範囲外の入力は端の値になるので、0 や無限大は返さない。NaN の扱いは決めていない
+    float FastExp(float x);
+
+    /// @brief Fast モードの log。仮数を [√0.5, √2) に寄せ、1 の近くの 9 次の多項式で計算する
+    /// @details 誤差は最大 1 ULP (全ての正の正規化数で、倍精度の log を float に丸めた値と比べた)。
+    /// 0 以下、非正規化数、無限大と NaN の結果は決めていない
+    float FastLog(float x);
+
+    /// @brief values[i] = exp(values[i])
+    void ExpInPlace(float* values, size_t count, ActivationMode mode);
+
+    /// @brief values[i] = log(values[i])
+    void LogInPlace(float* values, size_t count, ActivationMode mode);
+
+    /// @brief values[i] = 1 / (1 + exp(-values[i]))
+    /// @details 誤差は Exact、Fast ともに最大 2 ULP ([-87, 87] の全ての float で倍精度の計算と比べた)。
+    /// Fast の AVX2 と AVX-512 の結果はビット単位で一致する (スカラー版は FMA を使わないので最後のビットが異なることがある)
+    void SigmoidInPlace(float* values, size_t count, ActivationMode mode);
+
+    void SigmoidInPlace(Matrix& a, ActivationMode mode);
+
+    /// @brief 連続した [rows][cols] の各行を softmax にする
+    /// @details Fast モードでは各行から最大値を引いた後、行をまたいでバッチ全体の exp をまとめて計算する
+    /// (出力層のように列が少なくても SIMD のレーンが埋まる)
+    void SoftmaxRowsInPlace(float* a, int rows, int cols, ActivationMode mode);
+
+    /// @note 行の間に隙間のある行列 (MatrixLayout::Padded) は 1 行ずつ計算する
+    void SoftmaxRowsInPlace(Matrix& a, ActivationMode mode);
+
+    /// @brief 連続した [rows][cols] の各行を log(softmax) にする (a - max - log Σ exp(a - max))
+    void LogSoftmaxRowsInPlace(float* a, int rows, int cols, ActivationMode mode);
+
+    void LogSoftmaxRowsInPlace(Matrix& a, ActivationMode mode);
+
+    /// @brief softmax の出力 y の各行について -log(y[n][trueLabels[n]] + 1e-7) を足し合わせる
+    /// @param trueLabels y の行数と同じ数の正解ラベル
+    float CrossEntropyError(const Matrix& y, const int* trueLabels, ActivationMode mode);
+}
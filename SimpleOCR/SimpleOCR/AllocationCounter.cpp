@@ -0,0 +1,121 @@
+﻿#include "pch.h"
+#include "AllocationCounter.h"
+
+#if OCR_COUNT_ALLOCATIONS
+
+namespace
+{
+    std::atomic<uint64_t> s_allocationCount{};
+
+    void* allocate(std::size_t size)
+    {
+        s_allocationCount.fetch_add(1, std::memory_order_relaxed);
+
+        if (void* p = std::malloc(size == 0 ? 1 : size)) return p;
+        throw std::bad_alloc{};
+    }
+
+    void* allocateAligned(std::size_t size, std::align_val_t alignment)
+    {
+        s_allocationCount.fetch_add(1, std::memory_order_relaxed);
+
+        const auto align = static_cast<std::size_t>(alignment);
+#ifdef _MSC_VER
+        void* p = _aligned_malloc(size == 0 ? 1 : size, align);
+#else
+        // aligned_alloc はサイズがアライメントの倍数であることを要求する
+        void* p = std::aligned_alloc(align, (size + align - 1) / align * align);
+#endif
+        if (p) return p;
+        throw std::bad_alloc{};
+    }
+
+    void deallocateAligned(void* p)
+    {
+#ifdef _MSC_VER
+        _aligned_free(p);
+#else
+        std::free(p);
+#endif
+    }
+}
+
+void* operator new(std::size_t size)
+{
+    return allocate(size);
+}
+
+void* operator new[](std::size_t size)
+{
+    return allocate(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    return allocateAligned(size, alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment)
+{
+    return allocateAligned(size, alignment);
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+    deallocateAligned(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept
+{
+    deallocateAligned(p);
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept
+{
+    deallocateAligned(p);
+}
+
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept
+{
+    deallocateAligned(p);
+}
+
+namespace ocr
+{
+    uint64_t HeapAllocationCount()
+    {
+        return s_allocationCount.load(std::memory_order_relaxed);
+    }
+}
+
+#else
+
+namespace ocr
+{
+    uint64_t HeapAllocationCount()
+    {
+        return 0;
+    }
+}
+
+#endif
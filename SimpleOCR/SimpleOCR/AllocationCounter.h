@@ -0,0 +1,17 @@
+﻿#pragma once
+
+// デバッグビルドではグローバルな operator new を置き換えて、ヒープ確保の回数を数える
+#ifndef OCR_COUNT_ALLOCATIONS
+#ifdef _DEBUG
+#define OCR_COUNT_ALLOCATIONS 1
+#else
+#define OCR_COUNT_ALLOCATIONS 0
+#endif
+#endif
+
+namespace ocr
+{
+    /// @brief プロセス開始からのヒープ確保の回数 (全スレッドの合計)
+    /// @note OCR_COUNT_ALLOCATIONS が 0 のときは常に 0 を返す
+    uint64_t HeapAllocationCount();
+}
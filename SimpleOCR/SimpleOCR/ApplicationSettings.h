@@ -1,10 +1,42 @@
-#pragma once
+﻿#pragma once
+#include "Activation.h"
+#include "GemmKernel.h"
+#include "LinearAlgebraBackend.h"
+#include "Optimizer.h"
 
 namespace ocr
 {
     struct ApplicationSettings
     {
+        /// @brief ヘッドレスのビルド (OCR_HEADLESS) には GPU の実装が含まれないので、常に CPU を使う
+#if OCR_HEADLESS
+        bool useGpu = false;
+#else
         bool useGpu = true;
+#endif
+
+        /// @brief CPU での学習に使うスレッド数 (1 なら呼び出し元スレッドのみ)
+        int trainingThreadCount = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+
+        /// @brief CPU での学習をバッチ同期ではなく Hogwild! 方式の非同期 SGD で行う
+        bool useHogwild = false;
+
+        /// @brief 同期ミニバッチ学習 (CPU と GPU) でパラメータを更新する規則。学習率は DefaultOptimizerSettings() に従う
+        OptimizerType optimizer = OptimizerType::Sgd;
+
+        /// @brief CPU での sigmoid, softmax と損失の exp / log の計算方法 (Exact はこれまでと同じ結果になる)
+        ActivationMode activationMode = ActivationMode::Exact;
+
+        /// @brief CPU の順伝搬と逆伝搬の float の行列積 (NP と DataParallelTrainer) を計算するバックエンド。Blas は使えるビルドでだけ選ぶ
+        LinearAlgebraBackend linearAlgebraBackend = LinearAlgebraBackend::Simd;
+
+        /// @brief CPU での推論 (正解率の計算と画像の判定) に int8 に量子化したパラメータを使う
+        bool useQuantizedInference = false;
+
+        /// @brief CPU での学習の順伝搬と推論で、第 1 層の重みを halfWeightFormat の半精度で読む (更新は float のマスターに行う)
+        bool useHalfPrecisionWeights = false;
+
+        HalfFormat halfWeightFormat = HalfFormat::BFloat16;
     };
 
     inline ApplicationSettings g_applicationSettings{};
@@ -1,14 +1,20 @@
 ﻿#include "pch.h"
 #include "BackPropagation.h"
 
+#include "Activation.h"
 #include "ApplicationSettings.h"
+#include "GemmKernel.h"
 #include "NP.h"
+#include "PhaseProfiler.h"
+#include "StaticNeuralNetwork.h"
+#if not OCR_HEADLESS
 #include "TY/Gpgpu.h"
 #include "TY/GpgpuBuffer.h"
 #include "TY/InlineComponent.h"
 #include "TY/Logger.h"
 #include "TY/ScopedDeferStack.h"
 #include "TY/Shader.h"
+#endif
 
 using namespace ocr;
 
@@ -36,10 +42,59 @@ namespace
         return error;
     }
 
+    /// @brief 中間層と出力層が mnistTopology の形のとき、cpuBackPropagation() の逆伝搬を形を固定したループで行う
+    /// @details NP の関数が作る一時配列と W2 の転置行列の確保がなくなり、dW1 は画素が 0 でない行だけを書く
+    BackPropagationOutput staticBackPropagation(const BackPropagationInput& input, const NeuralNetworkOutput& neuralOutput)
+    {
+        constexpr int midCount = mnistTopology.midCount;
+        constexpr int outputCount = mnistTopology.outputCount;
+
+        BackPropagationOutput output{};
+
+        // <-- softmax 逆伝搬
+        output.db2 = Array<float>(outputCount);
+        output.crossEntropyError = StaticOutputDeltas<outputCount>(
+            neuralOutput.y2.data(), input.trueLabel, static_cast<float>(input.batches), output.db2.data());
+
+        output.dw2 = Matrix(midCount, outputCount);
+        StaticAddOuterProduct<midCount, outputCount>(neuralOutput.y1.data(), output.db2.data(), output.dw2[0]);
+
+        // <-- sigmoid 逆伝搬
+        float w2Transposed[outputCount * midCount];
+        StaticTranspose<midCount, outputCount>(input.params.w2[0], w2Transposed);
+
+        output.db1 = Array<float>(midCount);
+        StaticHiddenDeltas<midCount, outputCount>(output.db2.data(), w2Transposed, neuralOutput.y1.data(), output.db1.data());
+
+        // 入力の長さは画像の大きさで変わるので、行の数だけは実行時に決める
+        const int inputCount = static_cast<int>(input.x.size());
+        output.dw1 = Matrix(inputCount, midCount);
+        for (int i = 0; i < inputCount; ++i)
+        {
+            StaticAddOuterProduct<1, midCount>(&input.x[i], output.db1.data(), output.dw1[i]);
+        }
+
+        return output;
+    }
+
     BackPropagationOutput cpuBackPropagation(const BackPropagationInput& input)
     {
         BackPropagationOutput output{};
-        const auto neuralOutput = NeuralNetwork(input.x, input.params);
+        NeuralNetworkOutput neuralOutput{};
+        {
+            OCR_PROFILE_SCOPE(Forward);
+            neuralOutput = NeuralNetwork(input.x, input.params);
+        }
+
+        OCR_PROFILE_SCOPE(Backward);
+
+        if (neuralOutput.y1.size() == mnistTopology.midCount &&
+            input.params.w2.rows() == mnistTopology.midCount &&
+            input.params.w2.cols() == mnistTopology.outputCount &&
+            input.params.w2.isContiguous())
+        {
+            return staticBackPropagation(input, neuralOutput);
+        }
 
         const Array<float>& x = input.x;
 
@@ -47,8 +102,8 @@ namespace
 
         // -----------------------------------------------
 
-        // <-- softmax 逆伝搬
-        const Array<float> da2 = NP::Divide(NP::Subtract(neuralOutput.y2, trueY), input.batches);
+        // <-- softmax 逆伝搬: 引き算と割り算を 1 回のループで行う
+        const Array<float> da2 = NP::Materialize((NP::Lazy(neuralOutput.y2) - NP::Lazy(trueY)) / input.batches);
 
         output.dw2 = NP::OuterProduct(neuralOutput.y1, da2);
 
@@ -56,15 +111,10 @@ namespace
 
         // -----------------------------------------------
 
-        // <-- sigmoid 逆伝搬
-        const Array<float> sigmoidGradient =
-            NP::HadamardProduct(neuralOutput.y1,
-                                NP::Subtract(Array<float>(neuralOutput.y1.size(), 1.0f), neuralOutput.y1));
-
-        const Array<float> da1 = NP::HadamardProduct(
-            NP::VecMat(da2, input.params.w2.transposed()).data(),
-            sigmoidGradient
-        );
+        // <-- sigmoid 逆伝搬: dA1 = (dA2 * W2^T) ⊙ Y1 ⊙ (1 - Y1) を、sigmoid の勾配の配列を作らずに求める
+        const Matrix da2W2 = NP::VecMat(da2, input.params.w2.transposedView());
+        const NP::ArrayExpression y1 = NP::Lazy(neuralOutput.y1);
+        const Array<float> da1 = NP::Materialize(NP::Lazy(da2W2) * (y1 * (1.0f - y1)));
 
         output.dw1 = NP::OuterProduct(x, da1);
 
@@ -76,8 +126,129 @@ namespace
         return output;
     }
 
+    void resizeZero(Matrix& a, int rows, int cols)
+    {
+        a.resize(rows, cols);
+        std::fill(a.data().begin(), a.data().end(), 0.0f);
+    }
+
+    /// @brief 勾配のバッファを、対応するパラメータと同じ形と並べ方にしてゼロで埋める
+    void resizeZeroLike(Matrix& a, const Matrix& param)
+    {
+        a.resize(param.rows(), param.cols(), param.layout());
+        std::fill(a.data().begin(), a.data().end(), 0.0f);
+    }
+
+    /// @brief 順伝搬と各層の誤差 dA2, dA1 まで求める。入力が疎なら勾配の計算に使う X^T を作業領域に用意する
+    /// @details 密な X^T, Y1^T, W2^T は作らず、GEMM に転置フラグを渡して元の行列を読む
+    float cpuBatchBackPropagationDeltas(const BatchBackPropagationInput& input,
+                                        int firstRow,
+                                        int rowCount,
+                                        const NeuralNetworkParameters& params,
+                                        BatchBackPropagationWorkspace& workspace,
+                                        const HalfMatrix* halfW1 = nullptr)
+    {
+        assert(firstRow >= 0 && firstRow + rowCount <= input.x.rows());
+        assert(input.x.rows() == input.trueLabels.size());
+
+        // 入力が十分に疎なら、第 1 層の順伝搬と X^T を非ゼロ要素だけで作る (疎なカーネルは SIMD のバックエンドにだけある)
+        workspace.sparseInput =
+            SupportsSparseAndHalfKernels(g_applicationSettings.linearAlgebraBackend) &&
+            input.sparseX.rows() == input.x.rows() &&
+            PreferSparseInput(input.sparseX.density(firstRow, rowCount));
+
+        {
+            OCR_PROFILE_SCOPE(Forward);
+            BatchNeuralNetwork(input.x, firstRow, rowCount, params, workspace.forward,
+                               workspace.sparseInput ? &input.sparseX : nullptr,
+                               halfW1);
+        }
+
+        OCR_PROFILE_SCOPE(Backward);
+
+        const Matrix& y1 = workspace.forward.y1;
+        const Matrix& y2 = workspace.forward.y2;
+
+        // -----------------------------------------------
+
+        // <-- softmax 逆伝搬: dA2 = (Y2 - T) / batches
+        Matrix& da2 = workspace.da2;
+        da2.resize(rowCount, y2.cols());
+        for (int n = 0; n < rowCount; ++n)
+        {
+            const int trueLabel = input.trueLabels[firstRow + n];
+            assert(trueLabel >= 0 && trueLabel < y2.cols());
+
+            for (int j = 0; j < y2.cols(); ++j)
+            {
+                const float trueY = j == trueLabel ? 1.0f : 0.0f;
+                da2[n][j] = (y2[n][j] - trueY) / input.batches;
+            }
+        }
+
+        const float crossEntropyError = CrossEntropyError(y2, &input.trueLabels[firstRow], g_applicationSettings.activationMode);
+
+        // -----------------------------------------------
+
+        // <-- sigmoid 逆伝搬: dA1 = (dA2 * W2^T) ⊙ Y1 ⊙ (1 - Y1)
+        Matrix& da1 = workspace.da1;
+        resizeZero(da1, rowCount, y1.cols());
+        NP::GEMM(da2, params.w2.transposedView(), da1);
+        NP::Evaluate(NP::Lazy(da1) * (NP::Lazy(y1) * (1.0f - NP::Lazy(y1))), da1);
+
+        workspace.xFirstRow = firstRow;
+        if (workspace.sparseInput)
+        {
+            input.sparseX.transposeRows(firstRow, rowCount, workspace.sparseXTransposed);
+        }
+
+        return crossEntropyError;
+    }
+
+    float cpuBatchBackPropagation(const BatchBackPropagationInput& input,
+                                  int firstRow,
+                                  int rowCount,
+                                  const NeuralNetworkParameters& params,
+                                  BatchBackPropagationWorkspace& workspace)
+    {
+        BackPropagationOutput& output = workspace.gradient;
+        output.crossEntropyError = cpuBatchBackPropagationDeltas(input, firstRow, rowCount, params, workspace);
+
+        OCR_PROFILE_SCOPE(Backward);
+
+        const Matrix& y1 = workspace.forward.y1;
+        const Matrix& da2 = workspace.da2;
+        const Matrix& da1 = workspace.da1;
+
+        resizeZeroLike(output.dw2, params.w2);
+        NP::GEMM(y1.transposedView(), da2, output.dw2); // dW2 = Y1^T * dA2
+
+        NP::ColumnSum(da2, output.db2);
+
+        resizeZeroLike(output.dw1, params.w1);
+        if (workspace.sparseInput)
+        {
+            // dW1 = X^T * dA1 を非ゼロの画素の行だけ計算する
+            const SparseRows& xTransposed = workspace.sparseXTransposed;
+            SparseGemmKernel(xTransposed.rows(), da1.cols(),
+                             xTransposed.offsets.data(), xTransposed.indices.data(), xTransposed.values.data(),
+                             da1[0], da1.stride(),
+                             output.dw1[0], output.dw1.stride());
+        }
+        else
+        {
+            // dW1 = X^T * dA1: 担当した行の X をコピーも転置もせずに読む
+            NP::GEMM(input.x.rowRange(firstRow, rowCount).transposedView(), da1, output.dw1);
+        }
+
+        NP::ColumnSum(da1, output.db1);
+
+        return output.crossEntropyError;
+    }
+
     // -----------------------------------------------
 
+#if not OCR_HEADLESS
     struct GpuBackPropagation : IInlineComponent
     {
         bool initialized{};
@@ -143,7 +314,7 @@ namespace
         const Array<float> trueY = oneHotEncoding(input.trueLabel, neuralOutput.output().size());
 
         // <-- softmax 逆伝搬 (最初の小規模な部分は CPU で計算)
-        const Array<float> da2 = NP::Divide(NP::Subtract(neuralOutput.y2, trueY), input.batches);
+        const Array<float> da2 = NP::Materialize((NP::Lazy(neuralOutput.y2) - NP::Lazy(trueY)) / input.batches);
         output.db2 = da2;
 
         output.dw2 = Matrix(neuralOutput.y1.size(), da2.size());
@@ -188,12 +359,44 @@ namespace
 #endif
         return output;
     }
+#endif
 }
 
 namespace ocr
 {
     BackPropagationOutput BackPropagation(const BackPropagationInput& input)
     {
-        return g_applicationSettings.useGpu ? gpuBackPropagation(input) : cpuBackPropagation(input);
+#if not OCR_HEADLESS
+        // GPU のシェーダーは行が隙間なく並んだ重みを読むので、Padded の重みは CPU で計算する
+        if (g_applicationSettings.useGpu && input.params.w1.isContiguous() && input.params.w2.isContiguous()) return gpuBackPropagation(input);
+#endif
+        return cpuBackPropagation(input);
+    }
+
+    BackPropagationOutput BatchBackPropagation(const BatchBackPropagationInput& input,
+                                               const NeuralNetworkParameters& params)
+    {
+        BatchBackPropagationWorkspace workspace{};
+        cpuBatchBackPropagation(input, 0, input.x.rows(), params, workspace);
+        return std::move(workspace.gradient);
+    }
+
+    float BatchBackPropagation(const BatchBackPropagationInput& input,
+                               int firstRow,
+                               int rowCount,
+                               const NeuralNetworkParameters& params,
+                               BatchBackPropagationWorkspace& workspace)
+    {
+        return cpuBatchBackPropagation(input, firstRow, rowCount, params, workspace);
+    }
+
+    float BatchBackPropagationDeltas(const BatchBackPropagationInput& input,
+                                     int firstRow,
+                                     int rowCount,
+                                     const NeuralNetworkParameters& params,
+                                     BatchBackPropagationWorkspace& workspace,
+                                     const HalfMatrix* halfW1)
+    {
+        return cpuBatchBackPropagationDeltas(input, firstRow, rowCount, params, workspace, halfW1);
     }
 }
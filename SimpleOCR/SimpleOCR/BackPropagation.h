@@ -1,6 +1,7 @@
 ﻿#pragma once
 #include "Matrix.h"
 #include "NeuralNetwork.h"
+#include "SparseInput.h"
 
 namespace ocr
 {
@@ -8,7 +9,8 @@ namespace ocr
     {
         Array<float> x;
 
-        NeuralNetworkParameters params;
+        /// @brief 学習中のパラメータを借りる (サンプルごとに複製しない)
+        const NeuralNetworkParameters& params;
 
         int trueLabel;
 
@@ -29,5 +31,66 @@ namespace ocr
         Array<float> db2; // [出力ノード数]
     };
 
+    struct BatchBackPropagationInput
+    {
+        Matrix x; // [バッチ数][入力ノード数]
+
+        Array<int> trueLabels; // [バッチ数]
+
+        /// @brief 勾配を割る数 (x の行数がバッチの一部でも、ミニバッチ全体のサイズを渡す)
+        int batches;
+
+        /// @brief x の非ゼロ要素 (任意)。x と同じ行数があり十分に疎なら、第 1 層を疎なカーネルで計算する
+        SparseRows sparseX{};
+    };
+
+    /// @brief バッチ逆伝搬の作業領域。呼び出し側が持ち、サンプルやバッチをまたいで使い回す
+    /// @details 担当する行数とパラメータの形が前回と同じなら、ヒープ確保を一切行わない
+    struct BatchBackPropagationWorkspace
+    {
+        BatchNeuralNetworkOutput forward{};
+
+        Matrix da2{}; // [行数][出力ノード数]
+
+        Matrix da1{}; // [行数][中間ノード数]
+
+        /// @brief 担当した行の先頭。密な X^T * dA1 は転置を作らず、入力の x のこの行から転置フラグで読む
+        int xFirstRow{};
+
+        /// @brief 直前の計算で入力が疎と判定され、sparseXTransposed を作ったか
+        bool sparseInput{};
+
+        SparseRows sparseXTransposed{}; // [入力ノード数] 行 x [行数] 列
+
+        /// @brief 求めた勾配 (crossEntropyError は担当した行の総和)
+        BackPropagationOutput gradient{};
+    };
+
     BackPropagationOutput BackPropagation(const BackPropagationInput& input);
+
+    /// @brief バッチ全体をまとめて逆伝搬し、バッチで総和を取った勾配を返す (CPU のみ)
+    /// @note crossEntropyError もバッチ内の総和になる
+    BackPropagationOutput BatchBackPropagation(const BatchBackPropagationInput& input,
+                                               const NeuralNetworkParameters& params);
+
+    /// @brief input.x の [firstRow, firstRow + rowCount) 行を逆伝搬し、勾配を workspace.gradient に書き込む
+    /// @details パラメータは参照で借りるだけで複製しない。ウォームアップ後はヒープ確保が起きない (CPU のみ)
+    /// @return 担当した行のクロスエントロピー誤差の総和
+    float BatchBackPropagation(const BatchBackPropagationInput& input,
+                               int firstRow,
+                               int rowCount,
+                               const NeuralNetworkParameters& params,
+                               BatchBackPropagationWorkspace& workspace);
+
+    /// @brief 勾配の行列を作らずに、各層の誤差 dA2, dA1 と転置 X^T, Y1^T だけを workspace に求める
+    /// @details 入力が疎なら X^T は workspace.sparseXTransposed に作られる (workspace.sparseInput で判定する)
+    /// @details 勾配は dW1 = X^T * dA1, dW2 = Y1^T * dA2 として、呼び出し側が足し込み先へ直接計算する
+    /// @param halfW1 nullptr でなければ、順伝搬の第 1 層は params.w1 の代わりにこの半精度の重みを読む (逆伝搬は W1 を使わない)
+    /// @return 担当した行のクロスエントロピー誤差の総和
+    float BatchBackPropagationDeltas(const BatchBackPropagationInput& input,
+                                     int firstRow,
+                                     int rowCount,
+                                     const NeuralNetworkParameters& params,
+                                     BatchBackPropagationWorkspace& workspace,
+                                     const HalfMatrix* halfW1 = nullptr);
 }
@@ -0,0 +1,124 @@
+﻿#include "pch.h"
+#include "BatchEvaluator.h"
+
+#include "PhaseProfiler.h"
+
+using namespace ocr;
+
+namespace ocr
+{
+    BatchEvaluator::BatchEvaluator(int threadCount, int tileSize)
+        : m_pool(std::max(1, threadCount)),
+          m_tileSize(std::max(1, tileSize)),
+          m_workspaces(m_pool.threadCount())
+    {
+    }
+
+    EvaluationResult BatchEvaluator::evaluate(const DatasetImageList& images,
+                                              const Array<uint8_t>& labels,
+                                              const NeuralNetworkParameters& params)
+    {
+        return evaluate(images, labels, params.w2.cols(), [&](const PixelBatch& x, Workspace& ws)
+        {
+            BatchNeuralNetwork(x, params, ws.output);
+        });
+    }
+
+    EvaluationResult BatchEvaluator::evaluate(const DatasetImageList& images,
+                                              const Array<uint8_t>& labels,
+                                              const QuantizedNeuralNetworkParameters& params)
+    {
+        return evaluate(images, labels, params.w2.cols(), [&](const PixelBatch& x, Workspace& ws)
+        {
+            QuantizedBatchNeuralNetwork(x, params, ws.output, ws.accumulator);
+        });
+    }
+
+    EvaluationResult BatchEvaluator::evaluate(const DatasetImageList& images,
+                                              const Array<uint8_t>& labels,
+                                              const HalfNeuralNetworkParameters& params)
+    {
+        return evaluate(images, labels, params.w2.cols(), [&](const PixelBatch& x, Workspace& ws)
+        {
+            HalfBatchNeuralNetwork(x, params, ws.output);
+        });
+    }
+
+    template <class Forward>
+    EvaluationResult BatchEvaluator::evaluate(const DatasetImageList& images,
+                                              const Array<uint8_t>& labels,
+                                              int labelCount,
+                                              const Forward& forward)
+    {
+        if (labels.size() < images.size())
+        {
+            throw std::invalid_argument("Label count is less than image count.");
+        }
+
+        // 混同行列はラベルで添字を引くので、出力の数を超えるラベルはタイルを配る前に弾く
+        const size_t imageCount = images.size();
+        const auto invalidLabel = std::find_if(labels.begin(), labels.begin() + imageCount,
+                                               [&](uint8_t label) { return label >= labelCount; });
+        if (invalidLabel != labels.begin() + imageCount)
+        {
+            throw std::invalid_argument("Label " + std::to_string(*invalidLabel) + " is out of range for a network with " +
+                                        std::to_string(labelCount) + " outputs.");
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+
+        const int tileCount = static_cast<int>((imageCount + m_tileSize - 1) / m_tileSize);
+
+        for (auto& ws : m_workspaces)
+        {
+            ws.confusionMatrix.assign(static_cast<size_t>(labelCount) * labelCount, 0);
+        }
+
+        // スレッドごとに 1 つのタスクを起動し、共有のカウンタから早い者勝ちでタイルを取り出す
+        std::atomic<int> nextTile{};
+        m_pool.parallelFor(threadCount(), [&](int worker)
+        {
+            Workspace& ws = m_workspaces[worker];
+
+            int tile;
+            while ((tile = nextTile.fetch_add(1, std::memory_order_relaxed)) < tileCount)
+            {
+                OCR_PROFILE_SCOPE(Evaluation);
+
+                const size_t first = static_cast<size_t>(tile) * m_tileSize;
+                const size_t count = std::min(static_cast<size_t>(m_tileSize), imageCount - first);
+
+                forward(images.batch(first, count), ws);
+
+                for (int i = 0; i < static_cast<int>(count); ++i)
+                {
+                    const int trueLabel = labels[first + i];
+                    ws.confusionMatrix[trueLabel * labelCount + ws.output.maxIndex(i)]++;
+                }
+            }
+        });
+
+        EvaluationResult result{
+            .sampleCount = static_cast<int>(imageCount),
+            .labelCount = labelCount,
+            .confusionMatrix = Array<int>(static_cast<size_t>(labelCount) * labelCount, 0)
+        };
+
+        for (const auto& ws : m_workspaces)
+        {
+            for (size_t i = 0; i < result.confusionMatrix.size(); ++i)
+            {
+                result.confusionMatrix[i] += ws.confusionMatrix[i];
+            }
+        }
+
+        for (int label = 0; label < labelCount; ++label)
+        {
+            result.correctCount += result.confusion(label, label);
+        }
+
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        result.elapsedSeconds = elapsed.count();
+        return result;
+    }
+}
@@ -0,0 +1,89 @@
+﻿#pragma once
+#include "DatasetImage.h"
+#include "HalfNeuralNetwork.h"
+#include "NeuralNetwork.h"
+#include "QuantizedNeuralNetwork.h"
+#include "ThreadPool.h"
+
+namespace ocr
+{
+    struct EvaluationResult
+    {
+        int sampleCount{};
+
+        int correctCount{};
+
+        int labelCount{};
+
+        /// @brief [正解ラベル][予測したラベル] ごとの画像の数
+        Array<int> confusionMatrix{};
+
+        double elapsedSeconds{};
+
+        float accuracy() const
+        {
+            return sampleCount > 0 ? static_cast<float>(correctCount) / sampleCount : 0.0f;
+        }
+
+        double samplesPerSecond() const
+        {
+            return elapsedSeconds > 0.0 ? sampleCount / elapsedSeconds : 0.0;
+        }
+
+        int confusion(int trueLabel, int predictedLabel) const
+        {
+            return confusionMatrix[trueLabel * labelCount + predictedLabel];
+        }
+    };
+
+    /// @brief データセット全体をタイル (連続した画像のバッチ) に分け、スレッドプールで並列に順伝搬して評価する (CPU のみ)
+    /// @details 画素は uint8 のまま第 1 層の GEMM で読む。作業領域はスレッドごとに使い回すので、
+    /// 2 回目以降の評価ではタイルの形が同じである限りヒープ確保をしない
+    class BatchEvaluator
+    {
+    public:
+        /// @param tileSize 1 回の順伝搬でまとめて計算する画像の数
+        explicit BatchEvaluator(int threadCount, int tileSize = 256);
+
+        int threadCount() const
+        {
+            return m_pool.threadCount();
+        }
+
+        EvaluationResult evaluate(const DatasetImageList& images,
+                                  const Array<uint8_t>& labels,
+                                  const NeuralNetworkParameters& params);
+
+        /// @brief int8 に量子化したパラメータで評価する
+        EvaluationResult evaluate(const DatasetImageList& images,
+                                  const Array<uint8_t>& labels,
+                                  const QuantizedNeuralNetworkParameters& params);
+
+        /// @brief 第 1 層の重みを半精度にしたパラメータで評価する
+        EvaluationResult evaluate(const DatasetImageList& images,
+                                  const Array<uint8_t>& labels,
+                                  const HalfNeuralNetworkParameters& params);
+
+    private:
+        struct Workspace
+        {
+            BatchNeuralNetworkOutput output{};
+
+            Array<int32_t> accumulator{};
+
+            Array<int> confusionMatrix{};
+        };
+
+        template <class Forward>
+        EvaluationResult evaluate(const DatasetImageList& images,
+                                  const Array<uint8_t>& labels,
+                                  int labelCount,
+                                  const Forward& forward);
+
+        ThreadPool m_pool;
+
+        int m_tileSize;
+
+        Array<Workspace> m_workspaces{};
+    };
+}
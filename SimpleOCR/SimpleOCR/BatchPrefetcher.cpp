@@ -0,0 +1,153 @@
+﻿#include "pch.h"
+#include "BatchPrefetcher.h"
+
+#include "PhaseProfiler.h"
+
+namespace ocr
+{
+    BatchPrefetcher::BatchPrefetcher(const DatasetImageList& images,
+                                     const Array<uint8_t>& labels,
+                                     int batchSize,
+                                     const ActivePixelIndex* activePixels,
+                                     std::optional<uint32_t> shuffleSeed) :
+        m_images(images),
+        m_labels(labels),
+        m_batchSize(batchSize),
+        m_batchesPerEpoch(static_cast<int>(images.size()) / batchSize),
+        m_activePixels(activePixels && PreferSparseInput(activePixels->density()) ? activePixels : nullptr),
+        m_shuffleSeed(shuffleSeed ? *shuffleSeed : std::random_device{}())
+    {
+        if (batchSize <= 0 || m_batchesPerEpoch == 0 || labels.size() < images.size())
+        {
+            throw std::invalid_argument("Dataset is too small for the batch size.");
+        }
+
+        for (int i = 0; i < bufferCount; ++i)
+        {
+            m_buffers[i] = BatchBackPropagationInput{
+                .x = Matrix(batchSize, images.property().pixelCount()),
+                .trueLabels = Array<int>(batchSize),
+                .batches = batchSize
+            };
+
+            if (m_activePixels)
+            {
+                // 非ゼロ要素の数はバッチごとに変わるので、密な場合の大きさまで先に確保しておく
+                const size_t capacity = static_cast<size_t>(batchSize) * images.property().pixelCount();
+                m_buffers[i].sparseX.offsets.reserve(batchSize + 1);
+                m_buffers[i].sparseX.indices.reserve(capacity);
+                m_buffers[i].sparseX.values.reserve(capacity);
+            }
+
+            m_freeBuffers.push(i);
+        }
+
+        m_producer = std::thread{[this]() { producerLoop(); }};
+    }
+
+    BatchPrefetcher::~BatchPrefetcher()
+    {
+        // 手元のバッファを返してから停止を伝える。生産者は空きバッファを待つ場所でしか止まらない
+        if (m_acquiredBuffer != stopSignal)
+        {
+            release();
+        }
+
+        // 生産者が最後のバッチを準備済みキューに積めるように、受け取っていないバッチを捨てて空ける
+        int buffer;
+        while (m_readyBuffers.tryPop(buffer))
+        {
+        }
+
+        m_freeBuffers.push(stopSignal);
+        m_producer.join();
+    }
+
+    const BatchBackPropagationInput& BatchPrefetcher::acquire()
+    {
+        assert(m_acquiredBuffer == stopSignal);
+
+        const int buffer = m_readyBuffers.pop();
+        if (buffer == stopSignal)
+        {
+            std::rethrow_exception(m_exception);
+        }
+
+        m_acquiredBuffer = buffer;
+        return m_buffers[buffer];
+    }
+
+    void BatchPrefetcher::release()
+    {
+        assert(m_acquiredBuffer != stopSignal);
+
+        m_freeBuffers.push(m_acquiredBuffer);
+        m_acquiredBuffer = stopSignal;
+    }
+
+    void BatchPrefetcher::producerLoop()
+    {
+        // Random は他のスレッドと共有しないよう、このスレッド専用の乱数で添字を並べ替える
+        std::mt19937 engine{m_shuffleSeed};
+
+        Array<int> indices(m_images.size());
+        std::iota(indices.begin(), indices.end(), 0);
+
+        try
+        {
+            while (true)
+            {
+                std::shuffle(indices.begin(), indices.end(), engine);
+
+                for (int batch = 0; batch < m_batchesPerEpoch; ++batch)
+                {
+                    const int buffer = m_freeBuffers.pop();
+                    if (buffer == stopSignal) return;
+
+                    fillBatch(indices, batch * m_batchSize, m_buffers[buffer]);
+
+                    m_readyBuffers.push(buffer);
+                }
+            }
+        }
+        catch (...)
+        {
+            m_exception = std::current_exception();
+            m_readyBuffers.push(stopSignal);
+        }
+    }
+
+    void BatchPrefetcher::fillBatch(const Array<int>& indices, int baseIndex, BatchBackPropagationInput& batch) const
+    {
+        OCR_PROFILE_SCOPE(Gather);
+
+        if (m_activePixels)
+        {
+            batch.sparseX.clear(batch.x.cols());
+        }
+
+        for (int i = 0; i < m_batchSize; ++i)
+        {
+            const int imageIndex = indices[baseIndex + i];
+            const DatasetImage image = m_images[imageIndex];
+
+            std::transform(image.begin(), image.end(), batch.x[i], [](uint8_t pixel)
+            {
+                return static_cast<float>(pixel) / 255.0f;
+            });
+
+            if (m_activePixels)
+            {
+                // キャッシュした非ゼロ画素の番号から、画像を走査せずに疎な行を作る
+                for (const uint16_t pixel : (*m_activePixels)[imageIndex])
+                {
+                    batch.sparseX.push(pixel, batch.x[i][pixel]);
+                }
+
+                batch.sparseX.endRow();
+            }
+
+            batch.trueLabels[i] = m_labels[imageIndex];
+        }
+    }
+}
@@ -0,0 +1,78 @@
+﻿#pragma once
+#include "BackPropagation.h"
+#include "DatasetImage.h"
+#include "SparseInput.h"
+#include "SpscQueue.h"
+
+namespace ocr
+{
+    /// @brief 学習中の次のミニバッチをバックグラウンドスレッドで用意する (CPU 学習用)
+    /// @details 生産者スレッドがエポックごとに添字をシャッフルし、画像を集めて正規化した連続バッファを作る。
+    /// バッファは 2 枚を使い回し (ダブルバッファ)、準備済みと空きのやり取りはロックフリーキューで行う。
+    /// 消費者は acquire() で準備済みのバッチを受け取り、使い終わったら release() で返す。
+    class BatchPrefetcher
+    {
+    public:
+        /// @param activePixels images の非ゼロ画素の番号 (任意)。データセットが十分に疎なら、
+        /// バッチの sparseX も一緒に作る。BatchPrefetcher より長く生存していること
+        /// @param shuffleSeed 添字のシャッフルに使う乱数の種。同じ種なら同じ順でバッチを作る (省略すると毎回変わる)
+        BatchPrefetcher(const DatasetImageList& images,
+                        const Array<uint8_t>& labels,
+                        int batchSize,
+                        const ActivePixelIndex* activePixels = nullptr,
+                        std::optional<uint32_t> shuffleSeed = std::nullopt);
+
+        ~BatchPrefetcher();
+
+        BatchPrefetcher(const BatchPrefetcher&) = delete;
+
+        BatchPrefetcher& operator=(const BatchPrefetcher&) = delete;
+
+        int batchesPerEpoch() const
+        {
+            return m_batchesPerEpoch;
+        }
+
+        /// @brief 次のバッチが用意できるまで待って返す。release() まで内容は変わらない
+        /// @note 生産者スレッドで起きた例外はここで再送出される
+        const BatchBackPropagationInput& acquire();
+
+        /// @brief acquire() で受け取ったバッチを生産者に返す
+        void release();
+
+    private:
+        static constexpr int bufferCount = 2;
+
+        /// @brief 生産者に停止を伝えるための番号
+        static constexpr int stopSignal = -1;
+
+        void producerLoop();
+
+        void fillBatch(const Array<int>& indices, int baseIndex, BatchBackPropagationInput& batch) const;
+
+        DatasetImageList m_images;
+
+        Array<uint8_t> m_labels;
+
+        int m_batchSize;
+
+        int m_batchesPerEpoch;
+
+        /// @brief 疎な入力も作るときだけ nullptr 以外
+        const ActivePixelIndex* m_activePixels;
+
+        uint32_t m_shuffleSeed;
+
+        std::array<BatchBackPropagationInput, bufferCount> m_buffers{};
+
+        SpscQueue<int, bufferCount> m_readyBuffers{}; // 生産者 -> 消費者
+
+        SpscQueue<int, bufferCount> m_freeBuffers{}; // 消費者 -> 生産者
+
+        int m_acquiredBuffer{stopSignal};
+
+        std::exception_ptr m_exception{};
+
+        std::thread m_producer{};
+    };
+}
@@ -0,0 +1,328 @@
+﻿#include "pch.h"
+#include "DataParallelTrainer.h"
+
+#include "ApplicationSettings.h"
+#include "GemmKernel.h"
+#include "Gradient.h"
+#include "HalfNeuralNetwork.h"
+#include "PhaseProfiler.h"
+
+using namespace ocr;
+
+namespace
+{
+    /// @brief trainStep() で W1 を更新するときの 1 タスクあたりの行数 (64 行 x 128 列 = 32 KB)
+    constexpr int updateBlockRows = 64;
+
+    void scaleInPlace(Matrix& a, float scale)
+    {
+        for (auto& value : a.data())
+        {
+            value *= scale;
+        }
+    }
+
+    void addColumnSums(const Matrix& a, Array<float>& b)
+    {
+        assert(a.cols() == b.size());
+
+        for (int i = 0; i < a.rows(); ++i)
+        {
+            for (int j = 0; j < a.cols(); ++j)
+            {
+                b[j] += a[i][j];
+            }
+        }
+    }
+
+    /// @brief 各スレッドの X^T * dA1 のうち、W1 の [firstRow, firstRow + blockRows) 行に当たる部分を target に足し込む
+    /// @param ldTarget target の行の先頭同士の距離 (W1 の stride)
+    void addW1Products(const Array<BatchBackPropagationWorkspace>& workspaces,
+                       int workers,
+                       const Matrix& x,
+                       int firstRow,
+                       int blockRows,
+                       float* target,
+                       int ldTarget)
+    {
+        const int midCount = workspaces[0].da1.cols();
+        for (int worker = 0; worker < workers; ++worker)
+        {
+            const BatchBackPropagationWorkspace& workspace = workspaces[worker];
+
+            // target += X^T[firstRow..] * dA1
+            if (workspace.sparseInput)
+            {
+                // 疎な X^T では、ブロック内で非ゼロの画素がある行だけが更新される
+                const SparseRows& xTransposed = workspace.sparseXTransposed;
+                SparseGemmKernel(blockRows, midCount,
+                                 xTransposed.offsets.data() + firstRow,
+                                 xTransposed.indices.data(),
+                                 xTransposed.values.data(),
+                                 workspace.da1[0], workspace.da1.stride(),
+                                 target, ldTarget);
+            }
+            else
+            {
+                // 密な X は転置せず、担当した行の [firstRow, firstRow + blockRows) 列を X^T の行として読む
+                BackendGemm(g_applicationSettings.linearAlgebraBackend,
+                            Transpose::Yes, Transpose::No,
+                            blockRows, midCount, workspace.da1.rows(),
+                            x[workspace.xFirstRow] + firstRow, x.stride(),
+                            workspace.da1[0], workspace.da1.stride(),
+                            target, ldTarget);
+            }
+        }
+    }
+
+    /// @brief 各スレッドの Y1^T * dA2 を w2 に、dA2 と dA1 の列の和を b2 と b1 に足し込む
+    void addW2Products(const Array<BatchBackPropagationWorkspace>& workspaces,
+                       int workers,
+                       Matrix& w2,
+                       Array<float>& b1,
+                       Array<float>& b2)
+    {
+        const int midCount = w2.rows();
+        const int outCount = w2.cols();
+        for (int worker = 0; worker < workers; ++worker)
+        {
+            const BatchBackPropagationWorkspace& workspace = workspaces[worker];
+            const Matrix& y1 = workspace.forward.y1;
+
+            // w2 += Y1^T * dA2
+            BackendGemm(g_applicationSettings.linearAlgebraBackend,
+                        Transpose::Yes, Transpose::No,
+                        midCount, outCount, y1.rows(),
+                        y1[0], y1.stride(),
+                        workspace.da2[0], workspace.da2.stride(),
+                        w2[0], w2.stride());
+
+            addColumnSums(workspace.da2, b2);
+            addColumnSums(workspace.da1, b1);
+        }
+    }
+}
+
+namespace ocr
+{
+    DataParallelTrainer::DataParallelTrainer(int threadCount) :
+        m_pool(threadCount),
+        m_workspaces(threadCount),
+        m_accumulators(threadCount),
+        m_losses(threadCount)
+    {
+    }
+
+    float DataParallelTrainer::backPropagation(const BatchBackPropagationInput& input,
+                                               const NeuralNetworkParameters& params)
+    {
+        const int rows = input.x.rows();
+        const int workers = std::min(threadCount(), rows);
+
+        // 勾配のバッファは作業領域と交換しながら使うので、最初に params と同じ形で確保しておく
+        if (not m_accumulators[0].w1.hasSameLayout(params.w1))
+        {
+            for (auto& accumulator : m_accumulators)
+            {
+                accumulator = MakeZeroGradient(params);
+            }
+        }
+
+        // 各スレッドはバッチの連続した行を、コピーせずに自分の作業領域で計算する
+        m_pool.parallelFor(workers, [&](int worker)
+        {
+            const int firstRow = rows * worker / workers;
+            const int lastRow = rows * (worker + 1) / workers;
+
+            BatchBackPropagationWorkspace& workspace = m_workspaces[worker];
+            m_losses[worker] = BatchBackPropagation(input, firstRow, lastRow - firstRow, params, workspace);
+
+            // 勾配はバッファごと交換して受け取る。作業領域には前回の勾配のバッファが戻り、次の呼び出しで再利用される
+            NeuralNetworkParameters& accumulator = m_accumulators[worker];
+            std::swap(accumulator.w1, workspace.gradient.dw1);
+            std::swap(accumulator.b1, workspace.gradient.db1);
+            std::swap(accumulator.w2, workspace.gradient.dw2);
+            std::swap(accumulator.b2, workspace.gradient.db2);
+        });
+
+        // 二分木の形で隣り合う勾配を並列に足し合わせ、先頭に集約する
+        for (int stride = 1; stride < workers; stride *= 2)
+        {
+            const int pairCount = (workers - stride + 2 * stride - 1) / (2 * stride);
+            m_pool.parallelFor(pairCount, [&](int pair)
+            {
+                const int target = pair * 2 * stride;
+                AddGradients(m_accumulators[target], m_accumulators[target + stride]);
+            });
+        }
+
+        return std::accumulate(m_losses.begin(), m_losses.begin() + workers, 0.0f);
+    }
+
+    float DataParallelTrainer::trainStep(const BatchBackPropagationInput& input,
+                                         NeuralNetworkParameters& params,
+                                         float learningRate,
+                                         HalfMatrix* halfW1)
+    {
+        const int workers = std::min(threadCount(), input.x.rows());
+
+        // 誤差に -learningRate を掛けておくと、X^T * dA1 などがそのまま更新量になる
+        const float loss = backPropagationDeltas(input, params, -learningRate, halfW1, workers);
+
+        // W1 の行ブロックをキャッシュに載せたまま、全スレッドの X^T * dA1 を順に足し込む。
+        // 最後のタスクは小さな W2 とバイアスをまとめて更新する
+        const int blockCount = (params.w1.rows() + updateBlockRows - 1) / updateBlockRows;
+        m_pool.parallelFor(blockCount + 1, [&](int block)
+        {
+            OCR_PROFILE_SCOPE(UpdateParameters);
+
+            if (block == blockCount)
+            {
+                addW2Products(m_workspaces, workers, params.w2, params.b1, params.b2);
+                return;
+            }
+
+            const int firstRow = block * updateBlockRows;
+            const int blockRows = std::min(updateBlockRows, params.w1.rows() - firstRow);
+            addW1Products(m_workspaces, workers, input.x, firstRow, blockRows, params.w1[firstRow], params.w1.stride());
+
+            if (halfW1)
+            {
+                UpdateHalfMatrixRows(params.w1, firstRow, blockRows, *halfW1);
+            }
+        });
+
+        return loss;
+    }
+
+    float DataParallelTrainer::trainStep(const BatchBackPropagationInput& input,
+                                         NeuralNetworkParameters& params,
+                                         Optimizer& optimizer,
+                                         HalfMatrix* halfW1)
+    {
+        if (optimizer.settings().type == OptimizerType::Sgd)
+        {
+            return trainStep(input, params, optimizer.settings().learningRate, halfW1);
+        }
+
+        const int workers = std::min(threadCount(), input.x.rows());
+        const float loss = backPropagationDeltas(input, params, 1.0f, halfW1, workers);
+
+        if (not m_stepGradient.w1.hasSameLayout(params.w1) || not m_stepGradient.w2.hasSameLayout(params.w2))
+        {
+            m_stepGradient = MakeZeroGradient(params);
+        }
+
+        optimizer.beginStep();
+
+        // SGD と同じく W1 の行ブロックごとに、勾配の行を作った直後にキャッシュに載ったまま状態と一緒に更新する。
+        // 勾配は params と同じ並べ方なので、行の末尾の隙間 (0 のまま) も含めて連続した範囲として更新できる
+        const int stride = params.w1.stride();
+        const int blockCount = (params.w1.rows() + updateBlockRows - 1) / updateBlockRows;
+        m_pool.parallelFor(blockCount + 1, [&](int block)
+        {
+            OCR_PROFILE_SCOPE(UpdateParameters);
+
+            NeuralNetworkParameters& gradient = m_stepGradient;
+            if (block == blockCount)
+            {
+                std::fill(gradient.w2.data().begin(), gradient.w2.data().end(), 0.0f);
+                for (auto* values : {&gradient.b1, &gradient.b2})
+                {
+                    std::fill(values->begin(), values->end(), 0.0f);
+                }
+
+                addW2Products(m_workspaces, workers, gradient.w2, gradient.b1, gradient.b2);
+
+                optimizer.update(ParameterTensor::W2, 0, params.w2.data().size(), params.w2[0], gradient.w2[0]);
+                optimizer.update(ParameterTensor::B1, 0, params.b1.size(), params.b1.data(), gradient.b1.data());
+                optimizer.update(ParameterTensor::B2, 0, params.b2.size(), params.b2.data(), gradient.b2.data());
+                return;
+            }
+
+            const int firstRow = block * updateBlockRows;
+            const int blockRows = std::min(updateBlockRows, params.w1.rows() - firstRow);
+            const size_t offset = static_cast<size_t>(firstRow) * stride;
+            const size_t count = static_cast<size_t>(blockRows) * stride;
+
+            std::fill_n(gradient.w1[firstRow], count, 0.0f);
+            addW1Products(m_workspaces, workers, input.x, firstRow, blockRows, gradient.w1[firstRow], stride);
+            optimizer.update(ParameterTensor::W1, offset, count, params.w1[firstRow], gradient.w1[firstRow]);
+
+            if (halfW1)
+            {
+                UpdateHalfMatrixRows(params.w1, firstRow, blockRows, *halfW1);
+            }
+        });
+
+        return loss;
+    }
+
+    float DataParallelTrainer::backPropagationDeltas(const BatchBackPropagationInput& input,
+                                                     const NeuralNetworkParameters& params,
+                                                     float scale,
+                                                     const HalfMatrix* halfW1,
+                                                     int workers)
+    {
+        if (halfW1 && (halfW1->rows != params.w1.rows() || halfW1->cols != params.w1.cols()))
+        {
+            throw std::invalid_argument("Half-precision W1 does not match the parameters.");
+        }
+
+        // 各スレッドが担当する行の誤差 dA1, dA2 を求め、scale を掛けておく
+        const int rows = input.x.rows();
+        m_pool.parallelFor(workers, [&](int worker)
+        {
+            const int firstRow = rows * worker / workers;
+            const int lastRow = rows * (worker + 1) / workers;
+
+            BatchBackPropagationWorkspace& workspace = m_workspaces[worker];
+            m_losses[worker] = BatchBackPropagationDeltas(input, firstRow, lastRow - firstRow, params, workspace, halfW1);
+
+            if (scale != 1.0f)
+            {
+                scaleInPlace(workspace.da1, scale);
+                scaleInPlace(workspace.da2, scale);
+            }
+        });
+
+        return std::accumulate(m_losses.begin(), m_losses.begin() + workers, 0.0f);
+    }
+
+    Array<ThreadScalingResult> MeasureThreadScaling(const BatchBackPropagationInput& input,
+                                                    const NeuralNetworkParameters& params,
+                                                    int maxThreadCount,
+                                                    int iterations)
+    {
+        Array<int> threadCounts{};
+        for (int threadCount = 1; threadCount < maxThreadCount; threadCount *= 2)
+        {
+            threadCounts.push_back(threadCount);
+        }
+
+        threadCounts.push_back(std::max(maxThreadCount, 1));
+
+        Array<ThreadScalingResult> results{};
+        for (const int threadCount : threadCounts)
+        {
+            DataParallelTrainer trainer{threadCount};
+
+            // ウォームアップ: 勾配バッファの確保とスレッドの起動を計測から外す
+            trainer.backPropagation(input, params);
+
+            const auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < iterations; ++i)
+            {
+                trainer.backPropagation(input, params);
+            }
+
+            const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            results.push_back(ThreadScalingResult{
+                .threadCount = threadCount,
+                .samplesPerSecond = static_cast<double>(iterations) * input.x.rows() / elapsed.count()
+            });
+        }
+
+        return results;
+    }
+}
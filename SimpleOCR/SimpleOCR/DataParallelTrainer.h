@@ -0,0 +1,84 @@
+﻿#pragma once
+#include "BackPropagation.h"
+#include "NeuralNetwork.h"
+#include "Optimizer.h"
+#include "ThreadPool.h"
+
+namespace ocr
+{
+    /// @brief ミニバッチをスレッド数で分割して並列に逆伝搬する (CPU のみ)
+    class DataParallelTrainer
+    {
+    public:
+        explicit DataParallelTrainer(int threadCount);
+
+        int threadCount() const
+        {
+            return m_pool.threadCount();
+        }
+
+        /// @brief バッチ全体の勾配を求めて gradient() に書き込む
+        /// @return バッチ内のクロスエントロピー誤差の総和
+        float backPropagation(const BatchBackPropagationInput& input, const NeuralNetworkParameters& params);
+
+        /// @brief バッチを逆伝搬し、勾配を作らずに SGD の更新 (params -= learningRate * 勾配) を直接書き込む
+        /// @details W1 は行のブロックごとにスレッドへ割り当て、各スレッドの X^T * dA1 をそのブロックへ直接足し込む。
+        /// 勾配バッファの書き込み、スレッド間の集約、更新のための読み直しがなくなる。gradient() は更新されない
+        /// @param halfW1 nullptr でなければ順伝搬は半精度の W1 を読み、params.w1 (float のマスター) の行ブロックを
+        /// 更新した直後に、キャッシュに載っているうちにその行を halfW1 へ変換し直す
+        /// @return バッチ内のクロスエントロピー誤差の総和
+        float trainStep(const BatchBackPropagationInput& input,
+                        NeuralNetworkParameters& params,
+                        float learningRate,
+                        HalfMatrix* halfW1 = nullptr);
+
+        /// @brief trainStep() と同じ順で、SGD 以外の optimizer でも勾配の全体を集約せずに更新する
+        /// @details W1 の行ブロックごとに、全スレッドの X^T * dA1 をその行の勾配へ足し込んだ直後に、
+        /// キャッシュに載ったまま optimizer.update() で状態と一緒に更新する。SGD の設定では上の trainStep() を呼ぶ
+        /// @return バッチ内のクロスエントロピー誤差の総和
+        float trainStep(const BatchBackPropagationInput& input,
+                        NeuralNetworkParameters& params,
+                        Optimizer& optimizer,
+                        HalfMatrix* halfW1 = nullptr);
+
+        /// @brief 直前の backPropagation() で求めたバッチ全体の勾配
+        const NeuralNetworkParameters& gradient() const
+        {
+            return m_accumulators[0];
+        }
+
+    private:
+        /// @brief 各スレッドが担当する行の誤差 dA1, dA2 を作業領域に求め、scale を掛けておく
+        /// @return バッチ内のクロスエントロピー誤差の総和
+        float backPropagationDeltas(const BatchBackPropagationInput& input,
+                                    const NeuralNetworkParameters& params,
+                                    float scale,
+                                    const HalfMatrix* halfW1,
+                                    int workers);
+
+        ThreadPool m_pool;
+
+        Array<BatchBackPropagationWorkspace> m_workspaces{};
+
+        /// @brief スレッドごとの勾配。集約後は先頭にバッチ全体の勾配が入る
+        Array<NeuralNetworkParameters> m_accumulators{};
+
+        Array<float> m_losses{};
+
+        /// @brief Optimizer を使う trainStep() の勾配。各タスクが自分の行ブロックだけを 0 から作り直す
+        NeuralNetworkParameters m_stepGradient{};
+    };
+
+    struct ThreadScalingResult
+    {
+        int threadCount;
+
+        double samplesPerSecond;
+    };
+
+    /// @brief スレッド数を 1, 2, 4, ... maxThreadCount と変えて、同じバッチの逆伝搬のスループットを測る
+    Array<ThreadScalingResult> MeasureThreadScaling(const BatchBackPropagationInput& input,
+                                                    const NeuralNetworkParameters& params,
+                                                    int maxThreadCount,
+                                                    int iterations = 50);
+}
@@ -1,2 +1,43 @@
 ﻿#include "pch.h"
 #include "DatasetImage.h"
+
+namespace ocr
+{
+    DatasetImageList::DatasetImageList(std::shared_ptr<const void> owner,
+                                       const uint8_t* pixels,
+                                       size_t count,
+                                       const DatasetImageProperty& property) :
+        m_owner(std::move(owner)),
+        m_pixels(pixels),
+        m_count(count),
+        m_property(property)
+    {
+    }
+
+    DatasetImageList DatasetImageList::FromPixels(Array<uint8_t> pixels, const DatasetImageProperty& property)
+    {
+        if (property.pixelCount() <= 0 || pixels.size() % property.pixelCount() != 0)
+        {
+            throw std::invalid_argument("Pixel count is not a multiple of the image size.");
+        }
+
+        const size_t count = pixels.size() / property.pixelCount();
+        auto owner = std::make_shared<const Array<uint8_t>>(std::move(pixels));
+        const uint8_t* data = owner->data();
+        return DatasetImageList{std::move(owner), data, count, property};
+    }
+
+    PixelBatch DatasetImageList::batch(size_t first, size_t count) const
+    {
+        if (first + count > m_count)
+        {
+            throw std::out_of_range("Image range is out of the list.");
+        }
+
+        return PixelBatch{
+            .pixels = m_pixels + first * m_property.pixelCount(),
+            .rows = static_cast<int>(count),
+            .cols = m_property.pixelCount()
+        };
+    }
+}
@@ -1,6 +1,12 @@
 ﻿#pragma once
+#include <span>
+
 #include "TY/Array.h"
+#if not OCR_HEADLESS
 #include "TY/ImageView.h"
+#else
+#include "TY/Vector2D.h"
+#endif
 
 namespace ocr
 {
@@ -9,27 +15,101 @@ namespace ocr
     struct DatasetImageProperty
     {
         Size size{};
+
+        int pixelCount() const
+        {
+            return size.x * size.y;
+        }
     };
 
-    class DatasetImage : public Array<uint8_t>
+    /// @brief データセット内の 1 枚の画像を指す所有権のないビュー
+    class DatasetImage : public std::span<const uint8_t>
     {
     public:
-        using Array::Array;
+        using span::span;
 
+#if not OCR_HEADLESS
         ImageView imageView(const DatasetImageProperty& prop) const
         {
             return ImageView{
                 (data()),
                 prop.size,
-                size_in_bytes(),
+                size_bytes(),
                 DXGI_FORMAT_R8_UNORM,
             };
         }
+#endif
+    };
+
+    /// @brief 連続した画像を [rows][cols] の uint8 行列として見るビュー (画素は 0..255 のまま)
+    struct PixelBatch
+    {
+        const uint8_t* pixels{};
+
+        int rows{}; // 画像数
+
+        int cols{}; // 1 枚あたりの画素数
+
+        const uint8_t* operator[](int row) const
+        {
+            return pixels + static_cast<size_t>(row) * cols;
+        }
     };
 
-    struct DatasetImageList
+    /// @brief 連続した 1 つのバッファに並んだ画像列へのビュー
+    /// @details i 番目の画像は pixels() + i * property().pixelCount() から始まる。
+    /// バッファ (メモリマップしたファイルなど) はコピー間で共有され、最後のコピーが破棄されるまで保持される。
+    class DatasetImageList
     {
-        DatasetImageProperty property{};
-        Array<DatasetImage> images{};
+    public:
+        DatasetImageList() = default;
+
+        /// @param owner pixels が指すメモリを保持するオブジェクト
+        DatasetImageList(std::shared_ptr<const void> owner,
+                         const uint8_t* pixels,
+                         size_t count,
+                         const DatasetImageProperty& property);
+
+        /// @brief メモリ上の画素列から作る (画像は pixels に隙間なく並んでいること)
+        static DatasetImageList FromPixels(Array<uint8_t> pixels, const DatasetImageProperty& property);
+
+        const DatasetImageProperty& property() const
+        {
+            return m_property;
+        }
+
+        size_t size() const
+        {
+            return m_count;
+        }
+
+        bool empty() const
+        {
+            return m_count == 0;
+        }
+
+        /// @brief すべての画像の画素が連続して並んだ先頭
+        const uint8_t* pixels() const
+        {
+            return m_pixels;
+        }
+
+        DatasetImage operator[](size_t index) const
+        {
+            const size_t pixelCount = m_property.pixelCount();
+            return DatasetImage{m_pixels + index * pixelCount, pixelCount};
+        }
+
+        /// @brief [first, first + count) の画像をコピーせずに行列として参照する
+        PixelBatch batch(size_t first, size_t count) const;
+
+    private:
+        std::shared_ptr<const void> m_owner{};
+
+        const uint8_t* m_pixels{};
+
+        size_t m_count{};
+
+        DatasetImageProperty m_property{};
     };
 }
@@ -5,17 +5,30 @@
 #include <cstdint>
 
 #include "DatasetImage.h"
+#include "MappedFile.h"
 
 namespace
 {
+    /// @brief IDX 形式のマジックナンバー: 0x0000 [型] [次元数]
+    constexpr uint32_t idxImagesMagic = 0x00000803; // unsigned byte, 3 次元
+
+    constexpr uint32_t idxLabelsMagic = 0x00000801; // unsigned byte, 1 次元
+
+    constexpr size_t idxImagesHeaderSize = 16;
+
+    uint32_t toBigEndianUint32(const uint8_t* bytes)
+    {
+        return (static_cast<uint32_t>(bytes[0]) << 24) |
+            (static_cast<uint32_t>(bytes[1]) << 16) |
+            (static_cast<uint32_t>(bytes[2]) << 8) |
+            static_cast<uint32_t>(bytes[3]);
+    }
+
     uint32_t readBigEndianUint32(std::ifstream& ifs)
     {
-        uint32_t value;
-        ifs.read(reinterpret_cast<char*>(&value), 4);
-        return ((value & 0xFF) << 24) |
-            ((value & 0xFF00) << 8) |
-            ((value & 0xFF0000) >> 8) |
-            ((value & 0xFF000000) >> 24);
+        uint8_t bytes[4]{};
+        ifs.read(reinterpret_cast<char*>(bytes), 4);
+        return toBigEndianUint32(bytes);
     }
 }
 
@@ -23,38 +36,70 @@ namespace ocr
 {
     DatasetImageList LoadMnistImages(const std::string& file)
     {
-        DatasetImageList images{};
-        std::ifstream ifs(file, std::ios::binary);
-        if (!ifs) { throw std::runtime_error("Can't open file!"); }
+        auto mappedFile = std::make_shared<const MappedFile>(file);
+        const uint8_t* bytes = mappedFile->data();
 
-        const int magic = readBigEndianUint32(ifs);
-        const int num_images = readBigEndianUint32(ifs);
-        const int rows = readBigEndianUint32(ifs);
-        const int cols = readBigEndianUint32(ifs);
+        if (mappedFile->size() < idxImagesHeaderSize)
+        {
+            throw std::runtime_error("IDX image file is too small: " + file);
+        }
 
-        images.property.size = {rows, cols};
+        const uint32_t magic = toBigEndianUint32(bytes);
+        const uint32_t num_images = toBigEndianUint32(bytes + 4);
+        const uint32_t rows = toBigEndianUint32(bytes + 8);
+        const uint32_t cols = toBigEndianUint32(bytes + 12);
 
-        images.images.resize(num_images, DatasetImage(rows * cols));
+        if (magic != idxImagesMagic)
+        {
+            throw std::runtime_error("Invalid IDX image magic number: " + file);
+        }
 
-        for (uint32_t i = 0; i < num_images; ++i)
+        if (rows == 0 || cols == 0 || rows > 0x7fff || cols > 0x7fff)
         {
-            ifs.read(reinterpret_cast<char*>(images.images[i].data()), rows * cols);
+            throw std::runtime_error("Invalid IDX image dimensions: " + file);
         }
 
-        return images;
+        const uint64_t pixelBytes = static_cast<uint64_t>(num_images) * rows * cols;
+        if (mappedFile->size() - idxImagesHeaderSize < pixelBytes)
+        {
+            throw std::runtime_error("IDX image file is truncated: " + file);
+        }
+
+        DatasetImageProperty property{};
+        property.size = {static_cast<int>(rows), static_cast<int>(cols)};
+
+        // 画素はヘッダの直後から全画像ぶん連続して並んでいるので、マップしたまま参照する
+        const uint8_t* pixels = bytes + idxImagesHeaderSize;
+        return DatasetImageList{std::move(mappedFile), pixels, num_images, property};
     }
 
-    Array<uint8_t> LoadMnistLabels(const std::string& file)
+    Array<uint8_t> LoadMnistLabels(const std::string& file, const DatasetImageList& images)
     {
         Array<uint8_t> labels{};
         std::ifstream ifs(file, std::ios::binary);
         if (!ifs) { throw std::runtime_error("Can't open file!"); }
 
-        const int magic = readBigEndianUint32(ifs);
-        const int num_labels = readBigEndianUint32(ifs);
+        const uint32_t magic = readBigEndianUint32(ifs);
+        const uint32_t num_labels = readBigEndianUint32(ifs);
+
+        if (magic != idxLabelsMagic)
+        {
+            throw std::runtime_error("Invalid IDX label magic number: " + file);
+        }
+
+        if (num_labels != images.size())
+        {
+            throw std::runtime_error("IDX label count (" + std::to_string(num_labels) +
+                                     ") does not match the image count (" + std::to_string(images.size()) + "): " + file);
+        }
 
         labels.resize(num_labels);
         ifs.read(reinterpret_cast<char*>(labels.data()), num_labels);
+        if (ifs.gcount() != num_labels)
+        {
+            throw std::runtime_error("IDX label file is truncated: " + file);
+        }
+
         return labels;
     }
 }
@@ -4,5 +4,8 @@
 namespace ocr
 {
     DatasetImageList LoadMnistImages(const std::string& file);
-    Array<uint8_t> LoadMnistLabels(const std::string& file);
+
+    /// @brief images の各画像に対応するラベルを読み込む
+    /// @note ラベルの数が images の画像の数と異なるときは std::runtime_error (組み合わせを間違えたファイルを受け付けない)
+    Array<uint8_t> LoadMnistLabels(const std::string& file, const DatasetImageList& images);
 }
@@ -2,11 +2,26 @@
 #include "EntryPoint.h"
 
 #include "BackPropagation.h"
+#include "BatchEvaluator.h"
+#include "BatchPrefetcher.h"
+#include "DataParallelTrainer.h"
 #include "DatasetImage.h"
 #include "DatasetLoader.h"
+#include "GemmKernel.h"
+#include "Gradient.h"
+#include "HogwildTrainer.h"
+#include "InputFormatBenchmark.h"
+#include "AllocationCounter.h"
 #include "ApplicationSettings.h"
 #include "LivePPAddon.h"
+#include "ModelFile.h"
 #include "NeuralNetwork.h"
+#include "Optimizer.h"
+#include "PhaseProfiler.h"
+#include "HalfNeuralNetwork.h"
+#include "QuantizedNeuralNetwork.h"
+#include "SparseInput.h"
+#include "StaticNeuralNetwork.h"
 #include "TY/DynamicTexture.h"
 #include "TY/Gpgpu.h"
 #include "TY/Image.h"
@@ -25,9 +40,9 @@ using namespace ocr;
 
 namespace
 {
-    constexpr int midNodeCount = 128;
+    constexpr int midNodeCount = mnistTopology.midCount;
 
-    constexpr int labelCount = 10;
+    constexpr int labelCount = mnistTopology.outputCount;
 
     constexpr int batchSize = 100;
 
@@ -35,6 +50,10 @@ namespace
 
     constexpr int epochCount = 5;
 
+    constexpr auto modelFile = "asset/trained/model.ocrm";
+
+    constexpr auto traceFile = "asset/trained/training_trace.json";
+
     void drawline(Image& image, const Point& start, const Point& end, const ColorU8& color)
     {
         const int dx = end.x - start.x;
@@ -52,6 +71,27 @@ namespace
             }
         }
     }
+
+    /// @brief 混同行列を、行が正解ラベル・列が予測したラベルの表にする
+    std::string formatConfusionMatrix(const EvaluationResult& result)
+    {
+        std::string text = "- Confusion Matrix (row: actual, column: predicted)\n     ";
+        for (int predicted = 0; predicted < result.labelCount; ++predicted)
+        {
+            text += std::format("{:>6}", predicted);
+        }
+
+        for (int actual = 0; actual < result.labelCount; ++actual)
+        {
+            text += std::format("\n{:>5}", actual);
+            for (int predicted = 0; predicted < result.labelCount; ++predicted)
+            {
+                text += std::format("{:>6}", result.confusion(actual, predicted));
+            }
+        }
+
+        return text;
+    }
 }
 
 struct EntryPointImpl
@@ -65,12 +105,17 @@ struct EntryPointImpl
 
     DatasetImageList m_trainImages{};
     Array<uint8_t> m_trainLabels{};
+    ActivePixelIndex m_trainActivePixels{};
 
     DatasetImageList m_testImage{};
     Array<uint8_t> m_testLabel{};
 
     NeuralNetworkParameters m_params{};
 
+    QuantizedNeuralNetworkParameters m_quantizedParams{}; // 学習のたびに m_params から作り直す
+
+    HalfMatrix m_halfW1{}; // 半精度で学習するときの W1 (m_params.w1 がマスター)
+
     Image m_myImage{};
     DynamicTexture m_myTexture{};
     TextureDrawer m_myTextureDrawer{};
@@ -78,20 +123,32 @@ struct EntryPointImpl
 
     Array<std::string> m_epochMessages{};
 
+    std::unique_ptr<DataParallelTrainer> m_dataParallelTrainer{};
+
+    std::unique_ptr<BatchEvaluator> m_batchEvaluator{};
+
     EntryPointImpl()
     {
         m_trainImages = LoadMnistImages("asset/dataset/train-images.idx3-ubyte");
 
-        m_trainLabels = LoadMnistLabels("asset/dataset/train-labels.idx1-ubyte");
+        m_trainLabels = LoadMnistLabels("asset/dataset/train-labels.idx1-ubyte", m_trainImages);
+
+        m_trainActivePixels = ActivePixelIndex{m_trainImages};
 
         m_testImage = LoadMnistImages("asset/dataset/t10k-images.idx3-ubyte");
 
-        m_testLabel = LoadMnistLabels("asset/dataset/t10k-labels.idx1-ubyte");
+        m_testLabel = LoadMnistLabels("asset/dataset/t10k-labels.idx1-ubyte", m_testImage);
 
         m_texturePS = PixelShader{ShaderParams::PS("asset/shader/default2d.hlsl")};
         m_textureVS = VertexShader{ShaderParams::VS("asset/shader/default2d.hlsl")};
 
-        m_params = makeRandomNeuralInput(m_trainImages.images[0].size());
+        // 学習済みのモデルが保存されていれば、学習し直さずにそれを使う
+        if (not tryLoadModel())
+        {
+            m_params = makeRandomNeuralInput(m_trainImages.property().pixelCount());
+        }
+
+        m_quantizedParams = QuantizeNeuralNetwork(m_params);
 
         m_trainImageIndex = 0;
         m_previewTexture = makePreviewTexture(m_trainImageIndex);
@@ -99,7 +156,7 @@ struct EntryPointImpl
 
         // -----------------------------------------------
 
-        m_myImage = Image{m_trainImages.property.size, ColorF32{0.0f, 1.0f}.toColorU8()};
+        m_myImage = Image{m_trainImages.property().size, ColorF32{0.0f, 1.0f}.toColorU8()};
         m_myTexture = DynamicTexture{m_myImage};
         m_myTextureDrawer = TextureDrawer{
             TextureDrawerParams()
@@ -144,7 +201,7 @@ struct EntryPointImpl
 
                     m_myTexture.upload(m_myImage);
 
-                    m_myImageLabel = runNeuralNetwork(makeImageInput(m_myImage));
+                    m_myImageLabel = runNeuralNetwork(m_myImage);
                 }
             }
 
@@ -179,7 +236,7 @@ struct EntryPointImpl
             if (ImGui::InputInt("Index", &m_trainImageIndex))
             {
                 m_trainImageIndex =
-                    Math::Clamp(m_trainImageIndex, 0, static_cast<int>(m_trainImages.images.size() - 1));
+                    Math::Clamp(m_trainImageIndex, 0, static_cast<int>(m_trainImages.size() - 1));
                 m_previewTexture = makePreviewTexture(m_trainImageIndex);
                 m_predictedLabel = runNeuralNetwork(m_trainImageIndex);
             }
@@ -197,11 +254,49 @@ struct EntryPointImpl
 
             static float s_accuracy{};
 
+            if (ImGui::Button("Save Model"))
+            {
+                saveModel();
+            }
+
+            ImGui::SameLine();
+
+            if (ImGui::Button("Load Model") && tryLoadModel())
+            {
+                m_quantizedParams = QuantizeNeuralNetwork(m_params);
+                m_predictedLabel = runNeuralNetwork(m_trainImageIndex);
+            }
+
             if (ImGui::Button("Compute Accuracy"))
             {
                 s_accuracy = computeAccuracy();
             }
 
+            if (ImGui::Button("Measure Thread Scaling"))
+            {
+                measureThreadScaling();
+            }
+
+            if (ImGui::Button("Compare Hogwild! / Synchronous"))
+            {
+                compareHogwildWithSynchronous();
+            }
+
+            if (ImGui::Button("Benchmark Input Formats"))
+            {
+                benchmarkInputFormats();
+            }
+
+            if (ImGui::Button("Compare INT8 / FP32 Inference"))
+            {
+                compareQuantizedInference();
+            }
+
+            if (ImGui::Button("Compare FP16 / BF16 / FP32 Inference"))
+            {
+                compareHalfPrecisionInference();
+            }
+
             ImGui::Separator();
             ImGui::Text("Accuracy: %.2f%%", s_accuracy * 100.0f);
             ImGui::Separator();
@@ -232,6 +327,66 @@ struct EntryPointImpl
 
             ImGui::Checkbox("Use GPU", &g_applicationSettings.useGpu);
 
+            const int maxThreadCount = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+            ImGui::SliderInt("CPU Training Threads", &g_applicationSettings.trainingThreadCount, 1, maxThreadCount);
+
+            ImGui::Checkbox("Hogwild! (Async SGD)", &g_applicationSettings.useHogwild);
+
+            // Hogwild! は SGD だけに対応しているので、そのときは Optimizer の選択を使わない
+            ImGui::TextUnformatted("Optimizer:");
+            for (const OptimizerType type : {OptimizerType::Sgd, OptimizerType::Momentum, OptimizerType::Adam})
+            {
+                ImGui::SameLine();
+                if (ImGui::RadioButton(OptimizerName(type), g_applicationSettings.optimizer == type))
+                {
+                    g_applicationSettings.optimizer = type;
+                }
+            }
+
+            ImGui::Checkbox("INT8 Inference (CPU)", &g_applicationSettings.useQuantizedInference);
+
+            ImGui::Checkbox("Half-Precision W1 (CPU)", &g_applicationSettings.useHalfPrecisionWeights);
+            for (const HalfFormat format : {HalfFormat::Float16, HalfFormat::BFloat16})
+            {
+                ImGui::SameLine();
+                if (ImGui::RadioButton(HalfFormatName(format), g_applicationSettings.halfWeightFormat == format))
+                {
+                    g_applicationSettings.halfWeightFormat = format;
+                }
+            }
+
+            ImGui::TextUnformatted("Activation (CPU):");
+            for (const ActivationMode mode : {ActivationMode::Exact, ActivationMode::Fast})
+            {
+                ImGui::SameLine();
+                if (ImGui::RadioButton(ActivationModeName(mode), g_applicationSettings.activationMode == mode))
+                {
+                    g_applicationSettings.activationMode = mode;
+                }
+            }
+
+            // BLAS はビルドで見つかったときだけ選べる
+            ImGui::TextUnformatted("GEMM Backend (CPU):");
+            for (const LinearAlgebraBackend backend : {LinearAlgebraBackend::Scalar, LinearAlgebraBackend::Simd, LinearAlgebraBackend::Blas})
+            {
+                if (not IsLinearAlgebraBackendAvailable(backend)) continue;
+
+                ImGui::SameLine();
+                if (ImGui::RadioButton(LinearAlgebraBackendName(backend), g_applicationSettings.linearAlgebraBackend == backend))
+                {
+                    g_applicationSettings.linearAlgebraBackend = backend;
+                }
+            }
+
+            ImGui::Text("CPU GEMM Kernel: %s", GemmKernelName(GetGemmKernelType()));
+
+            ImGui::Text("CPU INT8 Kernel: %s", QuantizedGemmKernelName(GetQuantizedGemmKernelType()));
+
+            const float pixelDensity = m_trainActivePixels.density();
+            ImGui::Text("Train Pixel Density: %.1f%% (%s first layer)",
+                        pixelDensity * 100.0f,
+                        PreferSparseInput(pixelDensity) ? "sparse" : "dense");
+
             ImGui::End();
         }
     }
@@ -241,7 +396,7 @@ private:
     {
         return TextureDrawer{
             TextureDrawerParams()
-            .setSource(m_trainImages.images[index].imageView(m_trainImages.property))
+            .setSource(m_trainImages[index].imageView(m_trainImages.property()))
             .setPS(m_texturePS)
             .setVS(m_textureVS)
         };
@@ -264,193 +419,616 @@ private:
         return neuralInput;
     }
 
-    int runNeuralNetwork(int index) const
+    /// @brief CPU で量子化した推論を使うかどうか
+    static bool useQuantizedInference()
     {
-        return runNeuralNetwork(makeImageInput(m_trainImages.images[index]));
+        return g_applicationSettings.useQuantizedInference && not g_applicationSettings.useGpu;
     }
 
-    int runNeuralNetwork(const Array<float>& x) const
+    /// @brief CPU で第 1 層の重みを半精度で読むかどうか
+    static bool useHalfPrecisionWeights()
     {
-        const NeuralNetworkOutput neuralOutput = NeuralNetwork(x, m_params);
-        return neuralOutput.maxIndex();
+        return g_applicationSettings.useHalfPrecisionWeights && not g_applicationSettings.useGpu;
     }
 
-    void acumulateGradients(NeuralNetworkParameters& params, const BackPropagationOutput& bp)
+    void saveModel() const
     {
-        // Accumulate gradients for weights and biases
-        for (int i = 0; i < params.w1.rows(); ++i)
+        try
         {
-            for (int j = 0; j < params.w1.cols(); ++j)
-            {
-                params.w1[i][j] += bp.dw1[i][j];
-            }
+            SaveModel(modelFile, m_params);
+            LogInfo.writeln(std::format("Saved model to {}", modelFile));
         }
-
-        for (int i = 0; i < params.b1.size(); ++i)
+        catch (const std::exception& e)
         {
-            params.b1[i] += bp.db1[i];
+            LogError.writeln(e.what());
         }
+    }
+
+    /// @brief 保存されたモデルを m_params に読み込む。ファイルがない、または壊れていれば false
+    bool tryLoadModel()
+    {
+        if (not std::filesystem::exists(modelFile)) return false;
 
-        for (int i = 0; i < params.w2.rows(); ++i)
+        try
         {
-            for (int j = 0; j < params.w2.cols(); ++j)
+            Stopwatch stopwatch{};
+            const MappedModel model{modelFile};
+            if (model.tensor(ModelTensor::W1).rows != m_trainImages.property().pixelCount())
             {
-                params.w2[i][j] += bp.dw2[i][j];
+                LogError.writeln(std::format("Model input size does not match the dataset: {}", modelFile));
+                return false;
             }
+
+            if (model.tensor(ModelTensor::W2).cols != labelCount)
+            {
+                LogError.writeln(std::format("Model output count does not match the {} labels: {}", labelCount, modelFile));
+                return false;
+            }
+
+            m_params = model.toParameters();
+            LogInfo.writeln(std::format("Loaded model from {} in {:.2f} ms", modelFile, stopwatch.sF() * 1000.0));
+            return true;
         }
+        catch (const std::exception& e)
+        {
+            LogError.writeln(e.what());
+            return false;
+        }
+    }
 
-        for (int i = 0; i < params.b2.size(); ++i)
+    int runNeuralNetwork(int index) const
+    {
+        if (useQuantizedInference())
         {
-            params.b2[i] += bp.db2[i];
+            return QuantizedBatchNeuralNetwork(m_trainImages.batch(index, 1), m_quantizedParams).maxIndex(0);
         }
+
+        return runNeuralNetwork(makeImageInput(m_trainImages[index]));
     }
 
-    void backpropagationApply(NeuralNetworkParameters& params, const NeuralNetworkParameters& gradient)
+    int runNeuralNetwork(const Image& image) const
     {
-        // Update weights and biases using the gradients from backpropagation
-        for (int i = 0; i < params.w1.rows(); ++i)
+        if (useQuantizedInference())
         {
-            for (int j = 0; j < params.w1.cols(); ++j)
-            {
-                params.w1[i][j] -= learningRate * gradient.w1[i][j];
-            }
+            const Array<uint8_t> pixels = image.data().map([](ColorU8 pixel) { return pixel.r; });
+            const PixelBatch x{.pixels = pixels.data(), .rows = 1, .cols = static_cast<int>(pixels.size())};
+            return QuantizedBatchNeuralNetwork(x, m_quantizedParams).maxIndex(0);
         }
 
-        for (int i = 0; i < params.b1.size(); ++i)
+        return runNeuralNetwork(makeImageInput(image));
+    }
+
+    int runNeuralNetwork(const Array<float>& x) const
+    {
+        const NeuralNetworkOutput neuralOutput = NeuralNetwork(x, m_params);
+        return neuralOutput.maxIndex();
+    }
+
+    /// @brief 1 エポック分のミニバッチ学習を行い、平均損失を返す
+    /// @param optimizer params の更新規則と状態 (エポックをまたいで同じものを渡す)
+    /// @param prefetcher CPU で学習するときにバッチを用意する生産者 (GPU では nullptr)
+    float trainEpoch(NeuralNetworkParameters& params, Optimizer& optimizer, Array<int>& indices, BatchPrefetcher* prefetcher)
+    {
+        if (prefetcher)
         {
-            params.b1[i] -= learningRate * gradient.b1[i];
+            return trainEpochOnCpu(params, optimizer, *prefetcher);
         }
 
-        for (int i = 0; i < params.w2.rows(); ++i)
+        for (int i = 0; i < indices.size(); ++i)
         {
-            for (int j = 0; j < params.w2.cols(); ++j)
+            indices[i] = i;
+        }
+
+        Random::Shuffle(indices);
+
+        float averageLoss = 0.0f;
+
+        NeuralNetworkParameters accGradient = MakeZeroGradient(params);
+
+        const int batchesPerEpoch = m_trainImages.size() / batchSize;
+        for (int batch = 0; batch < batchesPerEpoch; ++batch)
+        {
+            const int baseIndex = batch * batchSize;
+
+            ZeroGradients(accGradient);
+
+            for (int i = 0; i < batchSize; ++i)
             {
-                params.w2[i][j] -= learningRate * gradient.w2[i][j];
+                const int imageIndex = indices[baseIndex + i];
+
+                auto x = makeImageInput(m_trainImages[imageIndex]);
+
+                const BackPropagationInput bpInput{
+                    .x = std::move(x),
+                    .params = params,
+                    .trueLabel = m_trainLabels[imageIndex],
+                    .batches = batchSize
+                };
+
+                const BackPropagationOutput bpOutput = BackPropagation(bpInput);
+
+                averageLoss += bpOutput.crossEntropyError;
+
+                AccumulateGradients(accGradient, bpOutput);
             }
+
+            optimizer.apply(params, accGradient);
         }
 
-        for (int i = 0; i < params.b2.size(); ++i)
+        return averageLoss / static_cast<float>(batchesPerEpoch * batchSize);
+    }
+
+    /// @brief 生産者スレッドが用意した連続バッファのバッチを、スレッドごとに分割して計算する
+    float trainEpochOnCpu(NeuralNetworkParameters& params, Optimizer& optimizer, BatchPrefetcher& prefetcher)
+    {
+        DataParallelTrainer& trainer = dataParallelTrainer();
+
+        // 半精度の W1 はエポックの始めにマスターから作り、以降は trainStep() が更新した行ごとに変換し直す
+        HalfMatrix* halfW1 = nullptr;
+        if (useHalfPrecisionWeights())
         {
-            params.b2[i] -= learningRate * gradient.b2[i];
+            ConvertToHalfMatrix(params.w1, g_applicationSettings.halfWeightFormat, m_halfW1);
+            halfW1 = &m_halfW1;
         }
+
+        float averageLoss = 0.0f;
+
+        for (int batch = 0; batch < prefetcher.batchesPerEpoch(); ++batch)
+        {
+            // 計算している間に、生産者が次のバッチをシャッフル済みの順に集めて正規化する
+            const BatchBackPropagationInput& bpInput = prefetcher.acquire();
+
+#if OCR_COUNT_ALLOCATIONS
+            const uint64_t allocationCount = HeapAllocationCount();
+#endif
+
+            // 勾配を作らずに、誤差から求めた更新をパラメータへ直接足し込む
+            averageLoss += trainer.trainStep(bpInput, params, optimizer, halfW1);
+
+            prefetcher.release();
+
+#if OCR_COUNT_ALLOCATIONS
+            // 最初のバッチで作業領域を確保した後は、学習ステップでヒープ確保が起きないはず
+            const uint64_t stepAllocations = HeapAllocationCount() - allocationCount;
+            if (batch > 0 && stepAllocations != 0)
+            {
+                LogError.writeln(std::format("Training step allocated {} times on the heap.", stepAllocations));
+            }
+#endif
+        }
+
+        return averageLoss / static_cast<float>(prefetcher.batchesPerEpoch() * batchSize);
+    }
+
+    /// @brief CPU で学習するときだけバッチの生産者スレッドを起動する
+    std::unique_ptr<BatchPrefetcher> makeBatchPrefetcher() const
+    {
+        if (g_applicationSettings.useGpu) return nullptr;
+
+        return std::make_unique<BatchPrefetcher>(m_trainImages, m_trainLabels, batchSize, &m_trainActivePixels);
     }
 
     void machineLearning()
     {
-        Array<int> indices(m_trainImages.images.size());
-        for (int i = 0; i < indices.size(); ++i)
+        if (g_applicationSettings.useHogwild && not g_applicationSettings.useGpu)
         {
-            indices[i] = i;
+            hogwildMachineLearning();
+            m_quantizedParams = QuantizeNeuralNetwork(m_params);
+            return;
         }
 
-        Random::Shuffle(indices);
+        Array<int> indices(m_trainImages.size());
+        auto prefetcher = makeBatchPrefetcher();
+        Optimizer optimizer{DefaultOptimizerSettings(g_applicationSettings.optimizer), m_params};
 
         float previousAverageLoss{};
         constexpr float lossTermination = 0.01f;
 
+#if OCR_PROFILE_PHASES
+        const uint64_t traceStart = ProfileTimestamp();
+#endif
+
         for (int epoch = 0; epoch < epochCount; ++epoch)
         {
-            for (int i = 0; i < indices.size(); ++i)
+            LogInfo.writeln(std::format("Epoch: {}/{}", epoch + 1, epochCount));
+
+#if OCR_PROFILE_PHASES
+            const ProfileTotals profileBefore = CaptureProfileTotals();
+#endif
+
+            const float averageLoss = trainEpoch(m_params, optimizer, indices, prefetcher.get());
+
+            std::string message = std::format("Epoch {}:\n- Average Loss = {:.6f}", epoch + 1, averageLoss);
+            if (not g_applicationSettings.useGpu)
             {
-                indices[i] = i;
+                // CPU ではテストセットの評価が数十ミリ秒で終わるので、エポックごとに正解率も出す
+                const EvaluationResult evaluation = evaluateOnCpu(m_params);
+                message += std::format(
+                    "\n- Test Accuracy = {:.2f}% ({:.1f} ms)",
+                    evaluation.accuracy() * 100.0f,
+                    evaluation.elapsedSeconds * 1000.0);
             }
 
-            Random::Shuffle(indices);
+#if OCR_PROFILE_PHASES
+            // 評価を含めたエポック全体の処理速度と、各段階の時間の割合
+            const int sampleCount = static_cast<int>(m_trainImages.size()) / batchSize * batchSize;
+            message += "\n" + FormatProfileSummary(CaptureProfileTotals().since(profileBefore), sampleCount);
+#endif
 
-            // -----------------------------------------------
-            LogInfo.writeln(std::format("Epoch: {}/{}", epoch + 1, epochCount));
+            m_epochMessages.push_back(message);
 
-            float averageLoss = 0.0f;
+            LogInfo.writeln(std::format("Average Loss: {:.6f}", averageLoss));
 
-            const int batchesPerEpoch = m_trainImages.images.size() / batchSize;
-            for (int batch = 0; batch < batchesPerEpoch; ++batch)
+            if (Abs(averageLoss - previousAverageLoss) < lossTermination)
             {
-                const int baseIndex = batch * batchSize;
+                LogInfo.writeln("Training terminated early due to low loss.");
+                break;
+            }
 
-                NeuralNetworkParameters accGradient{};
-                accGradient.w1 = Matrix(m_params.w1.rows(), m_params.w1.cols());
-                accGradient.b1 = Array<float>(m_params.b1.size());
-                accGradient.w2 = Matrix(m_params.w2.rows(), m_params.w2.cols());
-                accGradient.b2 = Array<float>(m_params.b2.size());
+            previousAverageLoss = averageLoss;
+        }
 
-                for (int i = 0; i < batchSize; ++i)
-                {
-                    const int imageIndex = indices[baseIndex + i];
+#if OCR_PROFILE_PHASES
+        // 生産者スレッドを止めてから、記録が止まったリングバッファを読む
+        prefetcher.reset();
+        writeTrace(traceStart);
+#endif
 
-                    auto x = makeImageInput(m_trainImages.images[imageIndex]);
+        m_quantizedParams = QuantizeNeuralNetwork(m_params);
+    }
 
-                    const BackPropagationInput bpInput{
-                        .x = std::move(x),
-                        .params = m_params,
-                        .trueLabel = m_trainLabels[imageIndex],
-                        .batches = batchSize
-                    };
+    /// @brief start 以降に記録した段階を Chrome (chrome://tracing) や Perfetto で開ける形式で保存する
+    static void writeTrace(uint64_t start)
+    {
+        try
+        {
+            WriteChromeTrace(traceFile, start);
+            LogInfo.writeln(std::format("Saved trace to {}", traceFile));
+        }
+        catch (const std::exception& e)
+        {
+            LogError.writeln(e.what());
+        }
+    }
 
-                    const BackPropagationOutput bpOutput = BackPropagation(bpInput);
+    HogwildSettings makeHogwildSettings() const
+    {
+        return HogwildSettings{
+            .threadCount = g_applicationSettings.trainingThreadCount,
+            .learningRate = learningRate,
+            .epochCount = epochCount
+        };
+    }
 
-                    averageLoss += bpOutput.crossEntropyError;
+    void hogwildMachineLearning()
+    {
+        const auto progress = HogwildTraining(
+            m_params, m_trainImages, m_trainLabels, makeHogwildSettings(), nullptr);
 
-                    acumulateGradients(accGradient, bpOutput);
-                }
+        for (const auto& p : progress)
+        {
+            const std::string message = std::format(
+                "Epoch {} (Hogwild!):\n- Average Loss = {:.6f}\n- {:.0f} samples/sec",
+                p.epoch,
+                p.averageLoss,
+                p.samplesPerSecond);
 
-                backpropagationApply(m_params, accGradient);
-            }
+            m_epochMessages.push_back(message);
 
-            averageLoss /= static_cast<float>(batchesPerEpoch * batchSize);
+            LogInfo.writeln(message);
+        }
+    }
 
-            m_epochMessages.push_back(std::format("Epoch {}:\n- Average Loss = {:.6f}", epoch + 1, averageLoss));
+    /// @brief 同じ初期値から同期ミニバッチ学習と Hogwild! で学習し、経過時間ごとの正解率を比べる
+    void compareHogwildWithSynchronous()
+    {
+        const NeuralNetworkParameters initialParams = makeRandomNeuralInput(m_trainImages.property().pixelCount());
 
-            LogInfo.writeln(std::format("Average Loss: {:.6f}", averageLoss));
+        const AccuracyFunction evaluate = [this](const NeuralNetworkParameters& params)
+        {
+            return computeAccuracy(params);
+        };
 
-            if (Abs(averageLoss - previousAverageLoss) < lossTermination)
+        Array<TrainingProgress> syncProgress{};
+        {
+            NeuralNetworkParameters params = initialParams;
+            Array<int> indices(m_trainImages.size());
+            const auto prefetcher = makeBatchPrefetcher();
+
+            // Hogwild! と同じ SGD で比べる
+            Optimizer optimizer{DefaultOptimizerSettings(OptimizerType::Sgd), params};
+            double elapsedSeconds{};
+            for (int epoch = 0; epoch < epochCount; ++epoch)
             {
-                LogInfo.writeln("Training terminated early due to low loss.");
-                break;
+                Stopwatch stopwatch{};
+                const float averageLoss = trainEpoch(params, optimizer, indices, prefetcher.get());
+                const double epochSeconds = stopwatch.sF();
+                elapsedSeconds += epochSeconds;
+
+                syncProgress.push_back(TrainingProgress{
+                    .epoch = epoch + 1,
+                    .elapsedSeconds = elapsedSeconds,
+                    .samplesPerSecond = indices.size() / epochSeconds,
+                    .averageLoss = averageLoss,
+                    .accuracy = evaluate(params)
+                });
             }
-
-            previousAverageLoss = averageLoss;
         }
+
+        NeuralNetworkParameters hogwildParams = initialParams;
+        const auto hogwildProgress = HogwildTraining(
+            hogwildParams, m_trainImages, m_trainLabels, makeHogwildSettings(), evaluate);
+
+        std::string message = "Hogwild! vs Synchronous:";
+        const auto appendProgress = [&](const char* name, const Array<TrainingProgress>& progress)
+        {
+            for (const auto& p : progress)
+            {
+                message += std::format(
+                    "\n- {} epoch {}: {:.2f}% at {:.2f} s ({:.2f}%/s, {:.0f} samples/sec)",
+                    name,
+                    p.epoch,
+                    p.accuracy * 100.0f,
+                    p.elapsedSeconds,
+                    p.accuracy * 100.0f / p.elapsedSeconds,
+                    p.samplesPerSecond);
+            }
+        };
+
+        appendProgress("Synchronous", syncProgress);
+        appendProgress("Hogwild!", hogwildProgress);
+
+        m_epochMessages.push_back(message);
+
+        LogInfo.writeln(message);
     }
 
     Array<float> makeImageInput(const DatasetImage& image) const
     {
-        return image.map([](uint8_t pixel)
+        OCR_PROFILE_SCOPE(MakeImageInput);
+
+        Array<float> x(image.size());
+        std::transform(image.begin(), image.end(), x.begin(), [](uint8_t pixel)
         {
             return static_cast<float>(pixel) / 255.0f;
         });
+
+        return x;
+    }
+
+    /// @brief 設定されたスレッド数の学習器を返す (スレッド数が変わったときだけ作り直す)
+    DataParallelTrainer& dataParallelTrainer()
+    {
+        const int threadCount = Max(1, g_applicationSettings.trainingThreadCount);
+        if (not m_dataParallelTrainer || m_dataParallelTrainer->threadCount() != threadCount)
+        {
+            m_dataParallelTrainer = std::make_unique<DataParallelTrainer>(threadCount);
+        }
+
+        return *m_dataParallelTrainer;
+    }
+
+    /// @brief 設定されたスレッド数の評価器を返す (スレッド数が変わったときだけ作り直す)
+    BatchEvaluator& batchEvaluator()
+    {
+        const int threadCount = Max(1, g_applicationSettings.trainingThreadCount);
+        if (not m_batchEvaluator || m_batchEvaluator->threadCount() != threadCount)
+        {
+            m_batchEvaluator = std::make_unique<BatchEvaluator>(threadCount);
+        }
+
+        return *m_batchEvaluator;
+    }
+
+    void measureThreadScaling()
+    {
+        Array<int> indices(batchSize);
+        std::iota(indices.begin(), indices.end(), 0);
+
+        const BatchBackPropagationInput bpInput = makeBatchInput(indices, 0, batchSize);
+
+        const auto results = MeasureThreadScaling(bpInput, m_params, g_applicationSettings.trainingThreadCount);
+
+        std::string message = "Thread Scaling:";
+        for (const auto& result : results)
+        {
+            message += std::format(
+                "\n- {} threads: {:.0f} samples/sec (x{:.2f})",
+                result.threadCount,
+                result.samplesPerSecond,
+                result.samplesPerSecond / results[0].samplesPerSecond);
+        }
+
+        m_epochMessages.push_back(message);
+
+        LogInfo.writeln(message);
+    }
+
+    void benchmarkInputFormats()
+    {
+        const auto result = BenchmarkInputFormats(m_trainImages, m_params, batchSize);
+
+        std::string message = std::format(
+            "Input Formats:\n- Normalized cache: {:.1f} MB, built in {:.3f} s",
+            result.cacheBytes / (1024.0 * 1024.0),
+            result.cacheBuildSeconds);
+
+        for (const auto& timing : result.timings)
+        {
+            message += std::format(
+                "\n- {}: training {:.0f} samples/sec, evaluation {:.0f} samples/sec",
+                InputFormatName(timing.format),
+                timing.trainingSamplesPerSecond,
+                timing.evaluationSamplesPerSecond);
+        }
+
+        m_epochMessages.push_back(message);
+
+        LogInfo.writeln(message);
+    }
+
+    void compareQuantizedInference()
+    {
+        const auto report = CompareQuantizedInference(m_testImage, m_testLabel, m_params, batchSize);
+
+        const std::string message = std::format(
+            "INT8 Quantization ({}):\n"
+            "- FP32: {:.2f}%, {:.0f} samples/sec\n"
+            "- INT8: {:.2f}%, {:.0f} samples/sec (x{:.2f})\n"
+            "- Accuracy delta: {:+.2f} pt, {} / {} predictions differ, max probability error {:.4f}\n"
+            "- W1: {:.1f} KB -> {:.1f} KB",
+            QuantizedGemmKernelName(GetQuantizedGemmKernelType()),
+            report.fp32Accuracy * 100.0f,
+            report.fp32SamplesPerSecond,
+            report.int8Accuracy * 100.0f,
+            report.int8SamplesPerSecond,
+            report.int8SamplesPerSecond / report.fp32SamplesPerSecond,
+            (report.int8Accuracy - report.fp32Accuracy) * 100.0f,
+            report.disagreementCount,
+            report.sampleCount,
+            report.maxProbabilityError,
+            report.fp32W1Bytes / 1024.0,
+            report.int8W1Bytes / 1024.0);
+
+        m_epochMessages.push_back(message);
+
+        LogInfo.writeln(message);
+    }
+
+    void compareHalfPrecisionInference()
+    {
+        const auto report = CompareHalfPrecisionInference(m_testImage, m_testLabel, m_params, batchSize);
+
+        std::string message = std::format(
+            "Half-Precision W1 ({}):\n"
+            "- FP32: {:.2f}%, {:.0f} samples/sec, W1 {:.1f} KB",
+            GemmKernelName(GetGemmKernelType()),
+            report.fp32Accuracy * 100.0f,
+            report.fp32SamplesPerSecond,
+            report.fp32W1Bytes / 1024.0);
+
+        for (const HalfPrecisionResult& result : report.results)
+        {
+            message += std::format(
+                "\n- {}: {:.2f}% ({:+.2f} pt, {} / {} predictions differ, max probability error {:.5f}), "
+                "{:.0f} samples/sec (x{:.2f}), W1 {:.1f} KB",
+                HalfFormatName(result.format),
+                result.accuracy * 100.0f,
+                (result.accuracy - report.fp32Accuracy) * 100.0f,
+                result.disagreementCount,
+                report.sampleCount,
+                result.maxProbabilityError,
+                result.samplesPerSecond,
+                result.samplesPerSecond / report.fp32SamplesPerSecond,
+                result.w1Bytes / 1024.0);
+        }
+
+        m_epochMessages.push_back(message);
+
+        LogInfo.writeln(message);
+    }
+
+    BatchBackPropagationInput makeBatchInput(const Array<int>& indices, int baseIndex, int count) const
+    {
+        BatchBackPropagationInput input{
+            .x = Matrix(count, m_trainImages.property().pixelCount()),
+            .trueLabels = Array<int>(count),
+            .batches = batchSize
+        };
+
+        for (int i = 0; i < count; ++i)
+        {
+            const int imageIndex = indices[baseIndex + i];
+            const DatasetImage image = m_trainImages[imageIndex];
+
+            float* row = input.x[i];
+            for (int j = 0; j < image.size(); ++j)
+            {
+                row[j] = static_cast<float>(image[j]) / 255.0f;
+            }
+
+            input.trueLabels[i] = m_trainLabels[imageIndex];
+        }
+
+        return input;
     }
 
     Array<float> makeImageInput(const Image& image) const
     {
+        OCR_PROFILE_SCOPE(MakeImageInput);
+
         return image.data().map([](ColorU8 pixel)
         {
             return static_cast<float>(pixel.r) / 255.0f;
         });
     }
 
-    float computeAccuracy() const
+    float computeAccuracy()
     {
+        if (not g_applicationSettings.useGpu)
+        {
+            const EvaluationResult result = evaluateOnCpu(m_params);
+            LogInfo.writeln(std::format(
+                "Training completed!\n- Accuracy: {:.2f}\n- Elapsed Time: {:.3f} seconds ({:.0f} samples/sec)\n{}",
+                result.accuracy(),
+                result.elapsedSeconds,
+                result.samplesPerSecond(),
+                formatConfusionMatrix(result)));
+
+            return result.accuracy();
+        }
+
         Stopwatch stopwatch{};
 
+        const float accuracy = computeAccuracy(m_params);
+        LogInfo.writeln(std::format(
+            "Training completed!\n- Accuracy: {:.2f}\n- Elapsed Time: {:.2f} seconds",
+            accuracy,
+            stopwatch.sF()));
+
+        return accuracy;
+    }
+
+    /// @brief CPU ではテスト画像を uint8 のままタイルに分け、スレッドプールで並列に順伝搬する
+    EvaluationResult evaluateOnCpu(const NeuralNetworkParameters& params)
+    {
+        BatchEvaluator& evaluator = batchEvaluator();
+
+        // 評価するパラメータは m_params とは限らないので、量子化はここで行う
+        if (useQuantizedInference())
+        {
+            return evaluator.evaluate(m_testImage, m_testLabel, QuantizeNeuralNetwork(params));
+        }
+
+        if (useHalfPrecisionWeights())
+        {
+            return evaluator.evaluate(m_testImage, m_testLabel, MakeHalfNeuralNetwork(params, g_applicationSettings.halfWeightFormat));
+        }
+
+        return evaluator.evaluate(m_testImage, m_testLabel, params);
+    }
+
+    float computeAccuracy(const NeuralNetworkParameters& params)
+    {
+        if (not g_applicationSettings.useGpu)
+        {
+            return evaluateOnCpu(params).accuracy();
+        }
+
         int correctCount = 0;
-        for (int i = 0; i < m_testImage.images.size(); ++i)
+
+        for (int i = 0; i < m_testImage.size(); ++i)
         {
-            const auto x = makeImageInput(m_testImage.images[i]);
+            const auto x = makeImageInput(m_testImage[i]);
 
-            const NeuralNetworkOutput neuralOutput = NeuralNetwork(x, m_params);
+            const NeuralNetworkOutput neuralOutput = NeuralNetwork(x, params);
             if (neuralOutput.maxIndex() == m_testLabel[i])
             {
                 correctCount++;
             }
         }
 
-        const float accuracy = static_cast<float>(correctCount) / m_testImage.images.size();
-        LogInfo.writeln(std::format(
-            "Training completed!\n- Accuracy: {:.2f}\n- Elapsed Time: {:.2f} seconds",
-            accuracy,
-            stopwatch.sF()));
-
-        return accuracy;
+        return static_cast<float>(correctCount) / m_testImage.size();
     }
 };
 
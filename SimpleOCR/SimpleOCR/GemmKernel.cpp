@@ -0,0 +1,1590 @@
+﻿#include "pch.h"
+#include "GemmKernel.h"
+
+#include <bit>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define OCR_GEMM_X64 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#else
+#define OCR_GEMM_X64 0
+#endif
+
+// MSVC は関数単位の指定なしで AVX 命令を生成できるが、GCC/Clang は target 属性が必要
+#if defined(__GNUC__)
+#define OCR_TARGET_AVX2 __attribute__((target("avx2,fma,f16c")))
+#define OCR_TARGET_AVX512 __attribute__((target("avx512f")))
+#define OCR_TARGET_AVX512_VNNI __attribute__((target("avx512f,avx512vnni")))
+#else
+#define OCR_TARGET_AVX2
+#define OCR_TARGET_AVX512
+#define OCR_TARGET_AVX512_VNNI
+#endif
+
+using namespace ocr;
+
+namespace
+{
+    /// @brief 半精度の B を表す型。要素は uint16_t のビット列として持ち、読み込むときに float へ変換する
+    struct Float16Bits
+    {
+    };
+
+    struct BFloat16Bits
+    {
+    };
+
+    /// @brief TB が float 以外 (Float16Bits / BFloat16Bits) なら B は uint16_t の配列
+    template <class TB>
+    using BElement = std::conditional_t<std::is_same_v<TB, float>, float, uint16_t>;
+
+    float float16ToFloat(uint16_t value)
+    {
+        const uint32_t sign = static_cast<uint32_t>(value & 0x8000u) << 16;
+        const uint32_t exponent = (value >> 10) & 0x1fu;
+        const uint32_t mantissa = value & 0x3ffu;
+        if (exponent == 0)
+        {
+            // 0 と非正規化数 (mantissa * 2^-24)
+            const float magnitude = static_cast<float>(mantissa) * 0x1p-24f;
+            return sign ? -magnitude : magnitude;
+        }
+
+        // 指数のバイアスを 15 から 127 に付け替える。無限大と NaN は指数を全部 1 にする
+        const uint32_t floatExponent = exponent == 0x1fu ? 0xffu : exponent + 112;
+        return std::bit_cast<float>(sign | (floatExponent << 23) | (mantissa << 13));
+    }
+
+    /// @brief 最近接偶数への丸めで float を fp16 にする
+    uint16_t floatToFloat16(float value)
+    {
+        const uint32_t bits = std::bit_cast<uint32_t>(value);
+        const uint32_t sign = (bits >> 16) & 0x8000u;
+        const uint32_t magnitude = bits & 0x7fffffffu;
+
+        if (magnitude > 0x7f800000u) return static_cast<uint16_t>(sign | 0x7e00u); // NaN
+        if (magnitude >= 0x477ff000u) return static_cast<uint16_t>(sign | 0x7c00u); // 65520 以上は無限大
+
+        if (magnitude < 0x38800000u)
+        {
+            // fp16 の非正規化数 (2^-14 未満): 0.5 を足すと float の加算が 2^-24 単位の最近接偶数に丸める
+            const uint32_t units = std::bit_cast<uint32_t>(std::bit_cast<float>(magnitude) + 0.5f) - 0x3f000000u;
+            return static_cast<uint16_t>(sign | units);
+        }
+
+        // 仮数の下位 13 ビットを丸めてから、指数のバイアスを 127 から 15 に付け替える
+        const uint32_t rounded = magnitude + 0xfffu + ((magnitude >> 13) & 1u);
+        return static_cast<uint16_t>(sign | ((rounded - 0x38000000u) >> 13));
+    }
+
+    float bfloat16ToFloat(uint16_t value)
+    {
+        return std::bit_cast<float>(static_cast<uint32_t>(value) << 16);
+    }
+
+    /// @brief 最近接偶数への丸めで float を bf16 (float の上位 16 ビット) にする
+    uint16_t floatToBFloat16(float value)
+    {
+        const uint32_t bits = std::bit_cast<uint32_t>(value);
+        if ((bits & 0x7fffffffu) > 0x7f800000u)
+        {
+            return static_cast<uint16_t>((bits >> 16) | 0x40u); // 下位を切り捨てても NaN のままにする
+        }
+
+        return static_cast<uint16_t>((bits + 0x7fffu + ((bits >> 16) & 1u)) >> 16);
+    }
+
+    template <class TB>
+    float loadScalar(BElement<TB> value)
+    {
+        if constexpr (std::is_same_v<TB, Float16Bits>)
+        {
+            return float16ToFloat(value);
+        }
+        else if constexpr (std::is_same_v<TB, BFloat16Bits>)
+        {
+            return bfloat16ToFloat(value);
+        }
+        else
+        {
+            return value;
+        }
+    }
+
+    /// @brief C += scale * A * B. TA が float のときは scale = 1 として扱う
+    template <class TA, class TB>
+    using GemmFunction = void (*)(int m, int n, int k,
+                                  const TA* a, int lda,
+                                  const BElement<TB>* b, int ldb,
+                                  float* c, int ldc,
+                                  float scale);
+
+    /// @brief uint8 の A は 0 から積み上げ、最後に scale を掛けて C に加算する
+    template <class TA>
+    constexpr bool isScaled = std::is_same_v<TA, uint8_t>;
+
+    /// @brief キャッシュブロッキングの大きさ: B の [KC][NC] ブロックが L2 に収まるようにする
+    constexpr int blockK = 256;
+
+    constexpr int blockN = 128;
+
+    constexpr int blockM = 96;
+
+    constexpr int scalarTileN = 16;
+
+    template <class TA, class TB>
+    void gemmScalar(int m, int n, int k,
+                    const TA* a, int lda,
+                    const BElement<TB>* b, int ldb,
+                    float* c, int ldc,
+                    float scale)
+    {
+        // C の行の一部をローカルに保持し、B の行を連続アクセスしながら k 方向に積む
+        for (int i = 0; i < m; ++i)
+        {
+            const TA* ai = a + i * lda;
+            float* ci = c + i * ldc;
+            for (int j = 0; j < n; j += scalarTileN)
+            {
+                const int nr = std::min(scalarTileN, n - j);
+
+                float acc[scalarTileN]{};
+                if constexpr (not isScaled<TA>)
+                {
+                    for (int jj = 0; jj < nr; ++jj)
+                    {
+                        acc[jj] = ci[j + jj];
+                    }
+                }
+
+                for (int p = 0; p < k; ++p)
+                {
+                    const float aip = static_cast<float>(ai[p]);
+                    const BElement<TB>* bp = b + p * ldb + j;
+                    if (nr == scalarTileN)
+                    {
+                        for (int jj = 0; jj < scalarTileN; ++jj)
+                        {
+                            acc[jj] += aip * loadScalar<TB>(bp[jj]);
+                        }
+                    }
+                    else
+                    {
+                        for (int jj = 0; jj < nr; ++jj)
+                        {
+                            acc[jj] += aip * loadScalar<TB>(bp[jj]);
+                        }
+                    }
+                }
+
+                for (int jj = 0; jj < nr; ++jj)
+                {
+                    ci[j + jj] = isScaled<TA> ? ci[j + jj] + scale * acc[jj] : acc[jj];
+                }
+            }
+        }
+    }
+
+    /// @brief C += op(A) * op(B) (float の A, B のどちらかを転置して読む)
+    using TransposedGemmFunction = void (*)(Transpose transA, Transpose transB,
+                                            int m, int n, int k,
+                                            const float* a, int lda,
+                                            const float* b, int ldb,
+                                            float* c, int ldc);
+
+    /// @brief A * B^T の A の行数がこれ以下なら、B^T を詰めずに内積で計算する
+    constexpr int smallTransposedRows = 2;
+
+    void gemmScalarTransposed(Transpose transA, Transpose transB,
+                              int m, int n, int k,
+                              const float* a, int lda,
+                              const float* b, int ldb,
+                              float* c, int ldc)
+    {
+        if (transB == Transpose::No)
+        {
+            if (transA == Transpose::No)
+            {
+                gemmScalar<float, float>(m, n, k, a, lda, b, ldb, c, ldc, 1.0f);
+                return;
+            }
+
+            // A^T * B: A の p 行目 (op(A) の p 列目) と B の p 行目の外積を C に足し込む。A, B, C とも行方向に連続して読む
+            for (int p = 0; p < k; ++p)
+            {
+                const float* ap = a + p * lda;
+                const float* bp = b + p * ldb;
+                for (int i = 0; i < m; ++i)
+                {
+                    const float aip = ap[i];
+                    float* ci = c + i * ldc;
+                    for (int j = 0; j < n; ++j)
+                    {
+                        ci[j] += aip * bp[j];
+                    }
+                }
+            }
+
+            return;
+        }
+
+        // op(B) = B^T: C[i][j] は op(A) の i 行目と B の j 行目の内積なので、B も行方向に連続して読める。
+        // op(A) = A^T の行は飛び飛びに並ぶので、1 行ずつ連続した領域に写してから内積を取る
+        thread_local std::vector<float> column;
+        for (int i = 0; i < m; ++i)
+        {
+            const float* ai = a + i * lda;
+            if (transA == Transpose::Yes)
+            {
+                column.resize(k);
+                for (int p = 0; p < k; ++p)
+                {
+                    column[p] = a[p * lda + i];
+                }
+
+                ai = column.data();
+            }
+
+            float* ci = c + i * ldc;
+            for (int j = 0; j < n; ++j)
+            {
+                const float* bj = b + j * ldb;
+                float sum = 0.0f;
+                for (int p = 0; p < k; ++p)
+                {
+                    sum += ai[p] * bj[p];
+                }
+
+                ci[j] += sum;
+            }
+        }
+    }
+
+#if OCR_GEMM_X64
+    /// @brief C のタイル [mr][nr] に scale * A[mr][kc] * B[kc][nr] を加算する
+    template <class TA>
+    using TileFunction = void (*)(int kc, int nr,
+                                  const TA* a, int lda,
+                                  const float* b, int ldb,
+                                  float* c, int ldc,
+                                  float scale);
+
+    /// @brief 半精度の B の 1 行 (count 要素) を float に変換する
+    template <class TB>
+    using ConvertRowFunction = void (*)(int count, const BElement<TB>* source, float* destination);
+
+    /// @brief 半精度または転置した B のブロック [blockK][blockN] を float の行優先に詰めて置く、スレッドごとの領域
+    float* packedBBuffer()
+    {
+        alignas(64) thread_local float buffer[blockK * blockN];
+        return buffer;
+    }
+
+    /// @brief 転置した A のブロック [blockM][blockK] を行優先に詰めて置く、スレッドごとの領域
+    float* packedABuffer()
+    {
+        alignas(64) thread_local float buffer[blockM * blockK];
+        return buffer;
+    }
+
+    /// @brief [rows][cols] の source を転置して destination ([cols][rows]) に書き込む
+    /// @details 16 x 16 の正方形ごとに写し、同時に触れるキャッシュラインを読み書きとも 16 本に抑える
+    /// (詰める先の行の距離は 2 のべき乗なので、1 行ずつ写すと L1 の同じセットに集まって追い出し合う)
+    void transposeBlock(int rows, int cols, const float* source, int ldSource, float* destination, int ldDestination)
+    {
+        constexpr int tile = 16;
+        for (int i0 = 0; i0 < rows; i0 += tile)
+        {
+            const int iEnd = std::min(i0 + tile, rows);
+            for (int j0 = 0; j0 < cols; j0 += tile)
+            {
+                const int jEnd = std::min(j0 + tile, cols);
+                for (int j = j0; j < jEnd; ++j)
+                {
+                    float* dj = destination + j * ldDestination;
+                    for (int i = i0; i < iEnd; ++i)
+                    {
+                        dj[i] = source[i * ldSource + j];
+                    }
+                }
+            }
+        }
+    }
+
+    /// @brief B^T として格納された b ([n][k]) から、op(B) の [pc, pc + kc) 行 x [jc, jc + nc) 列を buffer に詰める
+    void packTransposedB(int kc, int nc, const float* b, int ldb, float* buffer)
+    {
+        transposeBlock(nc, kc, b, ldb, buffer, blockN);
+    }
+
+    /// @brief A^T として格納された a ([k][m]) から、op(A) の [ic, ic + mc) 行 x [pc, pc + kc) 列を buffer に詰める
+    void packTransposedA(int mc, int kc, const float* a, int lda, float* buffer)
+    {
+        transposeBlock(kc, mc, a, lda, buffer, blockK);
+    }
+
+    /// @brief (MR x NR) のレジスタタイルを並べてブロック単位で計算する
+    /// @details 半精度の B はブロックごとに 1 回だけ float へ変換し、M 方向の全タイルで使い回す
+    /// (タイルの内側で変換すると、A の放送と同じ実行ポートを取り合って float より遅くなる)。
+    /// 転置して読む float の A, B も同じようにブロックごとに行優先へ詰め、タイルは転置なしのものをそのまま使う
+    template <int MR, int NR, class TA, class TB>
+    void blockedGemm(int m, int n, int k,
+                     const TA* a, int lda,
+                     const BElement<TB>* b, int ldb,
+                     float* c, int ldc,
+                     float scale,
+                     const TileFunction<TA> (&fullTiles)[MR + 1],
+                     const TileFunction<TA> (&partialTiles)[MR + 1],
+                     ConvertRowFunction<TB> convertRow = nullptr,
+                     Transpose transA = Transpose::No,
+                     Transpose transB = Transpose::No)
+    {
+        for (int jc = 0; jc < n; jc += blockN)
+        {
+            const int nc = std::min(blockN, n - jc);
+            for (int pc = 0; pc < k; pc += blockK)
+            {
+                const int kc = std::min(blockK, k - pc);
+
+                const float* bBlock;
+                int ldbBlock;
+                if constexpr (std::is_same_v<TB, float>)
+                {
+                    if (transB == Transpose::Yes)
+                    {
+                        float* buffer = packedBBuffer();
+                        packTransposedB(kc, nc, b + jc * ldb + pc, ldb, buffer);
+                        bBlock = buffer;
+                        ldbBlock = blockN;
+                    }
+                    else
+                    {
+                        bBlock = b + pc * ldb + jc;
+                        ldbBlock = ldb;
+                    }
+                }
+                else
+                {
+                    float* buffer = packedBBuffer();
+                    for (int p = 0; p < kc; ++p)
+                    {
+                        convertRow(nc, b + (pc + p) * ldb + jc, buffer + p * blockN);
+                    }
+
+                    bBlock = buffer;
+                    ldbBlock = blockN;
+                }
+
+                for (int ic = 0; ic < m; ic += blockM)
+                {
+                    const int mc = std::min(blockM, m - ic);
+
+                    const TA* aBlock = a + ic * lda + pc;
+                    int ldaBlock = lda;
+                    if constexpr (std::is_same_v<TA, float>)
+                    {
+                        if (transA == Transpose::Yes)
+                        {
+                            float* buffer = packedABuffer();
+                            packTransposedA(mc, kc, a + pc * lda + ic, lda, buffer);
+                            aBlock = buffer;
+                            ldaBlock = blockK;
+                        }
+                    }
+
+                    for (int ir = 0; ir < mc; ir += MR)
+                    {
+                        const int mr = std::min(MR, mc - ir);
+                        const TA* ai = aBlock + ir * ldaBlock;
+                        float* ci = c + (ic + ir) * ldc + jc;
+                        for (int jr = 0; jr < nc; jr += NR)
+                        {
+                            const int nr = std::min(NR, nc - jr);
+                            const TileFunction<TA> tile = nr == NR ? fullTiles[mr] : partialTiles[mr];
+                            tile(kc, nr, ai, ldaBlock, bBlock + jr, ldbBlock, ci + jr, ldc, scale);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // ----------------------------------------------- AVX2 + FMA: 6 x 16 タイル
+
+    constexpr int avx2TileM = 6;
+
+    constexpr int avx2TileN = 16;
+
+    alignas(32) constexpr int32_t avx2MaskTable[16] = {
+        -1, -1, -1, -1, -1, -1, -1, -1,
+        0, 0, 0, 0, 0, 0, 0, 0,
+    };
+
+    OCR_TARGET_AVX2 __m256i avx2TailMask(int n)
+    {
+        n = std::clamp(n, 0, 8);
+        return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(avx2MaskTable + 8 - n));
+    }
+
+    /// @brief B の 8 要素を float として読む。Full でなければ先頭の count 要素だけを読み、残りは 0 にする
+    template <class TB, bool Full>
+    OCR_TARGET_AVX2 __m256 loadAvx2(const BElement<TB>* b, int count, __m256i mask)
+    {
+        if constexpr (std::is_same_v<TB, float>)
+        {
+            return Full ? _mm256_loadu_ps(b) : _mm256_maskload_ps(b, mask);
+        }
+        else
+        {
+            __m128i bits;
+            if constexpr (Full)
+            {
+                bits = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b));
+            }
+            else
+            {
+                // 16 ビット単位のマスク付き読み込みはないので、読める分だけを 0 埋めした領域に写す
+                alignas(16) uint16_t buffer[8]{};
+                std::memcpy(buffer, b, sizeof(uint16_t) * std::clamp(count, 0, 8));
+                bits = _mm_load_si128(reinterpret_cast<const __m128i*>(buffer));
+            }
+
+            if constexpr (std::is_same_v<TB, Float16Bits>)
+            {
+                return _mm256_cvtph_ps(bits);
+            }
+            else
+            {
+                return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(bits), 16));
+            }
+        }
+    }
+
+    template <class TB>
+    OCR_TARGET_AVX2 void convertRowAvx2(int count, const BElement<TB>* source, float* destination)
+    {
+        if constexpr (not std::is_same_v<TB, float>)
+        {
+            int j = 0;
+            for (; j + 8 <= count; j += 8)
+            {
+                _mm256_storeu_ps(destination + j, loadAvx2<TB, true>(source + j, 8, __m256i{}));
+            }
+
+            if (j < count)
+            {
+                const __m256i mask = avx2TailMask(count - j);
+                _mm256_maskstore_ps(destination + j, mask, loadAvx2<TB, false>(source + j, count - j, mask));
+            }
+        }
+    }
+
+    template <class TA, int MR, bool Full>
+    OCR_TARGET_AVX2 void tileAvx2(int kc, int nr,
+                                  const TA* a, int lda,
+                                  const float* b, int ldb,
+                                  float* c, int ldc,
+                                  float scale)
+    {
+        const __m256i mask0 = avx2TailMask(nr);
+        const __m256i mask1 = avx2TailMask(nr - 8);
+
+        __m256 acc0[MR];
+        __m256 acc1[MR];
+        for (int r = 0; r < MR; ++r)
+        {
+            if constexpr (isScaled<TA>)
+            {
+                acc0[r] = _mm256_setzero_ps();
+                acc1[r] = _mm256_setzero_ps();
+            }
+            else if constexpr (Full)
+            {
+                acc0[r] = _mm256_loadu_ps(c + r * ldc);
+                acc1[r] = _mm256_loadu_ps(c + r * ldc + 8);
+            }
+            else
+            {
+                acc0[r] = _mm256_maskload_ps(c + r * ldc, mask0);
+                acc1[r] = _mm256_maskload_ps(c + r * ldc + 8, mask1);
+            }
+        }
+
+        for (int p = 0; p < kc; ++p)
+        {
+            __m256 b0;
+            __m256 b1;
+            if constexpr (Full)
+            {
+                b0 = _mm256_loadu_ps(b + p * ldb);
+                b1 = _mm256_loadu_ps(b + p * ldb + 8);
+            }
+            else
+            {
+                b0 = _mm256_maskload_ps(b + p * ldb, mask0);
+                b1 = _mm256_maskload_ps(b + p * ldb + 8, mask1);
+            }
+
+            for (int r = 0; r < MR; ++r)
+            {
+                const __m256 ar = _mm256_set1_ps(static_cast<float>(a[r * lda + p]));
+                acc0[r] = _mm256_fmadd_ps(ar, b0, acc0[r]);
+                acc1[r] = _mm256_fmadd_ps(ar, b1, acc1[r]);
+            }
+        }
+
+        if constexpr (isScaled<TA>)
+        {
+            const __m256 scaleVector = _mm256_set1_ps(scale);
+            for (int r = 0; r < MR; ++r)
+            {
+                const __m256 c0 = Full ? _mm256_loadu_ps(c + r * ldc) : _mm256_maskload_ps(c + r * ldc, mask0);
+                const __m256 c1 = Full ? _mm256_loadu_ps(c + r * ldc + 8) : _mm256_maskload_ps(c + r * ldc + 8, mask1);
+                acc0[r] = _mm256_fmadd_ps(scaleVector, acc0[r], c0);
+                acc1[r] = _mm256_fmadd_ps(scaleVector, acc1[r], c1);
+            }
+        }
+
+        for (int r = 0; r < MR; ++r)
+        {
+            if constexpr (Full)
+            {
+                _mm256_storeu_ps(c + r * ldc, acc0[r]);
+                _mm256_storeu_ps(c + r * ldc + 8, acc1[r]);
+            }
+            else
+            {
+                _mm256_maskstore_ps(c + r * ldc, mask0, acc0[r]);
+                _mm256_maskstore_ps(c + r * ldc + 8, mask1, acc1[r]);
+            }
+        }
+    }
+
+    /// @brief 行数 (1..6) ごとの列が全部埋まったタイルと端のタイル
+    template <class TA>
+    constexpr TileFunction<TA> avx2FullTiles[avx2TileM + 1] = {
+        nullptr,
+        tileAvx2<TA, 1, true>, tileAvx2<TA, 2, true>, tileAvx2<TA, 3, true>,
+        tileAvx2<TA, 4, true>, tileAvx2<TA, 5, true>, tileAvx2<TA, 6, true>,
+    };
+
+    template <class TA>
+    constexpr TileFunction<TA> avx2PartialTiles[avx2TileM + 1] = {
+        nullptr,
+        tileAvx2<TA, 1, false>, tileAvx2<TA, 2, false>, tileAvx2<TA, 3, false>,
+        tileAvx2<TA, 4, false>, tileAvx2<TA, 5, false>, tileAvx2<TA, 6, false>,
+    };
+
+    template <class TA, class TB>
+    void gemmAvx2(int m, int n, int k,
+                  const TA* a, int lda,
+                  const BElement<TB>* b, int ldb,
+                  float* c, int ldc,
+                  float scale)
+    {
+        blockedGemm<avx2TileM, avx2TileN, TA, TB>(m, n, k, a, lda, b, ldb, c, ldc, scale,
+                                                  avx2FullTiles<TA>, avx2PartialTiles<TA>, convertRowAvx2<TB>);
+    }
+
+    void gemmAvx2Transposed(Transpose transA, Transpose transB,
+                            int m, int n, int k,
+                            const float* a, int lda,
+                            const float* b, int ldb,
+                            float* c, int ldc)
+    {
+        blockedGemm<avx2TileM, avx2TileN, float, float>(m, n, k, a, lda, b, ldb, c, ldc, 1.0f,
+                                                        avx2FullTiles<float>, avx2PartialTiles<float>, nullptr,
+                                                        transA, transB);
+    }
+
+    // ----------------------------------------------- AVX-512: 8 x 32 タイル
+
+    constexpr int avx512TileM = 8;
+
+    constexpr int avx512TileN = 32;
+
+    OCR_TARGET_AVX512 __mmask16 avx512TailMask(int n)
+    {
+        n = std::clamp(n, 0, 16);
+        return static_cast<__mmask16>((1u << n) - 1u);
+    }
+
+    /// @brief B の 16 要素を float として読む。Full でなければ先頭の count 要素だけを読み、残りは 0 にする
+    template <class TB, bool Full>
+    OCR_TARGET_AVX512 __m512 loadAvx512(const BElement<TB>* b, int count, __mmask16 mask)
+    {
+        if constexpr (std::is_same_v<TB, float>)
+        {
+            return Full ? _mm512_loadu_ps(b) : _mm512_maskz_loadu_ps(mask, b);
+        }
+        else
+        {
+            // 16 ビット単位のマスク付き読み込みは AVX-512BW が要るので、端は 0 埋めした領域に写して読む
+            __m256i bits;
+            if constexpr (Full)
+            {
+                bits = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b));
+            }
+            else
+            {
+                alignas(32) uint16_t buffer[16]{};
+                std::memcpy(buffer, b, sizeof(uint16_t) * std::clamp(count, 0, 16));
+                bits = _mm256_load_si256(reinterpret_cast<const __m256i*>(buffer));
+            }
+
+            if constexpr (std::is_same_v<TB, Float16Bits>)
+            {
+                return _mm512_cvtph_ps(bits);
+            }
+            else
+            {
+                return _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_cvtepu16_epi32(bits), 16));
+            }
+        }
+    }
+
+    template <class TB>
+    OCR_TARGET_AVX512 void convertRowAvx512(int count, const BElement<TB>* source, float* destination)
+    {
+        if constexpr (not std::is_same_v<TB, float>)
+        {
+            int j = 0;
+            for (; j + 16 <= count; j += 16)
+            {
+                _mm512_storeu_ps(destination + j, loadAvx512<TB, true>(source + j, 16, __mmask16{}));
+            }
+
+            if (j < count)
+            {
+                const __mmask16 mask = avx512TailMask(count - j);
+                _mm512_mask_storeu_ps(destination + j, mask, loadAvx512<TB, false>(source + j, count - j, mask));
+            }
+        }
+    }
+
+    template <class TA, int MR, bool Full>
+    OCR_TARGET_AVX512 void tileAvx512(int kc, int nr,
+                                      const TA* a, int lda,
+                                      const float* b, int ldb,
+                                      float* c, int ldc,
+                                      float scale)
+    {
+        const __mmask16 mask0 = avx512TailMask(nr);
+        const __mmask16 mask1 = avx512TailMask(nr - 16);
+
+        __m512 acc0[MR];
+        __m512 acc1[MR];
+        for (int r = 0; r < MR; ++r)
+        {
+            if constexpr (isScaled<TA>)
+            {
+                acc0[r] = _mm512_setzero_ps();
+                acc1[r] = _mm512_setzero_ps();
+            }
+            else if constexpr (Full)
+            {
+                acc0[r] = _mm512_loadu_ps(c + r * ldc);
+                acc1[r] = _mm512_loadu_ps(c + r * ldc + 16);
+            }
+            else
+            {
+                acc0[r] = _mm512_maskz_loadu_ps(mask0, c + r * ldc);
+                acc1[r] = _mm512_maskz_loadu_ps(mask1, c + r * ldc + 16);
+            }
+        }
+
+        for (int p = 0; p < kc; ++p)
+        {
+            __m512 b0;
+            __m512 b1;
+            if constexpr (Full)
+            {
+                b0 = _mm512_loadu_ps(b + p * ldb);
+                b1 = _mm512_loadu_ps(b + p * ldb + 16);
+            }
+            else
+            {
+                b0 = _mm512_maskz_loadu_ps(mask0, b + p * ldb);
+                b1 = _mm512_maskz_loadu_ps(mask1, b + p * ldb + 16);
+            }
+
+            for (int r = 0; r < MR; ++r)
+            {
+                const __m512 ar = _mm512_set1_ps(static_cast<float>(a[r * lda + p]));
+                acc0[r] = _mm512_fmadd_ps(ar, b0, acc0[r]);
+                acc1[r] = _mm512_fmadd_ps(ar, b1, acc1[r]);
+            }
+        }
+
+        if constexpr (isScaled<TA>)
+        {
+            const __m512 scaleVector = _mm512_set1_ps(scale);
+            for (int r = 0; r < MR; ++r)
+            {
+                const __m512 c0 = _mm512_maskz_loadu_ps(mask0, c + r * ldc);
+                const __m512 c1 = _mm512_maskz_loadu_ps(mask1, c + r * ldc + 16);
+                acc0[r] = _mm512_fmadd_ps(scaleVector, acc0[r], c0);
+                acc1[r] = _mm512_fmadd_ps(scaleVector, acc1[r], c1);
+            }
+        }
+
+        for (int r = 0; r < MR; ++r)
+        {
+            if constexpr (Full)
+            {
+                _mm512_storeu_ps(c + r * ldc, acc0[r]);
+                _mm512_storeu_ps(c + r * ldc + 16, acc1[r]);
+            }
+            else
+            {
+                _mm512_mask_storeu_ps(c + r * ldc, mask0, acc0[r]);
+                _mm512_mask_storeu_ps(c + r * ldc + 16, mask1, acc1[r]);
+            }
+        }
+    }
+
+    template <class TA>
+    constexpr TileFunction<TA> avx512FullTiles[avx512TileM + 1] = {
+        nullptr,
+        tileAvx512<TA, 1, true>, tileAvx512<TA, 2, true>, tileAvx512<TA, 3, true>, tileAvx512<TA, 4, true>,
+        tileAvx512<TA, 5, true>, tileAvx512<TA, 6, true>, tileAvx512<TA, 7, true>, tileAvx512<TA, 8, true>,
+    };
+
+    template <class TA>
+    constexpr TileFunction<TA> avx512PartialTiles[avx512TileM + 1] = {
+        nullptr,
+        tileAvx512<TA, 1, false>, tileAvx512<TA, 2, false>, tileAvx512<TA, 3, false>, tileAvx512<TA, 4, false>,
+        tileAvx512<TA, 5, false>, tileAvx512<TA, 6, false>, tileAvx512<TA, 7, false>, tileAvx512<TA, 8, false>,
+    };
+
+    template <class TA, class TB>
+    void gemmAvx512(int m, int n, int k,
+                    const TA* a, int lda,
+                    const BElement<TB>* b, int ldb,
+                    float* c, int ldc,
+                    float scale)
+    {
+        blockedGemm<avx512TileM, avx512TileN, TA, TB>(m, n, k, a, lda, b, ldb, c, ldc, scale,
+                                                      avx512FullTiles<TA>, avx512PartialTiles<TA>, convertRowAvx512<TB>);
+    }
+
+    void gemmAvx512Transposed(Transpose transA, Transpose transB,
+                              int m, int n, int k,
+                              const float* a, int lda,
+                              const float* b, int ldb,
+                              float* c, int ldc)
+    {
+        blockedGemm<avx512TileM, avx512TileN, float, float>(m, n, k, a, lda, b, ldb, c, ldc, 1.0f,
+                                                            avx512FullTiles<float>, avx512PartialTiles<float>, nullptr,
+                                                            transA, transB);
+    }
+
+#endif
+
+    // ----------------------------------------------- 疎行列 (CSR) x 密行列
+
+    template <class TB>
+    using SparseGemmFunction = void (*)(int m, int n,
+                                        const int* offsets, const int* indices, const float* values,
+                                        const BElement<TB>* b, int ldb,
+                                        float* c, int ldc);
+
+    template <class TB>
+    void sparseGemmScalar(int m, int n,
+                          const int* offsets, const int* indices, const float* values,
+                          const BElement<TB>* b, int ldb,
+                          float* c, int ldc)
+    {
+        // C の行の一部をローカルに保持し、非ゼロ要素ごとに対応する B の行を足し込む
+        for (int i = 0; i < m; ++i)
+        {
+            float* ci = c + i * ldc;
+            for (int j = 0; j < n; j += scalarTileN)
+            {
+                const int nr = std::min(scalarTileN, n - j);
+
+                float acc[scalarTileN]{};
+                for (int jj = 0; jj < nr; ++jj)
+                {
+                    acc[jj] = ci[j + jj];
+                }
+
+                for (int p = offsets[i]; p < offsets[i + 1]; ++p)
+                {
+                    const float value = values[p];
+                    const BElement<TB>* bp = b + indices[p] * ldb + j;
+                    for (int jj = 0; jj < nr; ++jj)
+                    {
+                        acc[jj] += value * loadScalar<TB>(bp[jj]);
+                    }
+                }
+
+                for (int jj = 0; jj < nr; ++jj)
+                {
+                    ci[j + jj] = acc[jj];
+                }
+            }
+        }
+    }
+
+#if OCR_GEMM_X64
+    /// @brief C の行を 4 本のベクトル (32 列) ずつレジスタに保持して、非ゼロ要素の数だけ積和する
+    template <class TB, bool Full>
+    OCR_TARGET_AVX2 void sparseRowAvx2(int nr,
+                                       int begin, int end, const int* indices, const float* values,
+                                       const BElement<TB>* b, int ldb,
+                                       float* c)
+    {
+        constexpr int vectorCount = 4;
+
+        __m256i mask[vectorCount];
+        __m256 acc[vectorCount];
+        for (int q = 0; q < vectorCount; ++q)
+        {
+            mask[q] = avx2TailMask(nr - q * 8);
+            acc[q] = Full ? _mm256_loadu_ps(c + q * 8) : _mm256_maskload_ps(c + q * 8, mask[q]);
+        }
+
+        for (int p = begin; p < end; ++p)
+        {
+            const __m256 value = _mm256_set1_ps(values[p]);
+            const BElement<TB>* bp = b + indices[p] * ldb;
+            for (int q = 0; q < vectorCount; ++q)
+            {
+                acc[q] = _mm256_fmadd_ps(value, loadAvx2<TB, Full>(bp + q * 8, nr - q * 8, mask[q]), acc[q]);
+            }
+        }
+
+        for (int q = 0; q < vectorCount; ++q)
+        {
+            if constexpr (Full)
+            {
+                _mm256_storeu_ps(c + q * 8, acc[q]);
+            }
+            else
+            {
+                _mm256_maskstore_ps(c + q * 8, mask[q], acc[q]);
+            }
+        }
+    }
+
+    template <class TB>
+    OCR_TARGET_AVX2 void sparseGemmAvx2(int m, int n,
+                                        const int* offsets, const int* indices, const float* values,
+                                        const BElement<TB>* b, int ldb,
+                                        float* c, int ldc)
+    {
+        constexpr int chunk = 32;
+        for (int i = 0; i < m; ++i)
+        {
+            float* ci = c + i * ldc;
+            for (int j = 0; j < n; j += chunk)
+            {
+                const int nr = std::min(chunk, n - j);
+                if (nr == chunk)
+                {
+                    sparseRowAvx2<TB, true>(nr, offsets[i], offsets[i + 1], indices, values, b + j, ldb, ci + j);
+                }
+                else
+                {
+                    sparseRowAvx2<TB, false>(nr, offsets[i], offsets[i + 1], indices, values, b + j, ldb, ci + j);
+                }
+            }
+        }
+    }
+
+    /// @brief C の行を 8 本のベクトル (128 列) ずつレジスタに保持して、非ゼロ要素の数だけ積和する
+    template <class TB, bool Full>
+    OCR_TARGET_AVX512 void sparseRowAvx512(int nr,
+                                           int begin, int end, const int* indices, const float* values,
+                                           const BElement<TB>* b, int ldb,
+                                           float* c)
+    {
+        constexpr int vectorCount = 8;
+
+        __mmask16 mask[vectorCount];
+        __m512 acc[vectorCount];
+        for (int q = 0; q < vectorCount; ++q)
+        {
+            mask[q] = avx512TailMask(nr - q * 16);
+            acc[q] = Full ? _mm512_loadu_ps(c + q * 16) : _mm512_maskz_loadu_ps(mask[q], c + q * 16);
+        }
+
+        for (int p = begin; p < end; ++p)
+        {
+            const __m512 value = _mm512_set1_ps(values[p]);
+            const BElement<TB>* bp = b + indices[p] * ldb;
+            for (int q = 0; q < vectorCount; ++q)
+            {
+                acc[q] = _mm512_fmadd_ps(value, loadAvx512<TB, Full>(bp + q * 16, nr - q * 16, mask[q]), acc[q]);
+            }
+        }
+
+        for (int q = 0; q < vectorCount; ++q)
+        {
+            if constexpr (Full)
+            {
+                _mm512_storeu_ps(c + q * 16, acc[q]);
+            }
+            else
+            {
+                _mm512_mask_storeu_ps(c + q * 16, mask[q], acc[q]);
+            }
+        }
+    }
+
+    template <class TB>
+    OCR_TARGET_AVX512 void sparseGemmAvx512(int m, int n,
+                                            const int* offsets, const int* indices, const float* values,
+                                            const BElement<TB>* b, int ldb,
+                                            float* c, int ldc)
+    {
+        constexpr int chunk = 128;
+        for (int i = 0; i < m; ++i)
+        {
+            float* ci = c + i * ldc;
+            for (int j = 0; j < n; j += chunk)
+            {
+                const int nr = std::min(chunk, n - j);
+                if (nr == chunk)
+                {
+                    sparseRowAvx512<TB, true>(nr, offsets[i], offsets[i + 1], indices, values, b + j, ldb, ci + j);
+                }
+                else
+                {
+                    sparseRowAvx512<TB, false>(nr, offsets[i], offsets[i + 1], indices, values, b + j, ldb, ci + j);
+                }
+            }
+        }
+    }
+#endif
+
+    template <class TB>
+    SparseGemmFunction<TB> selectSparseGemmFunction(GemmKernelType type)
+    {
+        switch (type)
+        {
+#if OCR_GEMM_X64
+        case GemmKernelType::Avx512:
+            return sparseGemmAvx512<TB>;
+        case GemmKernelType::Avx2:
+            return sparseGemmAvx2<TB>;
+#endif
+        default:
+            return sparseGemmScalar<TB>;
+        }
+    }
+
+    // ----------------------------------------------- uint8 x int8 の量子化行列積
+
+    using QuantizedGemmFunction = void (*)(int m, int k, int np,
+                                           const uint8_t* a, int lda,
+                                           const int8_t* b,
+                                           int32_t* c, int ldc);
+
+    /// @brief A の行の 4g .. 4g + 3 番目の画素を 1 つの 32 ビット整数として読む (k を超える部分は 0)
+    inline int32_t loadPixelGroup(const uint8_t* ai, int k, int g)
+    {
+        int32_t value{};
+        if (g * 4 + 4 <= k)
+        {
+            std::memcpy(&value, ai + g * 4, 4);
+        }
+        else
+        {
+            std::memcpy(&value, ai + g * 4, k - g * 4);
+        }
+
+        return value;
+    }
+
+    void quantizedGemmScalar(int m, int k, int np,
+                             const uint8_t* a, int lda,
+                             const int8_t* b,
+                             int32_t* c, int ldc)
+    {
+        const int groups = (k + 3) / 4;
+        for (int i = 0; i < m; ++i)
+        {
+            const uint8_t* ai = a + i * lda;
+            int32_t* ci = c + i * ldc;
+            std::fill(ci, ci + np, 0);
+
+            for (int g = 0; g < groups; ++g)
+            {
+                const int32_t group = loadPixelGroup(ai, k, g);
+                if (group == 0) continue;
+
+                uint8_t pixels[4]{};
+                std::memcpy(pixels, &group, 4);
+
+                const int8_t* bg = b + static_cast<size_t>(g) * np * 4;
+                for (int j = 0; j < np; ++j)
+                {
+                    const int8_t* bj = bg + j * 4;
+                    ci[j] += pixels[0] * bj[0] + pixels[1] * bj[1] + pixels[2] * bj[2] + pixels[3] * bj[3];
+                }
+            }
+        }
+    }
+
+#if OCR_GEMM_X64
+    /// @brief R 行 x 16 列の C をレジスタに保持し、4 画素ずつ maddubs (int16 に 2 組ずつ) と madd (int32 へ) で積和する
+    template <int R>
+    OCR_TARGET_AVX2 void quantizedTileAvx2(int k, int np,
+                                           const uint8_t* a, int lda,
+                                           const int8_t* b,
+                                           int32_t* c, int ldc)
+    {
+        constexpr int vectorCount = 2;
+        const int groups = (k + 3) / 4;
+        const __m256i ones = _mm256_set1_epi16(1);
+
+        for (int j = 0; j < np; j += vectorCount * 8)
+        {
+            __m256i acc[R][vectorCount];
+            for (int r = 0; r < R; ++r)
+            {
+                for (int q = 0; q < vectorCount; ++q)
+                {
+                    acc[r][q] = _mm256_setzero_si256();
+                }
+            }
+
+            for (int g = 0; g < groups; ++g)
+            {
+                int32_t pixelGroups[R];
+                int32_t any{};
+                for (int r = 0; r < R; ++r)
+                {
+                    pixelGroups[r] = loadPixelGroup(a + r * lda, k, g);
+                    any |= pixelGroups[r];
+                }
+
+                // 画像の縁のように全行で 0 の画素は積和を省く
+                if (any == 0) continue;
+
+                const int8_t* bg = b + (static_cast<size_t>(g) * np + j) * 4;
+                __m256i bq[vectorCount];
+                for (int q = 0; q < vectorCount; ++q)
+                {
+                    bq[q] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bg + q * 32));
+                }
+
+                for (int r = 0; r < R; ++r)
+                {
+                    const __m256i ar = _mm256_set1_epi32(pixelGroups[r]);
+                    for (int q = 0; q < vectorCount; ++q)
+                    {
+                        const __m256i pairs = _mm256_maddubs_epi16(ar, bq[q]);
+                        acc[r][q] = _mm256_add_epi32(acc[r][q], _mm256_madd_epi16(pairs, ones));
+                    }
+                }
+            }
+
+            for (int r = 0; r < R; ++r)
+            {
+                for (int q = 0; q < vectorCount; ++q)
+                {
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(c + r * ldc + j + q * 8), acc[r][q]);
+                }
+            }
+        }
+    }
+
+    /// @brief R 行 x 64 列の C をレジスタに保持し、4 画素ずつ vpdpbusd で int32 に直接積和する
+    template <int R>
+    OCR_TARGET_AVX512_VNNI void quantizedTileAvx512Vnni(int k, int np,
+                                                        const uint8_t* a, int lda,
+                                                        const int8_t* b,
+                                                        int32_t* c, int ldc)
+    {
+        constexpr int vectorCount = 4;
+        const int groups = (k + 3) / 4;
+
+        for (int j = 0; j < np; j += vectorCount * 16)
+        {
+            __m512i acc[R][vectorCount];
+            for (int r = 0; r < R; ++r)
+            {
+                for (int q = 0; q < vectorCount; ++q)
+                {
+                    acc[r][q] = _mm512_setzero_si512();
+                }
+            }
+
+            for (int g = 0; g < groups; ++g)
+            {
+                int32_t pixelGroups[R];
+                int32_t any{};
+                for (int r = 0; r < R; ++r)
+                {
+                    pixelGroups[r] = loadPixelGroup(a + r * lda, k, g);
+                    any |= pixelGroups[r];
+                }
+
+                if (any == 0) continue;
+
+                const int8_t* bg = b + (static_cast<size_t>(g) * np + j) * 4;
+                __m512i bq[vectorCount];
+                for (int q = 0; q < vectorCount; ++q)
+                {
+                    bq[q] = _mm512_loadu_si512(bg + q * 64);
+                }
+
+                for (int r = 0; r < R; ++r)
+                {
+                    const __m512i ar = _mm512_set1_epi32(pixelGroups[r]);
+                    for (int q = 0; q < vectorCount; ++q)
+                    {
+                        acc[r][q] = _mm512_dpbusd_epi32(acc[r][q], ar, bq[q]);
+                    }
+                }
+            }
+
+            for (int r = 0; r < R; ++r)
+            {
+                for (int q = 0; q < vectorCount; ++q)
+                {
+                    _mm512_storeu_si512(c + r * ldc + j + q * 16, acc[r][q]);
+                }
+            }
+        }
+    }
+
+    using QuantizedTileFunction = void (*)(int k, int np,
+                                           const uint8_t* a, int lda,
+                                           const int8_t* b,
+                                           int32_t* c, int ldc);
+
+    /// @brief A を最大 4 行ずつのタイルに分け、B の同じ列を各行で使い回す
+    void quantizedGemmTiled(int m, int k, int np,
+                            const uint8_t* a, int lda,
+                            const int8_t* b,
+                            int32_t* c, int ldc,
+                            const QuantizedTileFunction (&tiles)[5])
+    {
+        constexpr int tileM = 4;
+        for (int i = 0; i < m; i += tileM)
+        {
+            const int mr = std::min(tileM, m - i);
+            tiles[mr](k, np, a + i * lda, lda, b, c + i * ldc, ldc);
+        }
+    }
+
+    void quantizedGemmAvx2(int m, int k, int np,
+                           const uint8_t* a, int lda,
+                           const int8_t* b,
+                           int32_t* c, int ldc)
+    {
+        static constexpr QuantizedTileFunction tiles[5] = {
+            nullptr, quantizedTileAvx2<1>, quantizedTileAvx2<2>, quantizedTileAvx2<3>, quantizedTileAvx2<4>
+        };
+        quantizedGemmTiled(m, k, np, a, lda, b, c, ldc, tiles);
+    }
+
+    void quantizedGemmAvx512Vnni(int m, int k, int np,
+                                 const uint8_t* a, int lda,
+                                 const int8_t* b,
+                                 int32_t* c, int ldc)
+    {
+        static constexpr QuantizedTileFunction tiles[5] = {
+            nullptr,
+            quantizedTileAvx512Vnni<1>, quantizedTileAvx512Vnni<2>, quantizedTileAvx512Vnni<3>, quantizedTileAvx512Vnni<4>
+        };
+        quantizedGemmTiled(m, k, np, a, lda, b, c, ldc, tiles);
+    }
+#endif
+
+    QuantizedGemmFunction selectQuantizedGemmFunction(QuantizedGemmKernelType type)
+    {
+        switch (type)
+        {
+#if OCR_GEMM_X64
+        case QuantizedGemmKernelType::Avx512Vnni:
+            return quantizedGemmAvx512Vnni;
+        case QuantizedGemmKernelType::Avx2:
+            return quantizedGemmAvx2;
+#endif
+        default:
+            return quantizedGemmScalar;
+        }
+    }
+
+    // -----------------------------------------------
+
+#if OCR_GEMM_X64
+    struct CpuFeatures
+    {
+        bool avx2{};
+        bool avx512{};
+        bool avx512Vnni{};
+    };
+
+    CpuFeatures detectCpuFeatures()
+    {
+        CpuFeatures features{};
+#if defined(_MSC_VER)
+        int info[4]{};
+        __cpuid(info, 0);
+        if (info[0] < 7) return features;
+
+        __cpuid(info, 1);
+        const bool osxsave = (info[2] & (1 << 27)) != 0;
+        const bool fma = (info[2] & (1 << 12)) != 0;
+        const bool f16c = (info[2] & (1 << 29)) != 0;
+        if (not osxsave) return features;
+
+        // OS が YMM/ZMM レジスタを保存するかどうか
+        const unsigned long long xcr0 = _xgetbv(0);
+        const bool osYmm = (xcr0 & 0x6) == 0x6;
+        const bool osZmm = (xcr0 & 0xe6) == 0xe6;
+
+        __cpuidex(info, 7, 0);
+        features.avx2 = osYmm && fma && f16c && (info[1] & (1 << 5)) != 0;
+        features.avx512 = osZmm && (info[1] & (1 << 16)) != 0;
+        features.avx512Vnni = features.avx512 && (info[2] & (1 << 11)) != 0;
+#else
+        __builtin_cpu_init();
+        features.avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c");
+        features.avx512 = __builtin_cpu_supports("avx512f");
+        features.avx512Vnni = features.avx512 && __builtin_cpu_supports("avx512vnni");
+#endif
+        return features;
+    }
+#endif
+
+    GemmKernelType selectGemmKernelType()
+    {
+#if OCR_GEMM_X64
+        const CpuFeatures features = detectCpuFeatures();
+        if (features.avx512) return GemmKernelType::Avx512;
+        if (features.avx2) return GemmKernelType::Avx2;
+#endif
+        return GemmKernelType::Scalar;
+    }
+
+    QuantizedGemmKernelType selectQuantizedGemmKernelType()
+    {
+#if OCR_GEMM_X64
+        const CpuFeatures features = detectCpuFeatures();
+        if (features.avx512Vnni) return QuantizedGemmKernelType::Avx512Vnni;
+        if (features.avx2) return QuantizedGemmKernelType::Avx2;
+#endif
+        return QuantizedGemmKernelType::Scalar;
+    }
+
+    template <class TA, class TB>
+    GemmFunction<TA, TB> selectGemmFunction(GemmKernelType type)
+    {
+        switch (type)
+        {
+#if OCR_GEMM_X64
+        case GemmKernelType::Avx512:
+            return gemmAvx512<TA, TB>;
+        case GemmKernelType::Avx2:
+            return gemmAvx2<TA, TB>;
+#endif
+        default:
+            return gemmScalar<TA, TB>;
+        }
+    }
+
+    TransposedGemmFunction selectTransposedGemmFunction(GemmKernelType type)
+    {
+        switch (type)
+        {
+#if OCR_GEMM_X64
+        case GemmKernelType::Avx512:
+            return gemmAvx512Transposed;
+        case GemmKernelType::Avx2:
+            return gemmAvx2Transposed;
+#endif
+        default:
+            return gemmScalarTransposed;
+        }
+    }
+
+    template <class TA>
+    void halfGemm(int m, int n, int k,
+                  const TA* a, int lda,
+                  float scale,
+                  HalfFormat bFormat, const uint16_t* b, int ldb,
+                  float* c, int ldc)
+    {
+        if (m <= 0 || n <= 0 || k <= 0) return;
+
+        static const GemmFunction<TA, Float16Bits> float16Gemm = selectGemmFunction<TA, Float16Bits>(GetGemmKernelType());
+        static const GemmFunction<TA, BFloat16Bits> bfloat16Gemm = selectGemmFunction<TA, BFloat16Bits>(GetGemmKernelType());
+        if (bFormat == HalfFormat::Float16)
+        {
+            float16Gemm(m, n, k, a, lda, b, ldb, c, ldc, scale);
+        }
+        else
+        {
+            bfloat16Gemm(m, n, k, a, lda, b, ldb, c, ldc, scale);
+        }
+    }
+
+#if OCR_GEMM_X64
+    /// @brief F16C で 8 要素ずつ fp16 に変換する (丸めは最近接偶数)
+    OCR_TARGET_AVX2 void convertToFloat16Avx2(const float* source, size_t count, uint16_t* destination)
+    {
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            const __m128i bits = _mm256_cvtps_ph(_mm256_loadu_ps(source + i), _MM_FROUND_TO_NEAREST_INT);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + i), bits);
+        }
+
+        for (; i < count; ++i)
+        {
+            destination[i] = floatToFloat16(source[i]);
+        }
+    }
+#endif
+}
+
+namespace ocr
+{
+    GemmKernelType GetGemmKernelType()
+    {
+        static const GemmKernelType type = selectGemmKernelType();
+        return type;
+    }
+
+    const char* GemmKernelName(GemmKernelType type)
+    {
+        switch (type)
+        {
+        case GemmKernelType::Avx2:
+            return "AVX2 + FMA";
+        case GemmKernelType::Avx512:
+            return "AVX-512";
+        default:
+            return "Scalar";
+        }
+    }
+
+    void GemmKernel(int m, int n, int k,
+                    const float* a, int lda,
+                    const float* b, int ldb,
+                    float* c, int ldc)
+    {
+        if (m <= 0 || n <= 0 || k <= 0) return;
+
+        static const GemmFunction<float, float> gemm = selectGemmFunction<float, float>(GetGemmKernelType());
+        gemm(m, n, k, a, lda, b, ldb, c, ldc, 1.0f);
+    }
+
+    void GemmKernel(Transpose transA, Transpose transB,
+                    int m, int n, int k,
+                    const float* a, int lda,
+                    const float* b, int ldb,
+                    float* c, int ldc)
+    {
+        if (transA == Transpose::No && transB == Transpose::No)
+        {
+            GemmKernel(m, n, k, a, lda, b, ldb, c, ldc);
+            return;
+        }
+
+        if (m <= 0 || n <= 0 || k <= 0) return;
+
+        // 1 行のベクトル * B^T などは B を詰め直すだけで積と同じだけかかるので、A と B の行の内積で直接求める
+        if (transA == Transpose::No && m <= smallTransposedRows)
+        {
+            gemmScalarTransposed(transA, transB, m, n, k, a, lda, b, ldb, c, ldc);
+            return;
+        }
+
+        static const TransposedGemmFunction gemm = selectTransposedGemmFunction(GetGemmKernelType());
+        gemm(transA, transB, m, n, k, a, lda, b, ldb, c, ldc);
+    }
+
+    void GemmKernel(GemmKernelType type,
+                    Transpose transA, Transpose transB,
+                    int m, int n, int k,
+                    const float* a, int lda,
+                    const float* b, int ldb,
+                    float* c, int ldc)
+    {
+        if (m <= 0 || n <= 0 || k <= 0) return;
+
+        if (transA == Transpose::No && transB == Transpose::No)
+        {
+            selectGemmFunction<float, float>(type)(m, n, k, a, lda, b, ldb, c, ldc, 1.0f);
+        }
+        else if (transA == Transpose::No && m <= smallTransposedRows)
+        {
+            gemmScalarTransposed(transA, transB, m, n, k, a, lda, b, ldb, c, ldc);
+        }
+        else
+        {
+            selectTransposedGemmFunction(type)(transA, transB, m, n, k, a, lda, b, ldb, c, ldc);
+        }
+    }
+
+    void GemmKernel(int m, int n, int k,
+                    const uint8_t* a, int lda,
+                    float scale,
+                    const float* b, int ldb,
+                    float* c, int ldc)
+    {
+        if (m <= 0 || n <= 0 || k <= 0) return;
+
+        static const GemmFunction<uint8_t, float> gemm = selectGemmFunction<uint8_t, float>(GetGemmKernelType());
+        gemm(m, n, k, a, lda, b, ldb, c, ldc, scale);
+    }
+
+    void SparseGemmKernel(int m, int n,
+                          const int* offsets, const int* indices, const float* values,
+                          const float* b, int ldb,
+                          float* c, int ldc)
+    {
+        if (m <= 0 || n <= 0) return;
+
+        static const SparseGemmFunction<float> gemm = selectSparseGemmFunction<float>(GetGemmKernelType());
+        gemm(m, n, offsets, indices, values, b, ldb, c, ldc);
+    }
+
+    const char* HalfFormatName(HalfFormat format)
+    {
+        switch (format)
+        {
+        case HalfFormat::Float16:
+            return "FP16";
+        case HalfFormat::BFloat16:
+            return "BF16";
+        default:
+            return "Unknown";
+        }
+    }
+
+    void ConvertToHalf(HalfFormat format, const float* source, size_t count, uint16_t* destination)
+    {
+        if (format == HalfFormat::BFloat16)
+        {
+            // 整数演算だけなので、コンパイラのベクトル化に任せる
+            for (size_t i = 0; i < count; ++i)
+            {
+                destination[i] = floatToBFloat16(source[i]);
+            }
+
+            return;
+        }
+
+#if OCR_GEMM_X64
+        if (GetGemmKernelType() != GemmKernelType::Scalar)
+        {
+            convertToFloat16Avx2(source, count, destination);
+            return;
+        }
+#endif
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            destination[i] = floatToFloat16(source[i]);
+        }
+    }
+
+    float HalfToFloat(HalfFormat format, uint16_t value)
+    {
+        return format == HalfFormat::Float16 ? float16ToFloat(value) : bfloat16ToFloat(value);
+    }
+
+    void GemmKernel(int m, int n, int k,
+                    const float* a, int lda,
+                    HalfFormat bFormat, const uint16_t* b, int ldb,
+                    float* c, int ldc)
+    {
+        halfGemm(m, n, k, a, lda, 1.0f, bFormat, b, ldb, c, ldc);
+    }
+
+    void GemmKernel(int m, int n, int k,
+                    const uint8_t* a, int lda,
+                    float scale,
+                    HalfFormat bFormat, const uint16_t* b, int ldb,
+                    float* c, int ldc)
+    {
+        halfGemm(m, n, k, a, lda, scale, bFormat, b, ldb, c, ldc);
+    }
+
+    void SparseGemmKernel(int m, int n,
+                          const int* offsets, const int* indices, const float* values,
+                          HalfFormat bFormat, const uint16_t* b, int ldb,
+                          float* c, int ldc)
+    {
+        if (m <= 0 || n <= 0) return;
+
+        static const SparseGemmFunction<Float16Bits> float16Gemm = selectSparseGemmFunction<Float16Bits>(GetGemmKernelType());
+        static const SparseGemmFunction<BFloat16Bits> bfloat16Gemm = selectSparseGemmFunction<BFloat16Bits>(GetGemmKernelType());
+        if (bFormat == HalfFormat::Float16)
+        {
+            float16Gemm(m, n, offsets, indices, values, b, ldb, c, ldc);
+        }
+        else
+        {
+            bfloat16Gemm(m, n, offsets, indices, values, b, ldb, c, ldc);
+        }
+    }
+
+    QuantizedGemmKernelType GetQuantizedGemmKernelType()
+    {
+        static const QuantizedGemmKernelType type = selectQuantizedGemmKernelType();
+        return type;
+    }
+
+    const char* QuantizedGemmKernelName(QuantizedGemmKernelType type)
+    {
+        switch (type)
+        {
+        case QuantizedGemmKernelType::Avx2:
+            return "AVX2 maddubs";
+        case QuantizedGemmKernelType::Avx512Vnni:
+            return "AVX-512 VNNI";
+        default:
+            return "Scalar";
+        }
+    }
+
+    int QuantizedGemmPackedColumns(int n)
+    {
+        return (n + quantizedGemmColumnAlignment - 1) / quantizedGemmColumnAlignment * quantizedGemmColumnAlignment;
+    }
+
+    size_t QuantizedGemmPackedSize(int k, int n)
+    {
+        return static_cast<size_t>((k + 3) / 4) * QuantizedGemmPackedColumns(n) * 4;
+    }
+
+    void PackQuantizedGemmB(int k, int n, const int8_t* b, int ldb, int8_t* packed)
+    {
+        const int np = QuantizedGemmPackedColumns(n);
+        std::fill(packed, packed + QuantizedGemmPackedSize(k, n), int8_t{0});
+
+        for (int p = 0; p < k; ++p)
+        {
+            int8_t* group = packed + static_cast<size_t>(p / 4) * np * 4 + p % 4;
+            for (int j = 0; j < n; ++j)
+            {
+                group[j * 4] = b[p * ldb + j];
+            }
+        }
+    }
+
+    void QuantizedGemmKernel(int m, int n, int k,
+                             const uint8_t* a, int lda,
+                             const int8_t* packedB,
+                             int32_t* c, int ldc)
+    {
+        if (m <= 0 || n <= 0) return;
+
+        static const QuantizedGemmFunction gemm = selectQuantizedGemmFunction(GetQuantizedGemmKernelType());
+        gemm(m, std::max(k, 0), QuantizedGemmPackedColumns(n), a, lda, packedB, c, ldc);
+    }
+}
@@ -0,0 +1,135 @@
+﻿#pragma once
+
+namespace ocr
+{
+    enum class GemmKernelType
+    {
+        Scalar,
+        Avx2,
+        Avx512,
+    };
+
+    /// @brief 起動時に cpuid で選択された GEMM カーネルの種類
+    GemmKernelType GetGemmKernelType();
+
+    const char* GemmKernelName(GemmKernelType type);
+
+    /// @brief 行優先の行列積 C[m][n] += A[m][k] * B[k][n]
+    /// @param lda, ldb, ldc 各行列の行の先頭同士の距離 (要素数)
+    void GemmKernel(int m, int n, int k,
+                    const float* a, int lda,
+                    const float* b, int ldb,
+                    float* c, int ldc);
+
+    /// @brief GemmKernel() の A, B をそのまま読むか、転置して読むか (BLAS の op(X))
+    enum class Transpose
+    {
+        No,
+        Yes,
+    };
+
+    /// @brief 行優先の行列積 C[m][n] += op(A)[m][k] * op(B)[k][n]。転置は要素を写した行列を作らずに読み方で扱う
+    /// @param lda, ldb 格納されている (転置する前の) 行列の行の先頭同士の距離。op(A) = A^T なら A は [k][m] で lda >= m
+    /// @details 組み合わせごとにキャッシュに沿った順で読む: B^T は [k][n] のブロックに転置して詰め、
+    /// A^T は行ブロックごとに [m][k] に詰めてから、転置なしと同じレジスタタイルで計算する
+    void GemmKernel(Transpose transA, Transpose transB,
+                    int m, int n, int k,
+                    const float* a, int lda,
+                    const float* b, int ldb,
+                    float* c, int ldc);
+
+    /// @brief 起動時の選択によらず type のカーネルで C[m][n] += op(A)[m][k] * op(B)[k][n] を計算する
+    /// @note CPU が対応していない type を渡してはいけない (GetGemmKernelType() 以下の種類を使う)
+    void GemmKernel(GemmKernelType type,
+                    Transpose transA, Transpose transB,
+                    int m, int n, int k,
+                    const float* a, int lda,
+                    const float* b, int ldb,
+                    float* c, int ldc);
+
+    /// @brief uint8 の A を浮動小数に変換しながら C[m][n] += scale * A[m][k] * B[k][n] を計算する
+    /// @details 画素 (0..255) をそのまま読み、1/255 の正規化は scale として最後にまとめて掛ける
+    void GemmKernel(int m, int n, int k,
+                    const uint8_t* a, int lda,
+                    float scale,
+                    const float* b, int ldb,
+                    float* c, int ldc);
+
+    /// @brief 疎行列 A (CSR 形式) と密行列 B の積 C[m][n] += A[m][k] * B[k][n]
+    /// @param offsets A の i 行目の非ゼロ要素は [offsets[i], offsets[i + 1]) 番目
+    /// @param indices, values 非ゼロ要素の列番号 (B の行番号) と値
+    void SparseGemmKernel(int m, int n,
+                          const int* offsets, const int* indices, const float* values,
+                          const float* b, int ldb,
+                          float* c, int ldc);
+
+    /// @brief 重みを 16 ビットで持つときの形式
+    enum class HalfFormat
+    {
+        Float16, // IEEE 754 の binary16 (指数 5 ビット、仮数 10 ビット)
+        BFloat16, // float の上位 16 ビット (指数 8 ビット、仮数 7 ビット)
+    };
+
+    const char* HalfFormatName(HalfFormat format);
+
+    /// @brief float の配列を最近接偶数への丸めで半精度のビット列にする
+    void ConvertToHalf(HalfFormat format, const float* source, size_t count, uint16_t* destination);
+
+    float HalfToFloat(HalfFormat format, uint16_t value);
+
+    /// @brief 半精度の B を読み込みながら float に変換し、C[m][n] += A[m][k] * B[k][n] を float で積和する
+    /// @details B の読み込み量が半分になる。変換は AVX2 では F16C (fp16) / 16 ビットシフト (bf16) で行う
+    void GemmKernel(int m, int n, int k,
+                    const float* a, int lda,
+                    HalfFormat bFormat, const uint16_t* b, int ldb,
+                    float* c, int ldc);
+
+    /// @brief uint8 の A と半精度の B から C[m][n] += scale * A[m][k] * B[k][n] を float で計算する
+    void GemmKernel(int m, int n, int k,
+                    const uint8_t* a, int lda,
+                    float scale,
+                    HalfFormat bFormat, const uint16_t* b, int ldb,
+                    float* c, int ldc);
+
+    /// @brief 疎行列 A (CSR 形式) と半精度の密行列 B の積 C[m][n] += A[m][k] * B[k][n]
+    void SparseGemmKernel(int m, int n,
+                          const int* offsets, const int* indices, const float* values,
+                          HalfFormat bFormat, const uint16_t* b, int ldb,
+                          float* c, int ldc);
+
+    enum class QuantizedGemmKernelType
+    {
+        Scalar,
+        Avx2,
+        Avx512Vnni,
+    };
+
+    /// @brief 起動時に cpuid で選択された量子化 GEMM カーネルの種類
+    QuantizedGemmKernelType GetQuantizedGemmKernelType();
+
+    const char* QuantizedGemmKernelName(QuantizedGemmKernelType type);
+
+    /// @brief QuantizedGemmKernel の B の列数はこの倍数に切り上げて詰める
+    constexpr int quantizedGemmColumnAlignment = 64;
+
+    /// @brief AVX2 の maddubs は 2 組の積和を int16 で飽和させるので、B の値はこの範囲 (255 * 63 * 2 < 32768) に収める
+    constexpr int quantizedGemmWeightLimit = 63;
+
+    /// @brief n を quantizedGemmColumnAlignment の倍数に切り上げた列数
+    int QuantizedGemmPackedColumns(int n);
+
+    /// @brief PackQuantizedGemmB() が書き込む要素数
+    size_t QuantizedGemmPackedSize(int k, int n);
+
+    /// @brief int8 の B[k][n] を [(k + 3) / 4][QuantizedGemmPackedColumns(n)][4] の順に詰める (余る部分は 0)
+    /// @details 4 つの連続した k を 1 つの 32 ビットにまとめ、vpdpbusd / maddubs がそのまま読めるようにする
+    void PackQuantizedGemmB(int k, int n, const int8_t* b, int ldb, int8_t* packed);
+
+    /// @brief uint8 の A と int8 の B から C[m][n] = A[m][k] * B[k][n] を int32 で計算する
+    /// @param packedB PackQuantizedGemmB() で詰めた B (値は ±quantizedGemmWeightLimit 以内)
+    /// @param c 各行に QuantizedGemmPackedColumns(n) 列を上書きする (ldc はそれ以上であること)
+    void QuantizedGemmKernel(int m, int n, int k,
+                             const uint8_t* a, int lda,
+                             const int8_t* packedB,
+                             int32_t* c, int ldc);
+}
@@ -0,0 +1,119 @@
+﻿#include "pch.h"
+#include "Gradient.h"
+
+#include "PhaseProfiler.h"
+
+using namespace ocr;
+
+namespace
+{
+    void addInPlace(Array<float>& a, const Array<float>& b)
+    {
+        assert(a.size() == b.size());
+
+        for (size_t i = 0; i < a.size(); ++i)
+        {
+            a[i] += b[i];
+        }
+    }
+
+    void subtractScaledInPlace(Array<float>& a, const Array<float>& b, float scale)
+    {
+        assert(a.size() == b.size());
+
+        for (size_t i = 0; i < a.size(); ++i)
+        {
+            a[i] -= scale * b[i];
+        }
+    }
+
+    /// @brief a += b。並べ方が同じなら行の末尾の隙間ごと 1 回のループで、違えば行ごとに足す
+    void addInPlace(Matrix& a, const Matrix& b)
+    {
+        assert(a.rows() == b.rows() && a.cols() == b.cols());
+
+        const bool sameLayout = a.hasSameLayout(b);
+        const int rows = sameLayout ? 1 : a.rows();
+        const size_t count = sameLayout ? a.data().size() : a.cols();
+        for (int i = 0; i < rows; ++i)
+        {
+            float* ai = a[i];
+            const float* bi = b[i];
+            for (size_t j = 0; j < count; ++j)
+            {
+                ai[j] += bi[j];
+            }
+        }
+    }
+
+    void subtractScaledInPlace(Matrix& a, const Matrix& b, float scale)
+    {
+        assert(a.rows() == b.rows() && a.cols() == b.cols());
+
+        const bool sameLayout = a.hasSameLayout(b);
+        const int rows = sameLayout ? 1 : a.rows();
+        const size_t count = sameLayout ? a.data().size() : a.cols();
+        for (int i = 0; i < rows; ++i)
+        {
+            float* ai = a[i];
+            const float* bi = b[i];
+            for (size_t j = 0; j < count; ++j)
+            {
+                ai[j] -= scale * bi[j];
+            }
+        }
+    }
+}
+
+namespace ocr
+{
+    NeuralNetworkParameters MakeZeroGradient(const NeuralNetworkParameters& params)
+    {
+        NeuralNetworkParameters gradient{};
+        gradient.w1 = Matrix(params.w1.rows(), params.w1.cols(), params.w1.layout());
+        gradient.b1 = Array<float>(params.b1.size());
+        gradient.w2 = Matrix(params.w2.rows(), params.w2.cols(), params.w2.layout());
+        gradient.b2 = Array<float>(params.b2.size());
+        return gradient;
+    }
+
+    void ZeroGradients(NeuralNetworkParameters& gradient)
+    {
+        std::fill(gradient.w1.data().begin(), gradient.w1.data().end(), 0.0f);
+        std::fill(gradient.b1.begin(), gradient.b1.end(), 0.0f);
+        std::fill(gradient.w2.data().begin(), gradient.w2.data().end(), 0.0f);
+        std::fill(gradient.b2.begin(), gradient.b2.end(), 0.0f);
+    }
+
+    void AccumulateGradients(NeuralNetworkParameters& gradient, const BackPropagationOutput& bp)
+    {
+        OCR_PROFILE_SCOPE(AccumulateGradients);
+
+        // Accumulate gradients for weights and biases
+        addInPlace(gradient.w1, bp.dw1);
+        addInPlace(gradient.b1, bp.db1);
+        addInPlace(gradient.w2, bp.dw2);
+        addInPlace(gradient.b2, bp.db2);
+    }
+
+    void AddGradients(NeuralNetworkParameters& gradient, const NeuralNetworkParameters& other)
+    {
+        OCR_PROFILE_SCOPE(AccumulateGradients);
+
+        addInPlace(gradient.w1, other.w1);
+        addInPlace(gradient.b1, other.b1);
+        addInPlace(gradient.w2, other.w2);
+        addInPlace(gradient.b2, other.b2);
+    }
+
+    void ApplyGradients(NeuralNetworkParameters& params, const NeuralNetworkParameters& gradient, float learningRate)
+    {
+        OCR_PROFILE_SCOPE(UpdateParameters);
+
+        // Update weights and biases using the gradients from backpropagation
+        subtractScaledInPlace(params.w1, gradient.w1, learningRate);
+        subtractScaledInPlace(params.b1, gradient.b1, learningRate);
+        subtractScaledInPlace(params.w2, gradient.w2, learningRate);
+        subtractScaledInPlace(params.b2, gradient.b2, learningRate);
+    }
+}
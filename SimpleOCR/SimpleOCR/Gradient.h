@@ -0,0 +1,21 @@
+﻿#pragma once
+#include "BackPropagation.h"
+#include "NeuralNetwork.h"
+
+namespace ocr
+{
+    /// @brief params と同じ形と並べ方 (MatrixLayout) の、ゼロで初期化された勾配
+    NeuralNetworkParameters MakeZeroGradient(const NeuralNetworkParameters& params);
+
+    /// @brief 確保済みの勾配をゼロに戻す (バッチごとに作り直さずに使い回す)
+    void ZeroGradients(NeuralNetworkParameters& gradient);
+
+    /// @brief 逆伝搬の結果を勾配に加算する
+    void AccumulateGradients(NeuralNetworkParameters& gradient, const BackPropagationOutput& bp);
+
+    /// @brief 別の勾配を加算する (スレッドごとの勾配の集約用)
+    void AddGradients(NeuralNetworkParameters& gradient, const NeuralNetworkParameters& other);
+
+    /// @brief 勾配降下法でパラメータを更新する
+    void ApplyGradients(NeuralNetworkParameters& params, const NeuralNetworkParameters& gradient, float learningRate);
+}
@@ -0,0 +1,186 @@
+﻿#include "pch.h"
+#include "HalfNeuralNetwork.h"
+
+using namespace ocr;
+
+namespace
+{
+    constexpr float pixelScale = 1.0f / 255.0f;
+
+    template <class F>
+    double measureSeconds(F&& f)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        f();
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count();
+    }
+
+    /// @brief images をバッチに分けて順伝搬し、バッチごとの出力を残す
+    template <class Forward>
+    void forwardAll(const DatasetImageList& images, int batchSize, Array<BatchNeuralNetworkOutput>& outputs, const Forward& forward)
+    {
+        outputs.clear();
+        for (size_t first = 0; first < images.size(); first += batchSize)
+        {
+            const size_t count = std::min(static_cast<size_t>(batchSize), images.size() - first);
+            outputs.push_back(forward(images.batch(first, count)));
+        }
+    }
+}
+
+namespace ocr
+{
+    void ConvertToHalfMatrix(const Matrix& matrix, HalfFormat format, HalfMatrix& half)
+    {
+        half.format = format;
+        half.rows = matrix.rows();
+        half.cols = matrix.cols();
+        half.data.resize(static_cast<size_t>(matrix.rows()) * matrix.cols());
+        UpdateHalfMatrixRows(matrix, 0, matrix.rows(), half);
+    }
+
+    void UpdateHalfMatrixRows(const Matrix& matrix, int firstRow, int rowCount, HalfMatrix& half)
+    {
+        assert(half.rows == matrix.rows() && half.cols == matrix.cols());
+        assert(firstRow >= 0 && firstRow + rowCount <= matrix.rows());
+
+        if (matrix.isContiguous())
+        {
+            const size_t offset = static_cast<size_t>(firstRow) * matrix.cols();
+            ConvertToHalf(half.format, matrix[firstRow], static_cast<size_t>(rowCount) * matrix.cols(), half.data.data() + offset);
+            return;
+        }
+
+        // 半精度の行列は隙間なく並べるので、行の末尾の隙間を飛ばして 1 行ずつ変換する
+        for (int i = firstRow; i < firstRow + rowCount; ++i)
+        {
+            ConvertToHalf(half.format, matrix[i], matrix.cols(), half.data.data() + static_cast<size_t>(i) * half.cols);
+        }
+    }
+
+    HalfNeuralNetworkParameters MakeHalfNeuralNetwork(const NeuralNetworkParameters& params, HalfFormat format)
+    {
+        HalfNeuralNetworkParameters half{
+            .b1 = params.b1,
+            .w2 = params.w2,
+            .b2 = params.b2
+        };
+
+        ConvertToHalfMatrix(params.w1, format, half.w1);
+        return half;
+    }
+
+    BatchNeuralNetworkOutput HalfBatchNeuralNetwork(const PixelBatch& x, const HalfNeuralNetworkParameters& params)
+    {
+        BatchNeuralNetworkOutput output{};
+        HalfBatchNeuralNetwork(x, params, output);
+        return output;
+    }
+
+    void HalfBatchNeuralNetwork(const PixelBatch& x,
+                                const HalfNeuralNetworkParameters& params,
+                                BatchNeuralNetworkOutput& output)
+    {
+        if (x.cols != params.w1.rows)
+        {
+            throw std::invalid_argument("Pixel count does not match the half-precision network.");
+        }
+
+        // ----------------------------------------------- 入力層 --> 中間層 (w1 は読み込み時に float へ変換)
+
+        const int midCount = params.w1.cols;
+        output.y1.resize(x.rows, midCount);
+        for (int i = 0; i < x.rows; ++i)
+        {
+            std::copy(params.b1.begin(), params.b1.end(), output.y1[i]);
+        }
+
+        // A1 = (X / 255) * W1 + b1
+        GemmKernel(x.rows, midCount, x.cols,
+                   x.pixels, x.cols,
+                   pixelScale,
+                   params.w1.format, params.w1[0], midCount,
+                   output.y1[0], midCount);
+
+        // ----------------------------------------------- 中間層 --> 出力層 (float)
+
+        BatchNeuralNetworkFromA1(output, params.w2, params.b2);
+    }
+
+    HalfPrecisionReport CompareHalfPrecisionInference(const DatasetImageList& images,
+                                                      const Array<uint8_t>& labels,
+                                                      const NeuralNetworkParameters& params,
+                                                      int batchSize)
+    {
+        HalfPrecisionReport report{
+            .sampleCount = static_cast<int>(images.size()),
+            .fp32W1Bytes = params.w1.data().size() * sizeof(float)
+        };
+
+        // float の出力を基準として残しておき、各形式の速度の計測が終わってから比べる
+        Array<BatchNeuralNetworkOutput> fp32Outputs{};
+        const double fp32Seconds = measureSeconds([&]
+        {
+            forwardAll(images, batchSize, fp32Outputs, [&](const PixelBatch& x) { return BatchNeuralNetwork(x, params); });
+        });
+
+        report.fp32SamplesPerSecond = report.sampleCount / fp32Seconds;
+
+        const auto countCorrect = [&](const Array<BatchNeuralNetworkOutput>& outputs)
+        {
+            int correct{};
+            const int batchCount = static_cast<int>(outputs.size());
+            for (int batch = 0; batch < batchCount; ++batch)
+            {
+                for (int i = 0; i < outputs[batch].y2.rows(); ++i)
+                {
+                    if (outputs[batch].maxIndex(i) == labels[static_cast<size_t>(batch) * batchSize + i]) correct++;
+                }
+            }
+
+            return correct;
+        };
+
+        report.fp32Accuracy = static_cast<float>(countCorrect(fp32Outputs)) / report.sampleCount;
+
+        const int batchCount = static_cast<int>(fp32Outputs.size());
+
+        constexpr HalfFormat formats[] = {HalfFormat::Float16, HalfFormat::BFloat16};
+        for (size_t f = 0; f < std::size(formats); ++f)
+        {
+            const HalfNeuralNetworkParameters half = MakeHalfNeuralNetwork(params, formats[f]);
+
+            Array<BatchNeuralNetworkOutput> halfOutputs{};
+            const double halfSeconds = measureSeconds([&]
+            {
+                forwardAll(images, batchSize, halfOutputs, [&](const PixelBatch& x) { return HalfBatchNeuralNetwork(x, half); });
+            });
+
+            HalfPrecisionResult& result = report.results[f];
+            result = HalfPrecisionResult{
+                .format = formats[f],
+                .accuracy = static_cast<float>(countCorrect(halfOutputs)) / report.sampleCount,
+                .samplesPerSecond = report.sampleCount / halfSeconds,
+                .w1Bytes = half.w1.data.size() * sizeof(uint16_t)
+            };
+
+            for (int batch = 0; batch < batchCount; ++batch)
+            {
+                const BatchNeuralNetworkOutput& fp32 = fp32Outputs[batch];
+                const BatchNeuralNetworkOutput& output = halfOutputs[batch];
+                for (int i = 0; i < fp32.y2.rows(); ++i)
+                {
+                    if (fp32.maxIndex(i) != output.maxIndex(i)) result.disagreementCount++;
+
+                    for (int j = 0; j < fp32.y2.cols(); ++j)
+                    {
+                        result.maxProbabilityError = std::max(result.maxProbabilityError, std::abs(fp32.y2[i][j] - output.y2[i][j]));
+                    }
+                }
+            }
+        }
+
+        return report;
+    }
+}
@@ -0,0 +1,90 @@
+﻿#pragma once
+#include "DatasetImage.h"
+#include "GemmKernel.h"
+#include "NeuralNetwork.h"
+
+namespace ocr
+{
+    /// @brief 行優先の行列を半精度 (fp16 / bf16) のビット列で持つ
+    /// @details 学習では float の Matrix をマスターとして更新し、読み込み専用のこの行列を変換し直す
+    struct HalfMatrix
+    {
+        HalfFormat format{};
+
+        int rows{};
+
+        int cols{};
+
+        Array<uint16_t> data{};
+
+        const uint16_t* operator[](int index) const
+        {
+            return data.data() + static_cast<size_t>(index) * cols;
+        }
+    };
+
+    /// @brief matrix を format の半精度に変換して half に書き込む (形が同じなら再確保しない)
+    void ConvertToHalfMatrix(const Matrix& matrix, HalfFormat format, HalfMatrix& half);
+
+    /// @brief matrix の [firstRow, firstRow + rowCount) 行だけを half に変換し直す (形は同じであること)
+    void UpdateHalfMatrixRows(const Matrix& matrix, int firstRow, int rowCount, HalfMatrix& half);
+
+    /// @brief 第 1 層の重みを半精度で持つパラメータ
+    /// @details 読み込み量の大半を占める w1 だけを 16 ビットにし、積和は float で行う。小さい w2 とバイアスは float のまま持つ
+    struct HalfNeuralNetworkParameters
+    {
+        HalfMatrix w1{}; // [入力ノード数][中間ノード数]
+
+        Array<float> b1{}; // [中間ノード数]
+
+        Matrix w2{}; // [中間ノード数][出力ノード数]
+
+        Array<float> b2{}; // [出力ノード数]
+    };
+
+    HalfNeuralNetworkParameters MakeHalfNeuralNetwork(const NeuralNetworkParameters& params, HalfFormat format);
+
+    /// @brief uint8 の画素と半精度の w1 を読み、float で積和して順伝搬する
+    BatchNeuralNetworkOutput HalfBatchNeuralNetwork(const PixelBatch& x, const HalfNeuralNetworkParameters& params);
+
+    /// @brief HalfBatchNeuralNetwork() の結果を output に書き込む (形が同じなら再確保しない)
+    void HalfBatchNeuralNetwork(const PixelBatch& x,
+                                const HalfNeuralNetworkParameters& params,
+                                BatchNeuralNetworkOutput& output);
+
+    struct HalfPrecisionResult
+    {
+        HalfFormat format{};
+
+        float accuracy{};
+
+        /// @brief 予測したラベルが float の推論と異なる画像の数
+        int disagreementCount{};
+
+        /// @brief 出力の確率の差の絶対値の最大値
+        float maxProbabilityError{};
+
+        double samplesPerSecond{};
+
+        size_t w1Bytes{};
+    };
+
+    struct HalfPrecisionReport
+    {
+        int sampleCount{};
+
+        float fp32Accuracy{};
+
+        double fp32SamplesPerSecond{};
+
+        size_t fp32W1Bytes{};
+
+        std::array<HalfPrecisionResult, 2> results{}; // FP16, BF16 の順
+    };
+
+    /// @brief 同じ画像を float, fp16, bf16 の w1 で推論し、正解率と速度の差を調べる
+    HalfPrecisionReport CompareHalfPrecisionInference(const DatasetImageList& images,
+                                                      const Array<uint8_t>& labels,
+                                                      const NeuralNetworkParameters& params,
+                                                      int batchSize);
+}
@@ -0,0 +1,217 @@
+﻿#include "pch.h"
+#include "HogwildTrainer.h"
+
+#include "ThreadPool.h"
+#include "TY/Random.h"
+
+using namespace ocr;
+
+namespace
+{
+    /// @brief スレッドごとに使い回す作業領域
+    struct HogwildWorkspace
+    {
+        Array<float> x{};
+
+        Array<int> activeRows{}; // x が 0 でない入力ノード
+
+        Array<float> y1{};
+
+        Array<float> y2{};
+
+        Array<float> da1{};
+
+        Array<float> da2{};
+
+        double loss{};
+    };
+
+    // 以下の関数は他のスレッドと同時に params を読み書きする。
+    // Hogwild! は更新の競合を許容するアルゴリズムなので、ロックやアトミック操作を意図的に使わない。
+    // x64 ではアラインされた float の読み書きは分断されないため、値が壊れることはない。
+
+    float hogwildStep(NeuralNetworkParameters& params,
+                      const DatasetImage& image,
+                      int trueLabel,
+                      float learningRate,
+                      HogwildWorkspace& ws)
+    {
+        const int midCount = params.w1.cols();
+        const int outCount = params.w2.cols();
+
+        ws.activeRows.clear();
+        const int pixelCount = static_cast<int>(image.size());
+        for (int i = 0; i < pixelCount; ++i)
+        {
+            ws.x[i] = static_cast<float>(image[i]) / 255.0f;
+            if (image[i] != 0) ws.activeRows.push_back(i);
+        }
+
+        // ----------------------------------------------- 順伝搬
+
+        std::copy(params.b1.begin(), params.b1.end(), ws.y1.begin());
+        for (const int i : ws.activeRows)
+        {
+            const float xi = ws.x[i];
+            const float* w1 = params.w1[i];
+            for (int j = 0; j < midCount; ++j)
+            {
+                ws.y1[j] += xi * w1[j];
+            }
+        }
+
+        for (auto& y : ws.y1)
+        {
+            y = 1.0f / (1.0f + std::expf(-y));
+        }
+
+        std::copy(params.b2.begin(), params.b2.end(), ws.y2.begin());
+        for (int i = 0; i < midCount; ++i)
+        {
+            const float* w2 = params.w2[i];
+            for (int j = 0; j < outCount; ++j)
+            {
+                ws.y2[j] += ws.y1[i] * w2[j];
+            }
+        }
+
+        const float alpha = *std::max_element(ws.y2.begin(), ws.y2.end());
+        float sum{};
+        for (auto& y : ws.y2)
+        {
+            y = std::expf(y - alpha);
+            sum += y;
+        }
+
+        for (auto& y : ws.y2)
+        {
+            y /= sum;
+        }
+
+        const float loss = -std::logf(ws.y2[trueLabel] + 1e-7f);
+
+        // ----------------------------------------------- 逆伝搬
+
+        for (int j = 0; j < outCount; ++j)
+        {
+            ws.da2[j] = ws.y2[j] - (j == trueLabel ? 1.0f : 0.0f);
+        }
+
+        for (int i = 0; i < midCount; ++i)
+        {
+            const float* w2 = params.w2[i];
+            float dy1{};
+            for (int j = 0; j < outCount; ++j)
+            {
+                dy1 += ws.da2[j] * w2[j];
+            }
+
+            ws.da1[i] = dy1 * ws.y1[i] * (1.0f - ws.y1[i]);
+        }
+
+        // ----------------------------------------------- 共有パラメータを直接更新
+
+        for (int i = 0; i < midCount; ++i)
+        {
+            float* w2 = params.w2[i];
+            const float scale = learningRate * ws.y1[i];
+            for (int j = 0; j < outCount; ++j)
+            {
+                w2[j] -= scale * ws.da2[j];
+            }
+        }
+
+        for (int j = 0; j < outCount; ++j)
+        {
+            params.b2[j] -= learningRate * ws.da2[j];
+        }
+
+        for (const int i : ws.activeRows)
+        {
+            float* w1 = params.w1[i];
+            const float scale = learningRate * ws.x[i];
+            for (int j = 0; j < midCount; ++j)
+            {
+                w1[j] -= scale * ws.da1[j];
+            }
+        }
+
+        for (int j = 0; j < midCount; ++j)
+        {
+            params.b1[j] -= learningRate * ws.da1[j];
+        }
+
+        return loss;
+    }
+}
+
+namespace ocr
+{
+    Array<TrainingProgress> HogwildTraining(NeuralNetworkParameters& params,
+                                            const DatasetImageList& images,
+                                            const Array<uint8_t>& labels,
+                                            const HogwildSettings& settings,
+                                            const AccuracyFunction& evaluate)
+    {
+        const int threadCount = std::max(1, settings.threadCount);
+        ThreadPool pool{threadCount};
+
+        Array<HogwildWorkspace> workspaces(threadCount);
+        for (auto& ws : workspaces)
+        {
+            ws.x.resize(params.w1.rows());
+            ws.y1.resize(params.w1.cols());
+            ws.y2.resize(params.w2.cols());
+            ws.da1.resize(params.w1.cols());
+            ws.da2.resize(params.w2.cols());
+        }
+
+        Array<int> indices(images.size());
+        std::iota(indices.begin(), indices.end(), 0);
+
+        Array<TrainingProgress> progress{};
+        double elapsedSeconds{};
+        for (int epoch = 0; epoch < settings.epochCount; ++epoch)
+        {
+            Random::Shuffle(indices);
+
+            const auto start = std::chrono::steady_clock::now();
+
+            // 共有の添字列から各スレッドが早い者勝ちでサンプルを取り出す
+            const int sampleCount = static_cast<int>(indices.size());
+            std::atomic<int> nextIndex{};
+            pool.parallelFor(threadCount, [&](int worker)
+            {
+                HogwildWorkspace& ws = workspaces[worker];
+                ws.loss = 0.0;
+
+                int i;
+                while ((i = nextIndex.fetch_add(1, std::memory_order_relaxed)) < sampleCount)
+                {
+                    const int imageIndex = indices[i];
+                    ws.loss += hogwildStep(
+                        params, images[imageIndex], labels[imageIndex], settings.learningRate, ws);
+                }
+            });
+
+            const std::chrono::duration<double> epochSeconds = std::chrono::steady_clock::now() - start;
+            elapsedSeconds += epochSeconds.count();
+
+            double totalLoss{};
+            for (const auto& ws : workspaces)
+            {
+                totalLoss += ws.loss;
+            }
+
+            progress.push_back(TrainingProgress{
+                .epoch = epoch + 1,
+                .elapsedSeconds = elapsedSeconds,
+                .samplesPerSecond = indices.size() / epochSeconds.count(),
+                .averageLoss = static_cast<float>(totalLoss / indices.size()),
+                .accuracy = evaluate ? evaluate(params) : 0.0f
+            });
+        }
+
+        return progress;
+    }
+}
@@ -0,0 +1,42 @@
+﻿#pragma once
+#include "DatasetImage.h"
+#include "NeuralNetwork.h"
+
+namespace ocr
+{
+    struct HogwildSettings
+    {
+        int threadCount;
+
+        /// @brief 1 サンプルごとの更新に使う学習率
+        float learningRate;
+
+        int epochCount;
+    };
+
+    struct TrainingProgress
+    {
+        int epoch;
+
+        /// @brief 学習開始からの経過時間 (評価にかかった時間は含まない)
+        double elapsedSeconds;
+
+        double samplesPerSecond;
+
+        float averageLoss;
+
+        float accuracy;
+    };
+
+    using AccuracyFunction = std::function<float(const NeuralNetworkParameters& params)>;
+
+    /// @brief Hogwild! 方式の非同期 SGD で学習する (CPU のみ)
+    /// @details 各スレッドはシャッフルされた添字列から 1 サンプルずつ取り出し、ロックを取らずに params を直接更新する。
+    /// w1 は入力画素が 0 でない行だけを更新する。
+    /// @param evaluate エポックごとに呼ばれ、その時点の正解率を返す
+    Array<TrainingProgress> HogwildTraining(NeuralNetworkParameters& params,
+                                            const DatasetImageList& images,
+                                            const Array<uint8_t>& labels,
+                                            const HogwildSettings& settings,
+                                            const AccuracyFunction& evaluate);
+}
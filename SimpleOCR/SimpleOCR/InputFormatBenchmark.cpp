@@ -0,0 +1,190 @@
+﻿#include "pch.h"
+#include "InputFormatBenchmark.h"
+
+#include "GemmKernel.h"
+#include "NormalizedImages.h"
+#include "NP.h"
+#include "TY/Random.h"
+
+using namespace ocr;
+
+namespace
+{
+    constexpr float pixelScale = 1.0f / 255.0f;
+
+    /// @brief batch(i) を batchCount 回呼び、1 秒あたりのサンプル数を返す
+    template <class F>
+    double measureSamplesPerSecond(int batchCount, int batchSize, F&& batch)
+    {
+        // ウォームアップ: キャッシュと作業領域の準備を計測から外す
+        batch(0);
+
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < batchCount; ++i)
+        {
+            batch(i);
+        }
+
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        return static_cast<double>(batchCount) * batchSize / elapsed.count();
+    }
+
+    void convertRow(const DatasetImage& image, float* row)
+    {
+        std::transform(image.begin(), image.end(), row, [](uint8_t pixel)
+        {
+            return static_cast<float>(pixel) / 255.0f;
+        });
+    }
+
+    /// @brief float の入力 x から A1 = X * W1 と dW1 = X^T * dA1 を求める
+    void firstLayerTraining(const Matrix& x, const Matrix& da1, const NeuralNetworkParameters& params,
+                            Matrix& a1, Matrix& dw1)
+    {
+        std::fill(a1.data().begin(), a1.data().end(), 0.0f);
+        NP::GEMM(x, params.w1, a1);
+
+        std::fill(dw1.data().begin(), dw1.data().end(), 0.0f);
+        NP::GEMM(x.transposedView(), da1, dw1);
+    }
+}
+
+namespace ocr
+{
+    const char* InputFormatName(InputFormat format)
+    {
+        switch (format)
+        {
+        case InputFormat::ConvertOnAccess:
+            return "Convert on Access";
+        case InputFormat::NormalizedCache:
+            return "Normalized Cache";
+        case InputFormat::Uint8Kernel:
+            return "Uint8 Kernel";
+        default:
+            return "Unknown";
+        }
+    }
+
+    InputFormatBenchmarkResult BenchmarkInputFormats(const DatasetImageList& images,
+                                                     const NeuralNetworkParameters& params,
+                                                     int batchSize,
+                                                     int batchCount)
+    {
+        const int pixelCount = images.property().pixelCount();
+        const int midCount = params.w1.cols();
+
+        batchCount = std::min(batchCount, static_cast<int>(images.size()) / batchSize);
+        if (batchCount <= 0)
+        {
+            throw std::invalid_argument("Not enough images for a single batch.");
+        }
+
+        InputFormatBenchmarkResult result{};
+
+        const auto buildStart = std::chrono::steady_clock::now();
+        const Matrix cache = NormalizeImages(images);
+        const std::chrono::duration<double> buildSeconds = std::chrono::steady_clock::now() - buildStart;
+        result.cacheBuildSeconds = buildSeconds.count();
+        result.cacheBytes = cache.data().size_in_bytes();
+
+        Array<int> indices(images.size());
+        std::iota(indices.begin(), indices.end(), 0);
+        Random::Shuffle(indices);
+
+        // 逆伝搬で第 1 層に届く誤差の代わり (値は計測に影響しない)
+        Matrix da1(batchSize, midCount);
+        da1.data() = da1.data().map([](float) { return Random::Float(-1.0f, 1.0f); });
+
+        Matrix x(batchSize, pixelCount);
+        Matrix a1(batchSize, midCount);
+        Matrix dw1(pixelCount, midCount);
+        Array<uint8_t> pixels(batchSize * pixelCount);
+        Array<uint8_t> transposedPixels(pixelCount * batchSize);
+
+        const auto trainingBatch = [&](InputFormat format, int batch)
+        {
+            const int baseIndex = batch * batchSize;
+            switch (format)
+            {
+            case InputFormat::ConvertOnAccess:
+                for (int i = 0; i < batchSize; ++i)
+                {
+                    convertRow(images[indices[baseIndex + i]], x[i]);
+                }
+
+                firstLayerTraining(x, da1, params, a1, dw1);
+                break;
+
+            case InputFormat::NormalizedCache:
+                GatherRows(cache, indices, baseIndex, x);
+                firstLayerTraining(x, da1, params, a1, dw1);
+                break;
+
+            case InputFormat::Uint8Kernel:
+                // uint8 のまま行を集め、dW1 用に転置したものも uint8 で作る
+                for (int i = 0; i < batchSize; ++i)
+                {
+                    const DatasetImage image = images[indices[baseIndex + i]];
+                    std::copy(image.begin(), image.end(), &pixels[i * pixelCount]);
+                    for (int j = 0; j < pixelCount; ++j)
+                    {
+                        transposedPixels[j * batchSize + i] = image[j];
+                    }
+                }
+
+                std::fill(a1.data().begin(), a1.data().end(), 0.0f);
+                GemmKernel(batchSize, midCount, pixelCount,
+                           pixels.data(), pixelCount, pixelScale,
+                           params.w1[0], params.w1.stride(), a1[0], midCount);
+
+                std::fill(dw1.data().begin(), dw1.data().end(), 0.0f);
+                GemmKernel(pixelCount, midCount, batchSize,
+                           transposedPixels.data(), batchSize, pixelScale,
+                           da1[0], midCount, dw1[0], midCount);
+                break;
+            }
+        };
+
+        const auto evaluationBatch = [&](InputFormat format, int batch)
+        {
+            const int firstIndex = batch * batchSize;
+            std::fill(a1.data().begin(), a1.data().end(), 0.0f);
+            switch (format)
+            {
+            case InputFormat::ConvertOnAccess:
+                for (int i = 0; i < batchSize; ++i)
+                {
+                    convertRow(images[firstIndex + i], x[i]);
+                }
+
+                NP::GEMM(x, params.w1, a1);
+                break;
+
+            case InputFormat::NormalizedCache:
+                // 評価は連続した行を読むだけなので、キャッシュを直接参照する
+                GemmKernel(batchSize, midCount, pixelCount,
+                           cache[firstIndex], pixelCount,
+                           params.w1[0], params.w1.stride(), a1[0], midCount);
+                break;
+
+            case InputFormat::Uint8Kernel:
+                NP::GEMM(images.batch(firstIndex, batchSize), pixelScale, params.w1, a1);
+                break;
+            }
+        };
+
+        for (const InputFormat format : {InputFormat::ConvertOnAccess, InputFormat::NormalizedCache, InputFormat::Uint8Kernel})
+        {
+            result.timings.push_back(InputFormatTiming{
+                .format = format,
+                .trainingSamplesPerSecond = measureSamplesPerSecond(
+                    batchCount, batchSize, [&](int batch) { trainingBatch(format, batch); }),
+                .evaluationSamplesPerSecond = measureSamplesPerSecond(
+                    batchCount, batchSize, [&](int batch) { evaluationBatch(format, batch); })
+            });
+        }
+
+        return result;
+    }
+}
@@ -0,0 +1,48 @@
+﻿#pragma once
+#include "DatasetImage.h"
+#include "NeuralNetwork.h"
+
+namespace ocr
+{
+    enum class InputFormat
+    {
+        /// @brief アクセスのたびに uint8 から float に変換する (従来の makeImageInput)
+        ConvertOnAccess,
+
+        /// @brief NormalizeImages() で作った正規化済みの行列から行をコピーする
+        NormalizedCache,
+
+        /// @brief uint8 の画素を第 1 層の GEMM で直接読む
+        Uint8Kernel,
+    };
+
+    const char* InputFormatName(InputFormat format);
+
+    struct InputFormatTiming
+    {
+        InputFormat format;
+
+        double trainingSamplesPerSecond;
+
+        double evaluationSamplesPerSecond;
+    };
+
+    struct InputFormatBenchmarkResult
+    {
+        Array<InputFormatTiming> timings;
+
+        /// @brief NormalizeImages() にかかった時間 (計測には含めない)
+        double cacheBuildSeconds;
+
+        size_t cacheBytes;
+    };
+
+    /// @brief 入力の持ち方ごとに、入力を読む処理 (第 1 層の順伝搬と dW1 = X^T * dA1) のスループットを測る
+    /// @details 学習はシャッフルした添字でミニバッチを集め、順伝搬と dW1 を計算する。
+    /// 評価は先頭から順に連続したバッチの順伝搬だけを計算する。
+    /// 第 2 層以降は入力の持ち方によらず同じなので計測から外す。
+    InputFormatBenchmarkResult BenchmarkInputFormats(const DatasetImageList& images,
+                                                     const NeuralNetworkParameters& params,
+                                                     int batchSize,
+                                                     int batchCount = 100);
+}
@@ -0,0 +1,92 @@
+﻿#include "pch.h"
+#include "LinearAlgebraBackend.h"
+
+// CMake が CBLAS を見つけたときだけ 1 になる (Visual Studio のプロジェクトは組み込みのバックエンドだけを使う)
+#ifndef OCR_USE_BLAS
+#define OCR_USE_BLAS 0
+#endif
+
+#if OCR_USE_BLAS
+#include <cblas.h>
+#endif
+
+using namespace ocr;
+
+namespace
+{
+#if OCR_USE_BLAS
+    CBLAS_TRANSPOSE toCblasTranspose(Transpose transpose)
+    {
+        return transpose == Transpose::Yes ? CblasTrans : CblasNoTrans;
+    }
+#endif
+}
+
+namespace ocr
+{
+    const char* LinearAlgebraBackendName(LinearAlgebraBackend backend)
+    {
+        switch (backend)
+        {
+        case LinearAlgebraBackend::Scalar:
+            return "Scalar";
+        case LinearAlgebraBackend::Simd:
+            return "SIMD";
+        case LinearAlgebraBackend::Blas:
+            return "BLAS";
+        default:
+            return "Unknown";
+        }
+    }
+
+    bool IsLinearAlgebraBackendAvailable(LinearAlgebraBackend backend)
+    {
+        switch (backend)
+        {
+        case LinearAlgebraBackend::Scalar:
+        case LinearAlgebraBackend::Simd:
+            return true;
+        case LinearAlgebraBackend::Blas:
+            return OCR_USE_BLAS;
+        default:
+            return false;
+        }
+    }
+
+    bool SupportsSparseAndHalfKernels(LinearAlgebraBackend backend)
+    {
+        return backend == LinearAlgebraBackend::Simd;
+    }
+
+    void BackendGemm(LinearAlgebraBackend backend,
+                     Transpose transA, Transpose transB,
+                     int m, int n, int k,
+                     const float* a, int lda,
+                     const float* b, int ldb,
+                     float* c, int ldc)
+    {
+        switch (backend)
+        {
+        case LinearAlgebraBackend::Scalar:
+            GemmKernel(GemmKernelType::Scalar, transA, transB, m, n, k, a, lda, b, ldb, c, ldc);
+            return;
+        case LinearAlgebraBackend::Simd:
+            GemmKernel(transA, transB, m, n, k, a, lda, b, ldb, c, ldc);
+            return;
+#if OCR_USE_BLAS
+        case LinearAlgebraBackend::Blas:
+            if (m <= 0 || n <= 0 || k <= 0) return;
+
+            // beta = 1 で C に足し込む (GemmKernel と同じ意味にする)
+            cblas_sgemm(CblasRowMajor, toCblasTranspose(transA), toCblasTranspose(transB),
+                        m, n, k,
+                        1.0f, a, lda,
+                        b, ldb,
+                        1.0f, c, ldc);
+            return;
+#endif
+        default:
+            throw std::invalid_argument("Linear algebra backend is not available in this build.");
+        }
+    }
+}
@@ -0,0 +1,38 @@
+﻿#pragma once
+#include "GemmKernel.h"
+
+namespace ocr
+{
+    /// @brief float の行列積 (NP と DataParallelTrainer の順伝搬と逆伝搬の GEMM) を計算する CPU の実装
+    enum class LinearAlgebraBackend
+    {
+        /// @brief 組み込みのスカラー版。SIMD を使わず、他のバックエンドと比べる基準にする
+        Scalar,
+
+        /// @brief 組み込みの AVX2 / AVX-512 版 (cpuid で選んだ GemmKernel。どちらもない CPU ではスカラー版になる)
+        Simd,
+
+        /// @brief ビルド時に見つかったシステムの BLAS (OpenBLAS など) の cblas_sgemm
+        /// @note BLAS が自分でスレッドを立てると学習のスレッドと取り合うので、OPENBLAS_NUM_THREADS=1 などで止めておく
+        Blas,
+    };
+
+    const char* LinearAlgebraBackendName(LinearAlgebraBackend backend);
+
+    /// @brief このビルドで backend を使えるか (Blas は CMake が CBLAS を見つけて OCR_USE_BLAS でビルドしたときだけ)
+    bool IsLinearAlgebraBackendAvailable(LinearAlgebraBackend backend);
+
+    /// @brief 疎な入力 (SparseGemmKernel) と半精度の W1 の第 1 層を backend で計算できるか
+    /// @details これらのカーネルは組み込みの SIMD 版にしかない。他のバックエンドでは、学習の順伝搬と逆伝搬は
+    /// 疎な入力も半精度の W1 も使わず、float のマスターの W1 との密な行列積を BackendGemm() で計算する
+    bool SupportsSparseAndHalfKernels(LinearAlgebraBackend backend);
+
+    /// @brief backend で C[m][n] += op(A)[m][k] * op(B)[k][n] を計算する (引数は GemmKernel() と同じ)
+    /// @note 使えない backend を渡すと std::invalid_argument を投げる
+    void BackendGemm(LinearAlgebraBackend backend,
+                     Transpose transA, Transpose transB,
+                     int m, int n, int k,
+                     const float* a, int lda,
+                     const float* b, int ldb,
+                     float* c, int ldc);
+}
@@ -0,0 +1,91 @@
+﻿#include "pch.h"
+#include "MappedFile.h"
+
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ocr
+{
+#if defined(_WIN32)
+    MappedFile::MappedFile(const std::string& file)
+    {
+        const HANDLE fileHandle = CreateFileW(
+            std::filesystem::path(file).c_str(),
+            GENERIC_READ,
+            FILE_SHARE_READ,
+            nullptr,
+            OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL,
+            nullptr);
+        if (fileHandle == INVALID_HANDLE_VALUE)
+        {
+            throw std::runtime_error("Can't open file: " + file);
+        }
+
+        LARGE_INTEGER fileSize{};
+        if (not GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0)
+        {
+            CloseHandle(fileHandle);
+            throw std::runtime_error("Can't map empty file: " + file);
+        }
+
+        const HANDLE mappingHandle = CreateFileMappingW(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        const void* view = mappingHandle ? MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        if (view == nullptr)
+        {
+            if (mappingHandle) CloseHandle(mappingHandle);
+            CloseHandle(fileHandle);
+            throw std::runtime_error("Can't map file: " + file);
+        }
+
+        m_fileHandle = fileHandle;
+        m_mappingHandle = mappingHandle;
+        m_data = static_cast<const uint8_t*>(view);
+        m_size = static_cast<size_t>(fileSize.QuadPart);
+    }
+
+    MappedFile::~MappedFile()
+    {
+        UnmapViewOfFile(m_data);
+        CloseHandle(m_mappingHandle);
+        CloseHandle(m_fileHandle);
+    }
+#else
+    MappedFile::MappedFile(const std::string& file)
+    {
+        const int fd = ::open(file.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Can't open file: " + file);
+        }
+
+        struct stat status{};
+        if (::fstat(fd, &status) != 0 || status.st_size == 0)
+        {
+            ::close(fd);
+            throw std::runtime_error("Can't map empty file: " + file);
+        }
+
+        void* view = ::mmap(nullptr, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd); // マッピングはファイルディスクリプタを閉じても有効
+        if (view == MAP_FAILED)
+        {
+            throw std::runtime_error("Can't map file: " + file);
+        }
+
+        m_data = static_cast<const uint8_t*>(view);
+        m_size = static_cast<size_t>(status.st_size);
+    }
+
+    MappedFile::~MappedFile()
+    {
+        ::munmap(const_cast<uint8_t*>(m_data), m_size);
+    }
+#endif
+}
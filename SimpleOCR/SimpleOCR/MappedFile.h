@@ -0,0 +1,39 @@
+﻿#pragma once
+
+namespace ocr
+{
+    /// @brief 読み取り専用でメモリマップしたファイル
+    /// @details 先頭アドレスはページ境界に揃っており、同じファイルを開いたプロセス間でページキャッシュを共有する
+    class MappedFile
+    {
+    public:
+        explicit MappedFile(const std::string& file);
+
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        const uint8_t* data() const
+        {
+            return m_data;
+        }
+
+        size_t size() const
+        {
+            return m_size;
+        }
+
+    private:
+        const uint8_t* m_data{};
+
+        size_t m_size{};
+
+#if defined(_WIN32)
+        void* m_fileHandle{};
+
+        void* m_mappingHandle{};
+#endif
+    };
+}
@@ -1,18 +1,112 @@
 ﻿#include "pch.h"
 #include "Matrix.h"
 
+using namespace ocr;
+
+namespace
+{
+    void checkViewShape(int rows, int cols, int stride)
+    {
+        if (rows < 0 || cols < 0 || stride < cols)
+        {
+            throw std::invalid_argument("Matrix view dimensions are invalid.");
+        }
+    }
+
+    void checkRowRange(int firstRow, int rowCount, int rows)
+    {
+        if (firstRow < 0 || rowCount < 0 || firstRow + rowCount > rows)
+        {
+            throw std::out_of_range("Row range is out of the matrix.");
+        }
+    }
+
+    void checkBlock(int firstRow, int firstCol, int rowCount, int colCount, int rows, int cols)
+    {
+        checkRowRange(firstRow, rowCount, rows);
+        if (firstCol < 0 || colCount < 0 || firstCol + colCount > cols)
+        {
+            throw std::out_of_range("Column range is out of the matrix.");
+        }
+    }
+}
+
 namespace ocr
 {
-    Matrix::Matrix(int rows, int cols)
+    const char* MatrixLayoutName(MatrixLayout layout)
+    {
+        switch (layout)
+        {
+        case MatrixLayout::Packed: return "Packed";
+        case MatrixLayout::Padded: return "Padded";
+        default: return "Unknown";
+        }
+    }
+
+    MatrixView::MatrixView(float* data, int rows, int cols, int stride) :
+        m_data(data),
+        m_rows(rows),
+        m_cols(cols),
+        m_stride(stride)
+    {
+        checkViewShape(rows, cols, stride);
+    }
+
+    MatrixView MatrixView::rowRange(int firstRow, int rowCount) const
+    {
+        checkRowRange(firstRow, rowCount, m_rows);
+        return MatrixView{(*this)[firstRow], rowCount, m_cols, m_stride};
+    }
+
+    MatrixView MatrixView::block(int firstRow, int firstCol, int rowCount, int colCount) const
+    {
+        checkBlock(firstRow, firstCol, rowCount, colCount, m_rows, m_cols);
+        return MatrixView{(*this)[firstRow] + firstCol, rowCount, colCount, m_stride};
+    }
+
+    ConstMatrixView::ConstMatrixView(const float* data, int rows, int cols, int stride) :
+        m_data(data),
+        m_rows(rows),
+        m_cols(cols),
+        m_stride(stride)
+    {
+        checkViewShape(rows, cols, stride);
+    }
+
+    ConstMatrixView ConstMatrixView::rowRange(int firstRow, int rowCount) const
+    {
+        checkRowRange(firstRow, rowCount, m_rows);
+        return ConstMatrixView{(*this)[firstRow], rowCount, m_cols, m_stride};
+    }
+
+    ConstMatrixView ConstMatrixView::block(int firstRow, int firstCol, int rowCount, int colCount) const
+    {
+        checkBlock(firstRow, firstCol, rowCount, colCount, m_rows, m_cols);
+        return ConstMatrixView{(*this)[firstRow] + firstCol, rowCount, colCount, m_stride};
+    }
+
+    Matrix::Matrix(int rows, int cols, MatrixLayout layout)
+    {
+        resize(rows, cols, layout);
+    }
+
+    void Matrix::resize(int rows, int cols)
+    {
+        resize(rows, cols, m_layout);
+    }
+
+    void Matrix::resize(int rows, int cols, MatrixLayout layout)
     {
         if (rows <= 0 || cols <= 0)
         {
             throw std::invalid_argument("Matrix dimensions must be positive.");
         }
 
-        this->m_rows = rows;
-        this->m_cols = cols;
-        m_data.resize(rows * cols);
+        m_rows = rows;
+        m_cols = cols;
+        m_stride = layout == MatrixLayout::Padded ? PaddedStride(cols) : cols;
+        m_layout = layout;
+        m_data.resize(static_cast<size_t>(rows) * m_stride);
     }
 
     Matrix Matrix::transposed() const
@@ -22,18 +116,51 @@ namespace ocr
         {
             for (int j = 0; j < m_cols; ++j)
             {
-                result[j][i] = m_data[i * m_cols + j];
+                result[j][i] = (*this)[i][j];
             }
         }
 
         return result;
     }
 
+    Matrix Matrix::sliceRows(int firstRow, int rowCount) const
+    {
+        if (firstRow < 0 || rowCount <= 0 || firstRow + rowCount > m_rows)
+        {
+            throw std::out_of_range("Row range is out of the matrix.");
+        }
+
+        Matrix result(rowCount, m_cols, m_layout);
+        std::copy_n((*this)[firstRow], static_cast<size_t>(rowCount) * m_stride, result.m_data.begin());
+        return result;
+    }
+
+    ConstMatrixView Matrix::rowRange(int firstRow, int rowCount) const&
+    {
+        return ConstMatrixView{*this}.rowRange(firstRow, rowCount);
+    }
+
+    MatrixView Matrix::rowRange(int firstRow, int rowCount) &
+    {
+        return MatrixView{*this}.rowRange(firstRow, rowCount);
+    }
+
+    ConstMatrixView Matrix::block(int firstRow, int firstCol, int rowCount, int colCount) const&
+    {
+        return ConstMatrixView{*this}.block(firstRow, firstCol, rowCount, colCount);
+    }
+
+    MatrixView Matrix::block(int firstRow, int firstCol, int rowCount, int colCount) &
+    {
+        return MatrixView{*this}.block(firstRow, firstCol, rowCount, colCount);
+    }
+
     Matrix Matrix::RowMajor(Array<float> vector)
     {
         Matrix result{};
         result.m_rows = 1;
-        result.m_cols = vector.size();
+        result.m_cols = static_cast<int>(vector.size());
+        result.m_stride = result.m_cols;
         result.m_data = std::move(vector);
         return result;
     }
@@ -41,9 +168,23 @@ namespace ocr
     Matrix Matrix::ColumnMajor(Array<float> vector)
     {
         Matrix result{};
-        result.m_rows = vector.size();
+        result.m_rows = static_cast<int>(vector.size());
         result.m_cols = 1;
+        result.m_stride = 1;
         result.m_data = std::move(vector);
         return result;
     }
+
+    int Matrix::PaddedStride(int cols)
+    {
+        constexpr int lineFloats = 64 / sizeof(float);
+
+        int lines = (cols + lineFloats - 1) / lineFloats;
+        if (lines % 2 == 0)
+        {
+            ++lines;
+        }
+
+        return lines * lineFloats;
+    }
 }
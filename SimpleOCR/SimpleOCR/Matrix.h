@@ -6,11 +6,142 @@ using namespace TY;
 
 namespace ocr
 {
+    struct Matrix;
+
+    struct TransposedMatrixView;
+
+    /// @brief 行優先の行列の一部を、要素をコピーせずに読み書きする参照
+    /// @details 行の先頭同士の距離 stride (leading dimension) は cols 以上なので、行の範囲だけでなく列のブロックも表せる。
+    /// Matrix からは暗黙に変換されるので、NP の関数には Matrix とビューのどちらも渡せる
+    /// @note 参照先の行列より長く使わないこと (参照先を resize() したときも無効になる)
+    struct MatrixView
+    {
+        MatrixView() = default;
+
+        /// @param stride 行の先頭同士の距離 (要素数)。cols 以上であること
+        MatrixView(float* data, int rows, int cols, int stride);
+
+        MatrixView(Matrix& matrix);
+
+        int rows() const
+        {
+            return m_rows;
+        }
+
+        int cols() const
+        {
+            return m_cols;
+        }
+
+        int stride() const
+        {
+            return m_stride;
+        }
+
+        float* operator[](int index) const
+        {
+            return m_data + static_cast<ptrdiff_t>(index) * m_stride;
+        }
+
+        /// @brief 行の間に隙間がなく、rows * cols 個の要素が連続して並んでいるか
+        bool isContiguous() const
+        {
+            return m_stride == m_cols || m_rows <= 1;
+        }
+
+        /// @brief [firstRow, firstRow + rowCount) の行
+        MatrixView rowRange(int firstRow, int rowCount) const;
+
+        /// @brief [firstRow, firstRow + rowCount) 行 x [firstCol, firstCol + colCount) 列のブロック
+        MatrixView block(int firstRow, int firstCol, int rowCount, int colCount) const;
+
+    private:
+        float* m_data = nullptr;
+
+        int m_rows = 0;
+
+        int m_cols = 0;
+
+        int m_stride = 0;
+    };
+
+    /// @brief MatrixView の読み取り専用版
+    struct ConstMatrixView
+    {
+        ConstMatrixView() = default;
+
+        /// @param stride 行の先頭同士の距離 (要素数)。cols 以上であること
+        ConstMatrixView(const float* data, int rows, int cols, int stride);
+
+        /// @note 一時オブジェクトの行列も関数の引数としてなら渡せる (呼び出しが終わるまで破棄されない)。変数に保持しないこと
+        ConstMatrixView(const Matrix& matrix);
+
+        ConstMatrixView(const MatrixView& view) :
+            ConstMatrixView(view[0], view.rows(), view.cols(), view.stride())
+        {
+        }
+
+        int rows() const
+        {
+            return m_rows;
+        }
+
+        int cols() const
+        {
+            return m_cols;
+        }
+
+        int stride() const
+        {
+            return m_stride;
+        }
+
+        const float* operator[](int index) const
+        {
+            return m_data + static_cast<ptrdiff_t>(index) * m_stride;
+        }
+
+        bool isContiguous() const
+        {
+            return m_stride == m_cols || m_rows <= 1;
+        }
+
+        ConstMatrixView rowRange(int firstRow, int rowCount) const;
+
+        ConstMatrixView block(int firstRow, int firstCol, int rowCount, int colCount) const;
+
+        /// @brief 要素をコピーせずに、転置した [cols][rows] として読む参照
+        TransposedMatrixView transposedView() const;
+
+    private:
+        const float* m_data = nullptr;
+
+        int m_rows = 0;
+
+        int m_cols = 0;
+
+        int m_stride = 0;
+    };
+
+    /// @brief Matrix の行の並べ方
+    enum class MatrixLayout
+    {
+        /// @brief 行を隙間なく並べる (stride == cols)
+        Packed,
+
+        /// @brief 行の先頭同士の距離を Matrix::PaddedStride(cols) にする
+        /// @details 行の先頭同士がキャッシュラインの整数倍だけ離れ、列方向に読むときに行がキャッシュの同じセットに集まらない
+        Padded,
+    };
+
+    const char* MatrixLayoutName(MatrixLayout layout);
+
     struct Matrix
     {
         Matrix() = default;
 
-        Matrix(int rows, int cols);
+        /// @note Padded の行の末尾の隙間は 0 で初期化される
+        Matrix(int rows, int cols, MatrixLayout layout = MatrixLayout::Packed);
 
         int rows() const
         {
@@ -22,11 +153,31 @@ namespace ocr
             return m_cols;
         }
 
+        /// @brief 行の先頭同士の距離 (要素数)
+        int stride() const
+        {
+            return m_stride;
+        }
+
+        MatrixLayout layout() const
+        {
+            return m_layout;
+        }
+
+        /// @brief 行の間に隙間がなく、rows * cols 個の要素が data() に連続して並んでいるか
+        bool isContiguous() const
+        {
+            return m_stride == m_cols || m_rows <= 1;
+        }
+
         Size colsRows() const
         {
             return Size{m_cols, m_rows};
         }
 
+        /// @brief 行の末尾の隙間も含めた rows * stride 個の要素
+        /// @details 要素ごとの計算は、同じ形と並べ方の行列の間なら data() をそのまま走査してよい。
+        /// 隙間を 0 のまま保てば、足し算や勾配による更新の結果も 0 になる
         const Array<float>& data() const
         {
             return m_data;
@@ -39,27 +190,121 @@ namespace ocr
 
         float* operator[](int index)
         {
-            return &m_data[index * m_cols];
+            return m_data.data() + static_cast<size_t>(index) * m_stride;
         }
 
         const float* operator[](int index) const
         {
-            return &m_data[index * m_cols];
+            return m_data.data() + static_cast<size_t>(index) * m_stride;
+        }
+
+        /// @brief 形を [rows][cols] に変える。並べ方は変えず、要素数が確保済みの容量に収まる間は再確保しない
+        /// @note 要素の値は (行の末尾の隙間も) 保たれない
+        void resize(int rows, int cols);
+
+        void resize(int rows, int cols, MatrixLayout layout);
+
+        /// @brief 同じ形で、行の先頭同士の距離も同じか (data() を要素ごとに対応させてよいか)
+        bool hasSameLayout(const Matrix& other) const
+        {
+            return m_rows == other.m_rows && m_cols == other.m_cols && m_stride == other.m_stride;
         }
 
         Matrix transposed() const;
 
+        /// @brief 要素をコピーせずに、転置した [cols][rows] として読む参照
+        TransposedMatrixView transposedView() const&;
+
+        // 一時オブジェクトは参照より先に破棄されるので、名前を付けた行列だけを転置して読ませる
+        TransposedMatrixView transposedView() && = delete;
+
+        /// @brief [firstRow, firstRow + rowCount) の行をコピーした行列 (コピーせずに読むなら rowRange())
+        Matrix sliceRows(int firstRow, int rowCount) const;
+
+        /// @brief [firstRow, firstRow + rowCount) の行を、要素をコピーせずに参照するビュー
+        ConstMatrixView rowRange(int firstRow, int rowCount) const&;
+
+        MatrixView rowRange(int firstRow, int rowCount) &;
+
+        ConstMatrixView rowRange(int firstRow, int rowCount) && = delete;
+
+        /// @brief [firstRow, firstRow + rowCount) 行 x [firstCol, firstCol + colCount) 列を、要素をコピーせずに参照するビュー
+        ConstMatrixView block(int firstRow, int firstCol, int rowCount, int colCount) const&;
+
+        MatrixView block(int firstRow, int firstCol, int rowCount, int colCount) &;
+
+        ConstMatrixView block(int firstRow, int firstCol, int rowCount, int colCount) && = delete;
+
         static Matrix RowMajor(Array<float> vector);
 
         static Matrix ColumnMajor(Array<float> vector);
 
+        /// @brief MatrixLayout::Padded で cols 列の行の先頭同士の距離
+        /// @details 64 バイト (16 要素) の倍数に切り上げ、さらにキャッシュラインの数が奇数になるようにする。
+        /// 例えば 128 列 (512 バイト) は 144 列になり、8 行ごとに L1 の同じセットへ戻ることがなくなる
+        static int PaddedStride(int cols);
+
     private:
         /// @brief 行数
-        int m_rows;
+        int m_rows = 0;
 
         /// @brief 列数
-        int m_cols;
+        int m_cols = 0;
+
+        /// @brief 行の先頭同士の距離
+        int m_stride = 0;
+
+        MatrixLayout m_layout = MatrixLayout::Packed;
 
         Array<float> m_data;
     };
+
+    /// @brief 行列 source を転置した [source.cols()][source.rows()] の行列として読む参照 (要素はコピーしない)
+    /// @details NP::GEMM() などには転置フラグと source の stride として渡り、カーネルが読む順を選ぶ
+    /// @note source の参照先より長く使わないこと
+    struct TransposedMatrixView
+    {
+        ConstMatrixView source;
+
+        int rows() const
+        {
+            return source.cols();
+        }
+
+        int cols() const
+        {
+            return source.rows();
+        }
+
+        float operator()(int row, int col) const
+        {
+            return source[col][row];
+        }
+    };
+
+    inline MatrixView::MatrixView(Matrix& matrix) :
+        m_data(matrix.data().data()),
+        m_rows(matrix.rows()),
+        m_cols(matrix.cols()),
+        m_stride(matrix.stride())
+    {
+    }
+
+    inline ConstMatrixView::ConstMatrixView(const Matrix& matrix) :
+        m_data(matrix.data().data()),
+        m_rows(matrix.rows()),
+        m_cols(matrix.cols()),
+        m_stride(matrix.stride())
+    {
+    }
+
+    inline TransposedMatrixView ConstMatrixView::transposedView() const
+    {
+        return TransposedMatrixView{*this};
+    }
+
+    inline TransposedMatrixView Matrix::transposedView() const&
+    {
+        return TransposedMatrixView{*this};
+    }
 }
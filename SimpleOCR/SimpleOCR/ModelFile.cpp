@@ -0,0 +1,263 @@
+﻿#include "pch.h"
+#include "ModelFile.h"
+
+#include "MappedFile.h"
+
+#include <cstring>
+
+using namespace ocr;
+
+namespace
+{
+    constexpr char modelMagic[4] = {'O', 'C', 'R', 'M'};
+
+    struct ModelFileHeader
+    {
+        char magic[4]{};
+
+        uint32_t version{};
+
+        uint32_t tensorCount{};
+
+        uint32_t headerSize{};
+
+        uint64_t fileSize{};
+
+        uint64_t checksum{}; // ヘッダより後ろのすべてのバイトの FNV-1a
+
+        uint8_t reserved[32]{};
+    };
+
+    static_assert(sizeof(ModelFileHeader) == 64);
+
+    struct ModelTensorHeader
+    {
+        ModelTensor tensor;
+
+        ModelDataType dataType;
+
+        int32_t rows;
+
+        int32_t cols;
+
+        uint64_t offset; // ファイルの先頭から
+
+        uint64_t byteSize;
+    };
+
+    static_assert(sizeof(ModelTensorHeader) == 32);
+
+    constexpr size_t tensorCount = static_cast<size_t>(ModelTensor::Count);
+
+    constexpr size_t alignUp(size_t value, size_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    uint64_t fnv1a64(const uint8_t* bytes, size_t size)
+    {
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for (size_t i = 0; i < size; ++i)
+        {
+            hash ^= bytes[i];
+            hash *= 0x100000001b3ull;
+        }
+
+        return hash;
+    }
+
+    /// @brief 保存する配列。ベクトルは 1 行の行列として扱う
+    struct TensorSource
+    {
+        const float* data;
+
+        int rows;
+
+        int cols;
+
+        /// @brief 行の先頭同士の距離 (ファイルには行の末尾の隙間を除いて詰めて書く)
+        int stride;
+    };
+
+    std::array<TensorSource, tensorCount> tensorSources(const NeuralNetworkParameters& params)
+    {
+        const int b1Size = static_cast<int>(params.b1.size());
+        const int b2Size = static_cast<int>(params.b2.size());
+        return {
+            TensorSource{params.w1[0], params.w1.rows(), params.w1.cols(), params.w1.stride()},
+            TensorSource{params.b1.data(), 1, b1Size, b1Size},
+            TensorSource{params.w2[0], params.w2.rows(), params.w2.cols(), params.w2.stride()},
+            TensorSource{params.b2.data(), 1, b2Size, b2Size},
+        };
+    }
+
+    template <class T>
+    T readStruct(const uint8_t* bytes)
+    {
+        T value;
+        std::memcpy(&value, bytes, sizeof(T));
+        return value;
+    }
+}
+
+namespace ocr
+{
+    void SaveModel(const std::string& file, const NeuralNetworkParameters& params)
+    {
+        const auto sources = tensorSources(params);
+
+        // 配置を決めてから、ファイル全体を 1 つのバッファに組み立てて一度に書き込む
+        std::array<ModelTensorHeader, tensorCount> tensors{};
+        size_t offset = alignUp(sizeof(ModelFileHeader) + sizeof(tensors), modelBlobAlignment);
+        for (size_t i = 0; i < tensorCount; ++i)
+        {
+            const size_t byteSize = static_cast<size_t>(sources[i].rows) * sources[i].cols * sizeof(float);
+            tensors[i] = ModelTensorHeader{
+                .tensor = static_cast<ModelTensor>(i),
+                .dataType = ModelDataType::Float32,
+                .rows = sources[i].rows,
+                .cols = sources[i].cols,
+                .offset = offset,
+                .byteSize = byteSize
+            };
+            offset = alignUp(offset + byteSize, modelBlobAlignment);
+        }
+
+        Array<uint8_t> bytes(offset, 0);
+        std::memcpy(bytes.data() + sizeof(ModelFileHeader), tensors.data(), sizeof(tensors));
+        for (size_t i = 0; i < tensorCount; ++i)
+        {
+            const TensorSource& source = sources[i];
+            const size_t rowBytes = static_cast<size_t>(source.cols) * sizeof(float);
+            for (int row = 0; row < source.rows; ++row)
+            {
+                std::memcpy(bytes.data() + tensors[i].offset + row * rowBytes,
+                            source.data + static_cast<size_t>(row) * source.stride,
+                            rowBytes);
+            }
+        }
+
+        ModelFileHeader header{
+            .version = modelFileVersion,
+            .tensorCount = static_cast<uint32_t>(tensorCount),
+            .headerSize = sizeof(ModelFileHeader),
+            .fileSize = bytes.size(),
+            .checksum = fnv1a64(bytes.data() + sizeof(ModelFileHeader), bytes.size() - sizeof(ModelFileHeader))
+        };
+        std::memcpy(header.magic, modelMagic, sizeof(modelMagic));
+        std::memcpy(bytes.data(), &header, sizeof(header));
+
+        const std::filesystem::path path{file};
+        if (path.has_parent_path())
+        {
+            std::filesystem::create_directories(path.parent_path());
+        }
+
+        std::ofstream ofs(path, std::ios::binary);
+        if (!ofs) { throw std::runtime_error("Can't open file for writing: " + file); }
+
+        ofs.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+        if (!ofs) { throw std::runtime_error("Can't write model file: " + file); }
+    }
+
+    MappedModel::MappedModel(const std::string& file)
+        : m_file(std::make_shared<const MappedFile>(file))
+    {
+        const uint8_t* bytes = m_file->data();
+        const size_t size = m_file->size();
+
+        if (size < sizeof(ModelFileHeader))
+        {
+            throw std::runtime_error("Model file is too small: " + file);
+        }
+
+        const auto header = readStruct<ModelFileHeader>(bytes);
+        if (std::memcmp(header.magic, modelMagic, sizeof(modelMagic)) != 0)
+        {
+            throw std::runtime_error("Invalid model file magic: " + file);
+        }
+
+        if (header.version != modelFileVersion)
+        {
+            throw std::runtime_error("Unsupported model file version " + std::to_string(header.version) + ": " + file);
+        }
+
+        if (header.headerSize != sizeof(ModelFileHeader) || header.tensorCount != tensorCount)
+        {
+            throw std::runtime_error("Invalid model file header: " + file);
+        }
+
+        if (header.fileSize != size || size < sizeof(ModelFileHeader) + tensorCount * sizeof(ModelTensorHeader))
+        {
+            throw std::runtime_error("Model file is truncated: " + file);
+        }
+
+        if (fnv1a64(bytes + sizeof(ModelFileHeader), size - sizeof(ModelFileHeader)) != header.checksum)
+        {
+            throw std::runtime_error("Model file checksum mismatch: " + file);
+        }
+
+        for (size_t i = 0; i < tensorCount; ++i)
+        {
+            const auto tensor = readStruct<ModelTensorHeader>(
+                bytes + sizeof(ModelFileHeader) + i * sizeof(ModelTensorHeader));
+
+            const uint64_t expectedBytes = static_cast<uint64_t>(tensor.rows) * tensor.cols * sizeof(float);
+            if (tensor.tensor != static_cast<ModelTensor>(i) ||
+                tensor.dataType != ModelDataType::Float32 ||
+                tensor.rows <= 0 || tensor.cols <= 0 ||
+                tensor.byteSize != expectedBytes ||
+                tensor.offset % modelBlobAlignment != 0 ||
+                tensor.offset > size || size - tensor.offset < tensor.byteSize)
+            {
+                throw std::runtime_error("Invalid tensor " + std::to_string(i) + " in model file: " + file);
+            }
+
+            // マップの先頭はページ境界なので、揃えた位置の float はそのまま参照できる
+            m_tensors[i] = ModelTensorView{
+                .data = std::span<const float>{
+                    reinterpret_cast<const float*>(bytes + tensor.offset),
+                    static_cast<size_t>(tensor.rows) * tensor.cols
+                },
+                .rows = tensor.rows,
+                .cols = tensor.cols
+            };
+        }
+
+        // 層の間で形がつながっていること
+        const ModelTensorView& w1 = this->tensor(ModelTensor::W1);
+        const ModelTensorView& b1 = this->tensor(ModelTensor::B1);
+        const ModelTensorView& w2 = this->tensor(ModelTensor::W2);
+        const ModelTensorView& b2 = this->tensor(ModelTensor::B2);
+        if (b1.rows != 1 || b1.cols != w1.cols || w2.rows != w1.cols || b2.rows != 1 || b2.cols != w2.cols)
+        {
+            throw std::runtime_error("Layer shapes do not match in model file: " + file);
+        }
+    }
+
+    NeuralNetworkParameters MappedModel::toParameters(MatrixLayout layout) const
+    {
+        const auto toMatrix = [layout](const ModelTensorView& view)
+        {
+            Matrix matrix(view.rows, view.cols, layout);
+            for (int i = 0; i < view.rows; ++i)
+            {
+                std::copy_n(view[i], view.cols, matrix[i]);
+            }
+
+            return matrix;
+        };
+
+        const auto toArray = [](const ModelTensorView& view)
+        {
+            return Array<float>(view.data.begin(), view.data.end());
+        };
+
+        return NeuralNetworkParameters{
+            .w1 = toMatrix(tensor(ModelTensor::W1)),
+            .b1 = toArray(tensor(ModelTensor::B1)),
+            .w2 = toMatrix(tensor(ModelTensor::W2)),
+            .b2 = toArray(tensor(ModelTensor::B2))
+        };
+    }
+}
@@ -0,0 +1,77 @@
+﻿#pragma once
+#include <span>
+
+#include "NeuralNetwork.h"
+
+namespace ocr
+{
+    class MappedFile;
+
+    /// @brief モデルファイルの形式のバージョン。互換性のない変更をしたら上げる
+    constexpr uint32_t modelFileVersion = 1;
+
+    /// @brief 重みの配列の先頭をこのバイト数の倍数の位置に置く (キャッシュライン / AVX-512 のロード幅)
+    constexpr size_t modelBlobAlignment = 64;
+
+    enum class ModelDataType : uint32_t
+    {
+        Float32 = 1,
+    };
+
+    /// @brief ファイル内の重みの配列の並び順 (w1, b1, w2, b2 の固定順)
+    enum class ModelTensor : uint32_t
+    {
+        W1,
+        B1,
+        W2,
+        B2,
+        Count,
+    };
+
+    /// @brief パラメータを 1 つのバイナリファイルに保存する
+    /// @details レイアウト (リトルエンディアン):
+    /// - 64 バイトの固定ヘッダ (マジック "OCRM", バージョン, 配列の数, ファイルサイズ, チェックサム)
+    /// - 配列ごとに 32 バイトの記述子 (種類, 型, 行数, 列数, 先頭位置, バイト数)
+    /// - modelBlobAlignment に揃えた各配列の本体 (行優先)
+    /// チェックサムはヘッダより後ろのすべてのバイトの FNV-1a (64 ビット)
+    void SaveModel(const std::string& file, const NeuralNetworkParameters& params);
+
+    /// @brief 形だけを持つ、ファイル上の重みの配列へのビュー
+    struct ModelTensorView
+    {
+        std::span<const float> data;
+
+        int rows;
+
+        int cols;
+
+        const float* operator[](int row) const
+        {
+            return data.data() + static_cast<size_t>(row) * cols;
+        }
+    };
+
+    /// @brief モデルファイルをメモリマップし、検証したうえで重みをコピーせずに参照する
+    /// @details 構築時にファイル全体のチェックサムを計算するので、全ページを一度読み込んで検証する。
+    ///          重みをパースしてコピーし直すことはせず、ページキャッシュは同じファイルを開いたプロセス間で共有される
+    class MappedModel
+    {
+    public:
+        /// @brief ファイルをマップしてヘッダ、形、チェックサムを検証する (失敗したら std::runtime_error)
+        explicit MappedModel(const std::string& file);
+
+        const ModelTensorView& tensor(ModelTensor tensor) const
+        {
+            return m_tensors[static_cast<size_t>(tensor)];
+        }
+
+        /// @brief 学習や既存の推論関数に渡すために、所有権を持つパラメータへコピーする
+        /// @param layout 重みの行列の並べ方
+        NeuralNetworkParameters toParameters(MatrixLayout layout = MatrixLayout::Packed) const;
+
+    private:
+        std::shared_ptr<const MappedFile> m_file{};
+
+        std::array<ModelTensorView, static_cast<size_t>(ModelTensor::Count)> m_tensors{};
+    };
+}
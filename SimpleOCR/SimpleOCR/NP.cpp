@@ -1,6 +1,26 @@
 ﻿#include "pch.h"
 #include "NP.h"
 
+#include "ApplicationSettings.h"
+#include "DatasetImage.h"
+#include "GemmKernel.h"
+#include "LinearAlgebraBackend.h"
+
+using namespace ocr;
+
+namespace
+{
+    /// @brief float の行列積は ApplicationSettings で選んだバックエンドで計算する
+    void gemm(Transpose transA, Transpose transB,
+              int m, int n, int k,
+              const float* a, int lda,
+              const float* b, int ldb,
+              float* c, int ldc)
+    {
+        BackendGemm(g_applicationSettings.linearAlgebraBackend, transA, transB, m, n, k, a, lda, b, ldb, c, ldc);
+    }
+}
+
 namespace ocr
 {
     Array<float> NP::Subtract(const Array<float>& a, const Array<float>& b)
@@ -10,13 +30,7 @@ namespace ocr
             throw std::invalid_argument("Array sizes do not match for subtraction.");
         }
 
-        Array<float> result(a.size());
-        for (size_t i = 0; i < a.size(); ++i)
-        {
-            result[i] = a[i] - b[i];
-        }
-
-        return result;
+        return Materialize(Lazy(a) - Lazy(b));
     }
 
     Array<float> NP::Divide(const Array<float>& a, float b)
@@ -26,56 +40,49 @@ namespace ocr
             throw std::invalid_argument("Division by zero is not allowed.");
         }
 
-        Array<float> result(a.size());
-        for (size_t i = 0; i < a.size(); ++i)
+        return Materialize(Lazy(a) / b);
+    }
+
+    Matrix NP::VecMat(const Array<float>& b, ConstMatrixView A)
+    {
+        if (A.rows() != static_cast<int>(b.size()))
         {
-            result[i] = a[i] / b;
+            throw std::invalid_argument("Matrix and vector dimensions do not match for multiplication.");
         }
 
+        Matrix result(1, A.cols());
+        gemm(Transpose::No, Transpose::No, 1, A.cols(), A.rows(), b.data(), A.rows(), A[0], A.stride(), result[0], A.cols());
+
         return result;
     }
 
-    Matrix NP::VecMat(const Array<float>& b, const Matrix& A)
+    Matrix NP::VecMat(const Array<float>& b, const TransposedMatrixView& A)
     {
-        if (A.rows() != b.size())
+        if (A.rows() != static_cast<int>(b.size()))
         {
             throw std::invalid_argument("Matrix and vector dimensions do not match for multiplication.");
         }
 
         Matrix result(1, A.cols());
-        for (int j = 0; j < A.cols(); ++j)
-        {
-            result[0][j] = 0;
-            for (int i = 0; i < A.rows(); ++i)
-            {
-                result[0][j] += b[i] * A[i][j];
-            }
-        }
+        gemm(Transpose::No, Transpose::Yes, 1, A.cols(), A.rows(), b.data(), A.rows(), A.source[0], A.source.stride(), result[0], A.cols());
 
         return result;
     }
 
-    Matrix NP::MatVec(const Matrix& A, const Array<float>& b)
+    Matrix NP::MatVec(ConstMatrixView A, const Array<float>& b)
     {
-        if (A.cols() != b.size())
+        if (A.cols() != static_cast<int>(b.size()))
         {
             throw std::invalid_argument("Matrix and vector dimensions do not match for multiplication.");
         }
 
         Matrix result(A.rows(), 1);
-        for (int i = 0; i < A.rows(); ++i)
-        {
-            result[i][0] = 0;
-            for (int j = 0; j < A.cols(); ++j)
-            {
-                result[i][0] += A[i][j] * b[j];
-            }
-        }
+        gemm(Transpose::No, Transpose::No, A.rows(), 1, A.cols(), A[0], A.stride(), b.data(), 1, result[0], 1);
 
         return result;
     }
 
-    Matrix NP::MatMul(const Matrix& A, const Matrix& B)
+    Matrix NP::MatMul(ConstMatrixView A, ConstMatrixView B)
     {
         if (A.cols() != B.rows())
         {
@@ -83,54 +90,91 @@ namespace ocr
         }
 
         Matrix result(A.rows(), B.cols());
-        for (int i = 0; i < A.rows(); ++i)
-        {
-            for (int j = 0; j < B.cols(); ++j)
-            {
-                result[i][j] = 0;
-                for (int k = 0; k < A.cols(); ++k)
-                {
-                    result[i][j] += A[i][k] * B[k][j];
-                }
-            }
-        }
+        gemm(Transpose::No, Transpose::No, A.rows(), B.cols(), A.cols(), A[0], A.stride(), B[0], B.stride(), result[0], B.cols());
 
         return result;
     }
 
-    void NP::GEMM(const Array<float>& a, const Matrix& B, Array<float>& c)
+    void NP::GEMM(const Array<float>& a, ConstMatrixView B, Array<float>& c)
     {
-        if (B.rows() != a.size() || B.cols() != c.size())
+        if (B.rows() != static_cast<int>(a.size()) || B.cols() != static_cast<int>(c.size()))
         {
             throw std::invalid_argument("Matrix and vector dimensions do not match for GEMM operation.");
         }
 
-        for (int j = 0; j < B.cols(); ++j)
+        // c は 1 行の行列として扱い、w1 を行方向に連続して読む
+        gemm(Transpose::No, Transpose::No, 1, B.cols(), B.rows(), a.data(), B.rows(), B[0], B.stride(), c.data(), B.cols());
+    }
+
+    void NP::GEMM(ConstMatrixView A, ConstMatrixView B, MatrixView C)
+    {
+        if (A.cols() != B.rows() || A.rows() != C.rows() || B.cols() != C.cols())
         {
-            for (int i = 0; i < B.rows(); ++i)
-            {
-                c[j] += a[i] * B[i][j];
-            }
+            throw std::invalid_argument("Matrix dimensions do not match for GEMM operation.");
         }
+
+        gemm(Transpose::No, Transpose::No, A.rows(), B.cols(), A.cols(), A[0], A.stride(), B[0], B.stride(), C[0], C.stride());
     }
 
-    void NP::GEMM(const Matrix& A, const Matrix& B, Matrix& C)
+    void NP::GEMM(Transpose transA, Transpose transB,
+                  int m, int n, int k,
+                  const float* a, int lda,
+                  const float* b, int ldb,
+                  float* c, int ldc)
+    {
+        // 格納されている行列の行の長さ: op(X) = X^T なら X の列数は op(X) の行数
+        const int aRowLength = transA == Transpose::Yes ? m : k;
+        const int bRowLength = transB == Transpose::Yes ? k : n;
+        if (m < 0 || n < 0 || k < 0 || lda < aRowLength || ldb < bRowLength || ldc < n)
+        {
+            throw std::invalid_argument("Invalid dimensions or leading dimensions for GEMM operation.");
+        }
+
+        gemm(transA, transB, m, n, k, a, lda, b, ldb, c, ldc);
+    }
+
+    void NP::GEMM(const TransposedMatrixView& A, ConstMatrixView B, MatrixView C)
     {
         if (A.cols() != B.rows() || A.rows() != C.rows() || B.cols() != C.cols())
         {
             throw std::invalid_argument("Matrix dimensions do not match for GEMM operation.");
         }
 
-        for (int i = 0; i < A.rows(); ++i)
+        gemm(Transpose::Yes, Transpose::No, A.rows(), B.cols(), A.cols(),
+             A.source[0], A.source.stride(), B[0], B.stride(), C[0], C.stride());
+    }
+
+    void NP::GEMM(ConstMatrixView A, const TransposedMatrixView& B, MatrixView C)
+    {
+        if (A.cols() != B.rows() || A.rows() != C.rows() || B.cols() != C.cols())
         {
-            for (int j = 0; j < B.cols(); ++j)
-            {
-                for (int k = 0; k < A.cols(); ++k)
-                {
-                    C[i][j] += A[i][k] * B[k][j];
-                }
-            }
+            throw std::invalid_argument("Matrix dimensions do not match for GEMM operation.");
         }
+
+        gemm(Transpose::No, Transpose::Yes, A.rows(), B.cols(), A.cols(),
+             A[0], A.stride(), B.source[0], B.source.stride(), C[0], C.stride());
+    }
+
+    void NP::GEMM(const TransposedMatrixView& A, const TransposedMatrixView& B, MatrixView C)
+    {
+        if (A.cols() != B.rows() || A.rows() != C.rows() || B.cols() != C.cols())
+        {
+            throw std::invalid_argument("Matrix dimensions do not match for GEMM operation.");
+        }
+
+        gemm(Transpose::Yes, Transpose::Yes, A.rows(), B.cols(), A.cols(),
+             A.source[0], A.source.stride(), B.source[0], B.source.stride(), C[0], C.stride());
+    }
+
+    void NP::GEMM(const PixelBatch& A, float scale, ConstMatrixView B, MatrixView C)
+    {
+        if (A.cols != B.rows() || A.rows != C.rows() || B.cols() != C.cols())
+        {
+            throw std::invalid_argument("Matrix dimensions do not match for GEMM operation.");
+        }
+
+        // uint8 の A を読む行列積は BLAS にないので、バックエンドによらず組み込みのカーネルを使う
+        GemmKernel(A.rows, B.cols(), A.cols, A.pixels, A.cols, scale, B[0], B.stride(), C[0], C.stride());
     }
 
     Matrix NP::OuterProduct(const Array<float>& a, const Array<float>& b)
@@ -154,13 +198,7 @@ namespace ocr
             throw std::invalid_argument("Array sizes do not match for dot product.");
         }
 
-        float result = 0.0f;
-        for (size_t i = 0; i < a.size(); ++i)
-        {
-            result += a[i] * b[i];
-        }
-
-        return result;
+        return Sum(Lazy(a) * Lazy(b));
     }
 
     Array<float> NP::HadamardProduct(const Array<float>& a, const Array<float>& b)
@@ -170,12 +208,26 @@ namespace ocr
             throw std::invalid_argument("Array sizes do not match for Hadamard product.");
         }
 
-        Array<float> result(a.size());
-        for (size_t i = 0; i < a.size(); ++i)
-        {
-            result[i] = a[i] * b[i];
-        }
+        return Materialize(Lazy(a) * Lazy(b));
+    }
 
+    Array<float> NP::ColumnSum(ConstMatrixView A)
+    {
+        Array<float> result{};
+        ColumnSum(A, result);
         return result;
     }
+
+    void NP::ColumnSum(ConstMatrixView A, Array<float>& result)
+    {
+        result.resize(A.cols());
+        std::fill(result.begin(), result.end(), 0.0f);
+        for (int i = 0; i < A.rows(); ++i)
+        {
+            for (int j = 0; j < A.cols(); ++j)
+            {
+                result[j] += A[i][j];
+            }
+        }
+    }
 }
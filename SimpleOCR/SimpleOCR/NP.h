@@ -1,23 +1,54 @@
 ﻿#pragma once
+#include "GemmKernel.h"
 #include "Matrix.h"
+#include "NPExpression.h"
 
 namespace ocr
 {
+    struct PixelBatch;
+
+    /// @note Subtract, Divide, DorProduct, HadamardProduct は NPExpression.h の式を 1 つだけ評価する薄い関数。
+    /// 演算を続けるときは、途中の配列を作らないように NP::Lazy() の式を組み合わせて 1 回だけ評価する。
+    /// float の行列積 (VecMat, MatVec, MatMul, GEMM) は ApplicationSettings::linearAlgebraBackend のバックエンドで計算する。
+    /// 行列の引数は ConstMatrixView / MatrixView なので、Matrix のほか rowRange() や block() のビューもコピーせずに渡せる
     namespace NP
     {
         Array<float> Subtract(const Array<float>& a, const Array<float>& b);
 
         Array<float> Divide(const Array<float>& a, float b);
 
-        Matrix VecMat(const Array<float>& b, const Matrix& A);
+        Matrix VecMat(const Array<float>& b, ConstMatrixView A);
+
+        /// @brief b * A^T (A^T の行列を確保してコピーせずに計算する)
+        Matrix VecMat(const Array<float>& b, const TransposedMatrixView& A);
+
+        Matrix MatVec(ConstMatrixView A, const Array<float>& b);
+
+        Matrix MatMul(ConstMatrixView A, ConstMatrixView B);
+
+        void GEMM(const Array<float>& a, ConstMatrixView B, Array<float>& c);
 
-        Matrix MatVec(const Matrix& A, const Array<float>& b);
+        void GEMM(ConstMatrixView A, ConstMatrixView B, MatrixView C);
 
-        Matrix MatMul(const Matrix& A, const Matrix& B);
+        /// @brief BLAS の sgemm と同じ形の C[m][n] += op(A)[m][k] * op(B)[k][n]
+        /// @param lda, ldb, ldc 格納されている行列の行の距離。op(A) = A^T なら A は [k][m] で格納され lda >= m
+        void GEMM(Transpose transA, Transpose transB,
+                  int m, int n, int k,
+                  const float* a, int lda,
+                  const float* b, int ldb,
+                  float* c, int ldc);
 
-        void GEMM(const Array<float>& a, const Matrix& B, Array<float>& c);
+        /// @brief C += A^T * B
+        void GEMM(const TransposedMatrixView& A, ConstMatrixView B, MatrixView C);
 
-        void GEMM(const Matrix& A, const Matrix& B, Matrix& C);
+        /// @brief C += A * B^T
+        void GEMM(ConstMatrixView A, const TransposedMatrixView& B, MatrixView C);
+
+        /// @brief C += A^T * B^T
+        void GEMM(const TransposedMatrixView& A, const TransposedMatrixView& B, MatrixView C);
+
+        /// @brief C += scale * A * B (A の画素を浮動小数の行列に展開せずに読む)
+        void GEMM(const PixelBatch& A, float scale, ConstMatrixView B, MatrixView C);
 
         /// @テンソル積
         Matrix OuterProduct(const Array<float>& a, const Array<float>& b);
@@ -27,5 +58,11 @@ namespace ocr
 
         /// @brief アダマール積
         Array<float> HadamardProduct(const Array<float>& a, const Array<float>& b);
+
+        /// @brief 列ごとの総和 (バッチ方向の和)
+        Array<float> ColumnSum(ConstMatrixView A);
+
+        /// @brief 列ごとの総和を result に書き込む (result の容量が足りていれば再確保しない)
+        void ColumnSum(ConstMatrixView A, Array<float>& result);
     }
 }
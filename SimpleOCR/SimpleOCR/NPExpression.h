@@ -0,0 +1,227 @@
+﻿#pragma once
+#include "Matrix.h"
+
+namespace ocr
+{
+    namespace NP
+    {
+        /// @brief 要素ごとの遅延評価の式。演算子はこれを継承した型の間でだけ定義し、Array<float> 自体には増やさない
+        /// @details (Lazy(y2) - Lazy(trueY)) / batches のような式は値を計算せずに木を作り、Evaluate() で
+        /// 1 回のループ (出力への書き込みも 1 回) にまとめて計算する。途中の配列は確保しない
+        struct ExpressionBase
+        {
+        };
+
+        template <class T>
+        concept Expression = std::is_base_of_v<ExpressionBase, T>;
+
+        /// @brief 連続した float の列を参照する葉 (値はコピーしないので、参照先は Evaluate() まで生きている必要がある)
+        struct ArrayExpression : ExpressionBase
+        {
+            const float* values;
+
+            size_t count;
+
+            float operator[](size_t index) const
+            {
+                return values[index];
+            }
+
+            size_t size() const
+            {
+                return count;
+            }
+        };
+
+        /// @brief 全ての要素が同じ値の葉 (スカラーとの演算で使う。要素数は相手の式に従う)
+        struct ScalarExpression : ExpressionBase
+        {
+            float value;
+
+            float operator[](size_t) const
+            {
+                return value;
+            }
+        };
+
+        template <class T>
+        constexpr bool isScalarExpression = std::is_same_v<T, ScalarExpression>;
+
+        /// @brief Operation(lhs[i], rhs[i])
+        template <class Operation, Expression L, Expression R>
+        struct BinaryExpression : ExpressionBase
+        {
+            static_assert(not (isScalarExpression<L> && isScalarExpression<R>), "At least one operand must be an array.");
+
+            L lhs;
+
+            R rhs;
+
+            BinaryExpression(const L& lhs, const R& rhs) :
+                lhs(lhs),
+                rhs(rhs)
+            {
+                if constexpr (not isScalarExpression<L> && not isScalarExpression<R>)
+                {
+                    if (lhs.size() != rhs.size())
+                    {
+                        throw std::invalid_argument("Array sizes do not match for elementwise operation.");
+                    }
+                }
+            }
+
+            float operator[](size_t index) const
+            {
+                return Operation{}(lhs[index], rhs[index]);
+            }
+
+            size_t size() const
+            {
+                if constexpr (isScalarExpression<L>)
+                {
+                    return rhs.size();
+                }
+                else
+                {
+                    return lhs.size();
+                }
+            }
+        };
+
+        /// @brief -operand[i]
+        template <Expression E>
+        struct NegateExpression : ExpressionBase
+        {
+            E operand;
+
+            float operator[](size_t index) const
+            {
+                return -operand[index];
+            }
+
+            size_t size() const
+            {
+                return operand.size();
+            }
+        };
+
+        inline ArrayExpression Lazy(const Array<float>& a)
+        {
+            return ArrayExpression{{}, a.data(), a.size()};
+        }
+
+        /// @brief 行の範囲のビューなど、要素が連続して並んだビューの葉 (列のブロックのように隙間のあるビューは std::invalid_argument)
+        inline ArrayExpression Lazy(const ConstMatrixView& a)
+        {
+            if (not a.isContiguous())
+            {
+                throw std::invalid_argument("Elementwise expressions require a contiguous matrix view.");
+            }
+
+            return ArrayExpression{{}, a[0], static_cast<size_t>(a.rows()) * a.cols()};
+        }
+
+        /// @note MatrixLayout::Padded の行列は行の間に隙間があるので std::invalid_argument
+        inline ArrayExpression Lazy(const Matrix& a)
+        {
+            return Lazy(ConstMatrixView{a});
+        }
+
+        // 一時オブジェクトは式を評価する前に破棄されうるので、名前を付けた変数だけを参照させる
+        ArrayExpression Lazy(Array<float>&&) = delete;
+
+        ArrayExpression Lazy(Matrix&&) = delete;
+
+#define OCR_NP_BINARY_OPERATOR(op, Operation)                                                    \
+        template <Expression L, Expression R>                                                    \
+        BinaryExpression<Operation, L, R> operator op(const L& lhs, const R& rhs)                \
+        {                                                                                        \
+            return BinaryExpression<Operation, L, R>{lhs, rhs};                                  \
+        }                                                                                        \
+                                                                                                 \
+        template <Expression L>                                                                  \
+        BinaryExpression<Operation, L, ScalarExpression> operator op(const L& lhs, float rhs)     \
+        {                                                                                        \
+            return BinaryExpression<Operation, L, ScalarExpression>{lhs, ScalarExpression{{}, rhs}}; \
+        }                                                                                        \
+                                                                                                 \
+        template <Expression R>                                                                  \
+        BinaryExpression<Operation, ScalarExpression, R> operator op(float lhs, const R& rhs)     \
+        {                                                                                        \
+            return BinaryExpression<Operation, ScalarExpression, R>{ScalarExpression{{}, lhs}, rhs}; \
+        }
+
+        OCR_NP_BINARY_OPERATOR(+, std::plus<float>)
+        OCR_NP_BINARY_OPERATOR(-, std::minus<float>)
+        OCR_NP_BINARY_OPERATOR(*, std::multiplies<float>)
+        OCR_NP_BINARY_OPERATOR(/, std::divides<float>)
+
+#undef OCR_NP_BINARY_OPERATOR
+
+        template <Expression E>
+        NegateExpression<E> operator-(const E& operand)
+        {
+            return NegateExpression<E>{{}, operand};
+        }
+
+        /// @brief 式を 1 回のループで評価し、result の先頭から expression.size() 要素に書き込む
+        /// @details 同じ添字の要素しか読まないので、result は式が参照する配列と同じでもよい (その場で更新する)
+        template <Expression E>
+        void Evaluate(const E& expression, float* result)
+        {
+            const size_t count = expression.size();
+            for (size_t i = 0; i < count; ++i)
+            {
+                result[i] = expression[i];
+            }
+        }
+
+        /// @brief 式を評価して result に書き込む (result の容量が足りていれば再確保しない)
+        template <Expression E>
+        void Evaluate(const E& expression, Array<float>& result)
+        {
+            result.resize(expression.size());
+            Evaluate(expression, result.data());
+        }
+
+        /// @brief 式を評価して、同じ要素数の行列 result (Matrix か、要素が連続して並んだビュー) に書き込む
+        template <Expression E>
+        void Evaluate(const E& expression, const MatrixView& result)
+        {
+            if (not result.isContiguous())
+            {
+                throw std::invalid_argument("Elementwise expressions require a contiguous matrix view.");
+            }
+
+            if (static_cast<size_t>(result.rows()) * result.cols() != expression.size())
+            {
+                throw std::invalid_argument("Matrix size does not match the expression.");
+            }
+
+            Evaluate(expression, result[0]);
+        }
+
+        /// @brief 式を評価した新しい配列
+        template <Expression E>
+        Array<float> Materialize(const E& expression)
+        {
+            Array<float> result(expression.size());
+            Evaluate(expression, result.data());
+            return result;
+        }
+
+        /// @brief 式の要素の総和 (先頭から順に足す)
+        template <Expression E>
+        float Sum(const E& expression)
+        {
+            float result = 0.0f;
+            const size_t count = expression.size();
+            for (size_t i = 0; i < count; ++i)
+            {
+                result += expression[i];
+            }
+
+            return result;
+        }
+    }
+}
@@ -1,53 +1,66 @@
 ﻿#include "pch.h"
 #include "NeuralNetwork.h"
 
+#include "Activation.h"
 #include "ApplicationSettings.h"
+#include "DatasetImage.h"
+#include "GemmKernel.h"
+#include "HalfNeuralNetwork.h"
 #include "NP.h"
+#include "SparseInput.h"
+#include "StaticNeuralNetwork.h"
+#if not OCR_HEADLESS
 #include "TY/Gpgpu.h"
 #include "TY/GpgpuBuffer.h"
 #include "TY/InlineComponent.h"
 #include "TY/Logger.h"
 #include "TY/ScopedDeferStack.h"
 #include "TY/Shader.h"
+#endif
 
 using namespace ocr;
 
 namespace
 {
-    Array<float> sigmoid(const Array<float>& a)
+    /// @brief a1 += x * w1。x の非ゼロ要素が少なければ、対応する w1 の行だけを足し込む
+    void firstLayer(const Array<float>& x, const Matrix& w1, Array<float>& a1)
     {
-        Array<float> y(a.size());
-        for (int i = 0; i < a.size(); ++i)
+        if (not SupportsSparseAndHalfKernels(g_applicationSettings.linearAlgebraBackend))
         {
-            // Sigmoid activation function
-            y[i] = 1.0f / (1.0f + std::expf(-a[i]));
+            NP::GEMM(x, w1, a1);
+            return;
         }
 
-        return y;
-    }
-
-    Array<float> softmax(const Array<float>& a)
-    {
-        float alpha = a[0];
-        for (int i = 1; i < a.size(); ++i)
+        SparseRows sparseX{};
+        const int inputCount = static_cast<int>(x.size());
+        sparseX.clear(inputCount);
+        for (int i = 0; i < inputCount; ++i)
         {
-            if (a[i] > alpha) alpha = a[i];
+            if (x[i] != 0.0f) sparseX.push(i, x[i]);
         }
 
-        Array<float> y(a.size());
-        float sum{};
-        for (int i = 0; i < a.size(); ++i)
-        {
-            y[i] = std::expf(a[i] - alpha);
-            sum += y[i];
-        }
+        sparseX.endRow();
 
-        for (int i = 0; i < a.size(); ++i)
+        if (not PreferSparseInput(sparseX.density(0, 1)))
         {
-            y[i] = y[i] / sum;
+            NP::GEMM(x, w1, a1);
+            return;
         }
 
-        return y;
+        SparseGemmKernel(1, w1.cols(),
+                         sparseX.offsets.data(), sparseX.indices.data(), sparseX.values.data(),
+                         w1[0], w1.stride(),
+                         a1.data(), a1.size());
+    }
+
+    /// @brief 中間層と出力層が mnistTopology と同じ形で、W2 の行が隙間なく並んでいるか (形が合わないときは NP の実装に任せ、例外を投げさせる)
+    bool isStaticOutputLayer(int midCount, const Matrix& w2, const Array<float>& b2)
+    {
+        return midCount == mnistTopology.midCount &&
+            w2.rows() == mnistTopology.midCount &&
+            w2.cols() == mnistTopology.outputCount &&
+            w2.isContiguous() &&
+            b2.size() == mnistTopology.outputCount;
     }
 
     NeuralNetworkOutput cpuNeuralNetwork(const Array<float>& x, const NeuralNetworkParameters& params)
@@ -58,25 +71,85 @@ namespace
 
         // ----------------------------------------------- 入力層 --> 中間層
 
-        Array<float> a1 = params.b1;
-        NP::GEMM(x, params.w1, a1); // a1 = x * w1 + b1
+        output.y1 = params.b1;
+        firstLayer(x, params.w1, output.y1); // a1 = x * w1 + b1
 
         // --> sigmoid 活性化関数層: 非線形性を加える
-        output.y1 = sigmoid(a1);
+        SigmoidInPlace(output.y1.data(), output.y1.size(), g_applicationSettings.activationMode);
 
         // ----------------------------------------------- 中間層 --> 出力層
 
-        Array<float> a2 = params.b2;
-        NP::GEMM(output.y1, params.w2, a2); // y2 = y1 * w2 + b2
+        if (isStaticOutputLayer(output.y1.size(), params.w2, params.b2))
+        {
+            constexpr int midCount = mnistTopology.midCount;
+            constexpr int outputCount = mnistTopology.outputCount;
+
+            output.y2.resize(outputCount);
+            StaticDenseLayer<midCount, outputCount>(output.y1.data(), params.w2[0], params.b2.data(), output.y2.data());
+            StaticSoftmax<outputCount>(output.y2.data());
+            return output;
+        }
+
+        output.y2 = params.b2;
+        NP::GEMM(output.y1, params.w2, output.y2); // a2 = y1 * w2 + b2
 
         // --> softmax 活性化関数層: 出力を確率分布として解釈
-        output.y2 = softmax(a2);
+        SoftmaxRowsInPlace(output.y2.data(), 1, output.y2.size(), g_applicationSettings.activationMode);
+
+        return output;
+    }
+
+    /// @brief result を [rows][b の要素数] にして、各行にベクトル b を並べる
+    void broadcastRows(const Array<float>& b, int rows, Matrix& result)
+    {
+        result.resize(rows, b.size());
+        for (int i = 0; i < rows; ++i)
+        {
+            std::copy(b.begin(), b.end(), result[i]);
+        }
+    }
+
+    /// @brief output.y1 に A1 = X * W1 + b1 が入った状態から残りの層を計算する
+    void cpuBatchNeuralNetworkFromA1(BatchNeuralNetworkOutput& output, const Matrix& w2, const Array<float>& b2)
+    {
+        const ActivationMode mode = g_applicationSettings.activationMode;
+        SigmoidInPlace(output.y1, mode);
+
+        // ----------------------------------------------- 中間層 --> 出力層
+
+        broadcastRows(b2, output.y1.rows(), output.y2);
+        NP::GEMM(output.y1, w2, output.y2); // A2 = Y1 * W2 + b2
+
+        SoftmaxRowsInPlace(output.y2, mode);
+    }
+
+    BatchNeuralNetworkOutput cpuBatchNeuralNetwork(const Matrix& x, const NeuralNetworkParameters& params)
+    {
+        BatchNeuralNetworkOutput output{};
+
+        // X -> [W1 + b1] -> A1 -> sigmoid -> Y1 -> [W2 + b2] -> A2 -> softmax -> Y2
+
+        // ----------------------------------------------- 入力層 --> 中間層
 
+        broadcastRows(params.b1, x.rows(), output.y1);
+        NP::GEMM(x, params.w1, output.y1); // A1 = X * W1 + b1
+
+        cpuBatchNeuralNetworkFromA1(output, params.w2, params.b2);
         return output;
     }
 
+    void cpuBatchNeuralNetwork(const PixelBatch& x, const NeuralNetworkParameters& params, BatchNeuralNetworkOutput& output)
+    {
+        // 画素を浮動小数に展開せず、1/255 の正規化を積和の最後にまとめて掛ける
+        broadcastRows(params.b1, x.rows, output.y1);
+        NP::GEMM(x, 1.0f / 255.0f, params.w1, output.y1); // A1 = (X / 255) * W1 + b1
+
+        cpuBatchNeuralNetworkFromA1(output, params.w2, params.b2);
+    }
+
     // -----------------------------------------------
 
+#if not OCR_HEADLESS
     struct GpuNeuralNetwork : IInlineComponent
     {
         bool initialized{};
@@ -183,6 +256,7 @@ namespace
 
         return output;
     }
+#endif
 }
 
 namespace ocr
@@ -204,8 +278,107 @@ namespace ocr
         return maxIndex;
     }
 
+    int BatchNeuralNetworkOutput::maxIndex(int row) const
+    {
+        int maxIndex = 0;
+        const float* output = y2[row];
+        float maxValue = output[0];
+        for (int i = 1; i < y2.cols(); ++i)
+        {
+            if (output[i] > maxValue)
+            {
+                maxValue = output[i];
+                maxIndex = i;
+            }
+        }
+
+        return maxIndex;
+    }
+
     NeuralNetworkOutput NeuralNetwork(const Array<float>& x, const NeuralNetworkParameters& params)
     {
-        return g_applicationSettings.useGpu ? gpuNeuralNetwork(x, params) : cpuNeuralNetwork(x, params);
+#if not OCR_HEADLESS
+        // GPU のシェーダーは行が隙間なく並んだ重みを読むので、Padded の重みは CPU で計算する
+        if (g_applicationSettings.useGpu && params.w1.isContiguous() && params.w2.isContiguous()) return gpuNeuralNetwork(x, params);
+#endif
+        return cpuNeuralNetwork(x, params);
+    }
+
+    BatchNeuralNetworkOutput BatchNeuralNetwork(const Matrix& x, const NeuralNetworkParameters& params)
+    {
+        return cpuBatchNeuralNetwork(x, params);
+    }
+
+    BatchNeuralNetworkOutput BatchNeuralNetwork(const PixelBatch& x, const NeuralNetworkParameters& params)
+    {
+        BatchNeuralNetworkOutput output{};
+        cpuBatchNeuralNetwork(x, params, output);
+        return output;
+    }
+
+    void BatchNeuralNetwork(const PixelBatch& x, const NeuralNetworkParameters& params, BatchNeuralNetworkOutput& output)
+    {
+        cpuBatchNeuralNetwork(x, params, output);
+    }
+
+    void BatchNeuralNetworkFromA1(BatchNeuralNetworkOutput& output, const Matrix& w2, const Array<float>& b2)
+    {
+        cpuBatchNeuralNetworkFromA1(output, w2, b2);
+    }
+
+    void BatchNeuralNetwork(const Matrix& x,
+                            int firstRow,
+                            int rowCount,
+                            const NeuralNetworkParameters& params,
+                            BatchNeuralNetworkOutput& output,
+                            const SparseRows* sparseX,
+                            const HalfMatrix* halfW1)
+    {
+        assert(firstRow >= 0 && firstRow + rowCount <= x.rows());
+
+        // 疎な入力と半精度の W1 のカーネルがないバックエンドでは、float のマスターの W1 との密な行列積にする
+        if (not SupportsSparseAndHalfKernels(g_applicationSettings.linearAlgebraBackend))
+        {
+            sparseX = nullptr;
+            halfW1 = nullptr;
+        }
+
+        broadcastRows(params.b1, rowCount, output.y1);
+
+        if (halfW1)
+        {
+            assert(halfW1->rows == params.w1.rows() && halfW1->cols == params.w1.cols());
+
+            // W1 は半精度で読み、積和は float で行う
+            if (sparseX)
+            {
+                SparseGemmKernel(rowCount, halfW1->cols,
+                                 sparseX->offsets.data() + firstRow, sparseX->indices.data(), sparseX->values.data(),
+                                 halfW1->format, (*halfW1)[0], halfW1->cols,
+                                 output.y1[0], output.y1.stride());
+            }
+            else
+            {
+                GemmKernel(rowCount, halfW1->cols, x.cols(),
+                           x[firstRow], x.stride(),
+                           halfW1->format, (*halfW1)[0], halfW1->cols,
+                           output.y1[0], output.y1.stride());
+            }
+        }
+        else if (sparseX)
+        {
+            // 非ゼロの画素に対応する W1 の行だけを足し込む
+            SparseGemmKernel(rowCount, params.w1.cols(),
+                             sparseX->offsets.data() + firstRow, sparseX->indices.data(), sparseX->values.data(),
+                             params.w1[0], params.w1.stride(),
+                             output.y1[0], output.y1.stride());
+        }
+        else
+        {
+            // A1 = X[firstRow..] * W1 + b1 (行の範囲をコピーせずにビューで読む)
+            NP::GEMM(x.rowRange(firstRow, rowCount), params.w1, output.y1);
+        }
+
+        cpuBatchNeuralNetworkFromA1(output, params.w2, params.b2);
     }
 }
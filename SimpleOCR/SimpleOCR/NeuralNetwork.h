@@ -4,6 +4,12 @@
 
 namespace ocr
 {
+    struct PixelBatch;
+
+    struct SparseRows;
+
+    struct HalfMatrix;
+
     struct NeuralNetworkParameters
     {
         Matrix w1; // [入力ノード数][中間ノード数]
@@ -29,5 +35,44 @@ namespace ocr
         int maxIndex() const;
     };
 
+    struct BatchNeuralNetworkOutput
+    {
+        Matrix y1; // [バッチ数][中間ノード数]
+
+        Matrix y2; // [バッチ数][出力ノード数]
+
+        const Matrix& output() const
+        {
+            return y2;
+        }
+
+        int maxIndex(int row) const;
+    };
+
     NeuralNetworkOutput NeuralNetwork(const Array<float>& x, const NeuralNetworkParameters& params);
+
+    /// @brief バッチ全体を [バッチ数][入力ノード数] の行列として一度に順伝搬する (CPU のみ)
+    BatchNeuralNetworkOutput BatchNeuralNetwork(const Matrix& x, const NeuralNetworkParameters& params);
+
+    /// @brief uint8 の画素を直接読んで順伝搬する (入力の正規化は第 1 層の積和に含める)
+    BatchNeuralNetworkOutput BatchNeuralNetwork(const PixelBatch& x, const NeuralNetworkParameters& params);
+
+    /// @brief BatchNeuralNetwork(const PixelBatch&, ...) の結果を output に書き込む (形が同じなら再確保しない)
+    void BatchNeuralNetwork(const PixelBatch& x, const NeuralNetworkParameters& params, BatchNeuralNetworkOutput& output);
+
+    /// @brief output.y1 に第 1 層の A1 = X * W1 + b1 が入った状態から、sigmoid 以降の層を計算する
+    /// @details 第 1 層を別の方法 (量子化など) で計算した推論が、残りの層を共有するために使う
+    void BatchNeuralNetworkFromA1(BatchNeuralNetworkOutput& output, const Matrix& w2, const Array<float>& b2);
+
+    /// @brief x の [firstRow, firstRow + rowCount) 行を順伝搬して output に書き込む
+    /// @details output の行列は使い回され、形が前回と同じなら再確保しない (学習ステップの作業領域用)
+    /// @param sparseX nullptr でなければ、第 1 層は x の代わりにこの非ゼロ要素だけを読む
+    /// @param halfW1 nullptr でなければ、第 1 層は params.w1 の代わりにこの半精度の重みを読む
+    void BatchNeuralNetwork(const Matrix& x,
+                            int firstRow,
+                            int rowCount,
+                            const NeuralNetworkParameters& params,
+                            BatchNeuralNetworkOutput& output,
+                            const SparseRows* sparseX = nullptr,
+                            const HalfMatrix* halfW1 = nullptr);
 }
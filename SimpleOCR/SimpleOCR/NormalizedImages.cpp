@@ -0,0 +1,33 @@
+﻿#include "pch.h"
+#include "NormalizedImages.h"
+
+namespace ocr
+{
+    Matrix NormalizeImages(const DatasetImageList& images)
+    {
+        const int pixelCount = images.property().pixelCount();
+        Matrix result(static_cast<int>(images.size()), pixelCount);
+
+        const uint8_t* pixels = images.pixels();
+        std::transform(pixels, pixels + images.size() * pixelCount, result.data().begin(), [](uint8_t pixel)
+        {
+            return static_cast<float>(pixel) / 255.0f;
+        });
+
+        return result;
+    }
+
+    void GatherRows(const Matrix& source, const Array<int>& indices, int baseIndex, Matrix& destination)
+    {
+        if (source.cols() != destination.cols() || baseIndex + destination.rows() > static_cast<int>(indices.size()))
+        {
+            throw std::invalid_argument("Matrix dimensions do not match for gathering rows.");
+        }
+
+        for (int i = 0; i < destination.rows(); ++i)
+        {
+            const float* row = source[indices[baseIndex + i]];
+            std::copy_n(row, source.cols(), destination[i]);
+        }
+    }
+}
@@ -0,0 +1,13 @@
+﻿#pragma once
+#include "DatasetImage.h"
+#include "Matrix.h"
+
+namespace ocr
+{
+    /// @brief データセット全体を 1/255 で正規化し、[画像数][画素数] の連続した行列にする
+    /// @details プロセス中に一度だけ作り、学習のたびに画素を変換し直さずに行をコピーして使う
+    Matrix NormalizeImages(const DatasetImageList& images);
+
+    /// @brief source の indices[baseIndex + i] 行目を destination の i 行目にコピーする
+    void GatherRows(const Matrix& source, const Array<int>& indices, int baseIndex, Matrix& destination);
+}
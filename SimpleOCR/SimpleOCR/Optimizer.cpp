@@ -0,0 +1,141 @@
+﻿#include "pch.h"
+#include "Optimizer.h"
+
+#include "PhaseProfiler.h"
+
+using namespace ocr;
+
+namespace
+{
+    // どの更新も 1 要素ごとに独立した 1 回のループで、コンパイラがベクトル化する
+
+    void sgdUpdate(size_t count, float* params, const float* gradient, float learningRate)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            params[i] -= learningRate * gradient[i];
+        }
+    }
+
+    /// @brief v = momentum * v - learningRate * g, p += v
+    void momentumUpdate(size_t count, float* params, const float* gradient, float* velocity, float learningRate, float momentum)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            velocity[i] = momentum * velocity[i] - learningRate * gradient[i];
+            params[i] += velocity[i];
+        }
+    }
+
+    /// @brief m = β1 m + (1 - β1) g, v = β2 v + (1 - β2) g^2, p -= stepSize * m / (√v + ε)
+    /// @details バイアス補正は stepSize にまとめてある (Kingma & Ba の 2 章の最後に書かれた効率のよい形)
+    void adamUpdate(size_t count,
+                    float* params,
+                    const float* gradient,
+                    float* firstMoment,
+                    float* secondMoment,
+                    float stepSize,
+                    const OptimizerSettings& settings)
+    {
+        const float beta1 = settings.beta1;
+        const float beta2 = settings.beta2;
+        const float epsilon = settings.epsilon;
+        for (size_t i = 0; i < count; ++i)
+        {
+            const float g = gradient[i];
+            firstMoment[i] = beta1 * firstMoment[i] + (1.0f - beta1) * g;
+            secondMoment[i] = beta2 * secondMoment[i] + (1.0f - beta2) * g * g;
+            params[i] -= stepSize * firstMoment[i] / (std::sqrt(secondMoment[i]) + epsilon);
+        }
+    }
+
+    int stateCount(OptimizerType type)
+    {
+        switch (type)
+        {
+        case OptimizerType::Momentum: return 1;
+        case OptimizerType::Adam: return 2;
+        default: return 0;
+        }
+    }
+}
+
+namespace ocr
+{
+    const char* OptimizerName(OptimizerType type)
+    {
+        switch (type)
+        {
+        case OptimizerType::Sgd: return "SGD";
+        case OptimizerType::Momentum: return "Momentum";
+        case OptimizerType::Adam: return "Adam";
+        default: return "Unknown";
+        }
+    }
+
+    OptimizerSettings DefaultOptimizerSettings(OptimizerType type)
+    {
+        return OptimizerSettings{
+            .type = type,
+            .learningRate = type == OptimizerType::Adam ? 0.001f : 0.01f
+        };
+    }
+
+    Optimizer::Optimizer(const OptimizerSettings& settings, const NeuralNetworkParameters& params) :
+        m_settings(settings),
+        m_sizes{params.w1.data().size(), params.b1.size(), params.w2.data().size(), params.b2.size()}
+    {
+        for (size_t i = 0; i < m_sizes.size(); ++i)
+        {
+            m_offsets[i] = m_parameterCount;
+            m_parameterCount += m_sizes[i];
+        }
+
+        m_state.assign(m_parameterCount * stateCount(settings.type), 0.0f);
+    }
+
+    void Optimizer::beginStep()
+    {
+        m_step++;
+
+        const double t = m_step;
+        const double correction1 = 1.0 - std::pow(static_cast<double>(m_settings.beta1), t);
+        const double correction2 = 1.0 - std::pow(static_cast<double>(m_settings.beta2), t);
+        m_stepSize = static_cast<float>(m_settings.learningRate * std::sqrt(correction2) / correction1);
+    }
+
+    void Optimizer::update(ParameterTensor tensor, size_t offset, size_t count, float* params, const float* gradient)
+    {
+        const size_t index = static_cast<size_t>(tensor);
+        assert(offset + count <= m_sizes[index]);
+
+        float* state = m_state.data() + m_offsets[index] + offset;
+        switch (m_settings.type)
+        {
+        case OptimizerType::Momentum:
+            momentumUpdate(count, params, gradient, state, m_settings.learningRate, m_settings.momentum);
+            break;
+        case OptimizerType::Adam:
+            assert(m_step > 0 && "beginStep() must be called before update().");
+            adamUpdate(count, params, gradient, state, state + m_parameterCount, m_stepSize, m_settings);
+            break;
+        default:
+            sgdUpdate(count, params, gradient, m_settings.learningRate);
+            break;
+        }
+    }
+
+    void Optimizer::apply(NeuralNetworkParameters& params, const NeuralNetworkParameters& gradient)
+    {
+        OCR_PROFILE_SCOPE(UpdateParameters);
+
+        // 行の末尾の隙間も含めて要素を対応させるので、勾配は MakeZeroGradient() のように params と同じ並べ方であること
+        assert(params.w1.hasSameLayout(gradient.w1) && params.w2.hasSameLayout(gradient.w2));
+
+        beginStep();
+        update(ParameterTensor::W1, 0, params.w1.data().size(), params.w1.data().data(), gradient.w1.data().data());
+        update(ParameterTensor::B1, 0, params.b1.size(), params.b1.data(), gradient.b1.data());
+        update(ParameterTensor::W2, 0, params.w2.data().size(), params.w2.data().data(), gradient.w2.data().data());
+        update(ParameterTensor::B2, 0, params.b2.size(), params.b2.data(), gradient.b2.data());
+    }
+}
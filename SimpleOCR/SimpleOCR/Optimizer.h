@@ -0,0 +1,88 @@
+﻿#pragma once
+#include "NeuralNetwork.h"
+
+namespace ocr
+{
+    enum class OptimizerType
+    {
+        Sgd,
+        Momentum, // 慣性付きの SGD
+        Adam,
+    };
+
+    const char* OptimizerName(OptimizerType type);
+
+    struct OptimizerSettings
+    {
+        OptimizerType type = OptimizerType::Sgd;
+
+        float learningRate = 0.01f;
+
+        /// @brief Momentum の慣性の係数
+        float momentum = 0.9f;
+
+        /// @brief Adam の 1 次、2 次モーメントの減衰率
+        float beta1 = 0.9f;
+
+        float beta2 = 0.999f;
+
+        float epsilon = 1e-8f;
+    };
+
+    /// @brief type ごとに標準の学習率を入れた設定 (SGD と Momentum は 0.01、Adam は 0.001)
+    OptimizerSettings DefaultOptimizerSettings(OptimizerType type);
+
+    /// @brief NeuralNetworkParameters の各テンソル
+    enum class ParameterTensor
+    {
+        W1,
+        B1,
+        W2,
+        B2,
+        Count,
+    };
+
+    /// @brief 勾配からパラメータを更新する規則と、その状態 (Momentum の速度、Adam の 1 次、2 次モーメント)
+    /// @details 状態は 4 つのテンソルを w1, b1, w2, b2 の順に並べた 1 つの連続した配列に置き、パラメータと同じ添字で読む。
+    /// 1 要素の更新 (状態の読み書きを含む) は 1 回のループで行う
+    class Optimizer
+    {
+    public:
+        /// @param params 更新するパラメータ (形と並べ方だけを使う。MatrixLayout::Padded の行の末尾の隙間の分も状態を持つ)
+        Optimizer(const OptimizerSettings& settings, const NeuralNetworkParameters& params);
+
+        const OptimizerSettings& settings() const
+        {
+            return m_settings;
+        }
+
+        /// @brief 1 ステップ分の更新を始める (Adam のバイアス補正を進める)。そのステップの update() より前に 1 回だけ呼ぶ
+        void beginStep();
+
+        /// @brief tensor の [offset, offset + count) 要素を勾配で更新する
+        /// @param params, gradient tensor の offset 要素目を指す
+        /// @note 範囲が重ならなければ、複数のスレッドから同時に呼べる
+        void update(ParameterTensor tensor, size_t offset, size_t count, float* params, const float* gradient);
+
+        /// @brief beginStep() を行い、全てのテンソルを gradient で更新する
+        void apply(NeuralNetworkParameters& params, const NeuralNetworkParameters& gradient);
+
+    private:
+        OptimizerSettings m_settings;
+
+        /// @brief 各テンソルの状態の先頭と要素数
+        std::array<size_t, static_cast<size_t>(ParameterTensor::Count)> m_offsets{};
+
+        std::array<size_t, static_cast<size_t>(ParameterTensor::Count)> m_sizes{};
+
+        size_t m_parameterCount{};
+
+        /// @brief Momentum: [速度]、Adam: [1 次モーメント][2 次モーメント] (それぞれ m_parameterCount 要素)
+        Array<float> m_state{};
+
+        int m_step{};
+
+        /// @brief Adam のバイアス補正を含めた学習率
+        float m_stepSize{};
+    };
+}
@@ -0,0 +1,222 @@
+﻿#include "pch.h"
+#include "PhaseProfiler.h"
+
+using namespace ocr;
+
+namespace
+{
+    /// @brief 1 スレッドが保持する区間の数 (2 のべき乗。16 バイト x 65536 = 1 MB)
+    constexpr uint64_t ringCapacity = 1 << 16;
+
+    struct ProfileEvent
+    {
+        uint64_t begin;
+
+        uint32_t duration; // ナノ秒 (約 4 秒で飽和する)
+
+        ProfilePhase phase;
+    };
+
+    /// @brief 1 つのスレッドだけが書き込み、他のスレッドは読むだけのリングバッファと合計
+    struct ThreadBuffer
+    {
+        int threadId{};
+
+        bool retired{};
+
+        std::atomic<uint64_t> writeCount{};
+
+        std::array<std::atomic<uint64_t>, profilePhaseCount> nanoseconds{};
+
+        std::array<std::atomic<uint64_t>, profilePhaseCount> counts{};
+
+        std::array<ProfileEvent, ringCapacity> events{};
+    };
+
+    std::mutex s_registryMutex{};
+
+    /// @brief 登録したバッファは解放しない。終了したスレッドのバッファは次に記録を始めたスレッドが引き継ぐ
+    std::vector<std::unique_ptr<ThreadBuffer>> s_threadBuffers{};
+
+    ThreadBuffer* acquireThreadBuffer()
+    {
+        std::lock_guard lock{s_registryMutex};
+        for (const auto& buffer : s_threadBuffers)
+        {
+            if (buffer->retired)
+            {
+                buffer->retired = false;
+                return buffer.get();
+            }
+        }
+
+        s_threadBuffers.push_back(std::make_unique<ThreadBuffer>());
+        s_threadBuffers.back()->threadId = static_cast<int>(s_threadBuffers.size());
+        return s_threadBuffers.back().get();
+    }
+
+    /// @brief スレッドの終了時にバッファを手放す
+    struct ThreadBufferOwner
+    {
+        ThreadBuffer* buffer{};
+
+        ~ThreadBufferOwner()
+        {
+            if (not buffer) return;
+
+            std::lock_guard lock{s_registryMutex};
+            buffer->retired = true;
+        }
+    };
+
+    thread_local ThreadBufferOwner t_owner{};
+
+    /// @brief 書き込むのは所有するスレッドだけなので、lock 付きの加算は要らない
+    void addRelaxed(std::atomic<uint64_t>& value, uint64_t amount)
+    {
+        value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    std::string formatText(const char* format, auto... args)
+    {
+        char buffer[256];
+        std::snprintf(buffer, sizeof(buffer), format, args...);
+        return buffer;
+    }
+}
+
+namespace ocr
+{
+    const char* ProfilePhaseName(ProfilePhase phase)
+    {
+        switch (phase)
+        {
+        case ProfilePhase::Gather: return "Gather";
+        case ProfilePhase::MakeImageInput: return "MakeImageInput";
+        case ProfilePhase::Forward: return "Forward";
+        case ProfilePhase::Backward: return "Backward";
+        case ProfilePhase::AccumulateGradients: return "AccumulateGradients";
+        case ProfilePhase::UpdateParameters: return "UpdateParameters";
+        case ProfilePhase::Evaluation: return "Evaluation";
+        default: return "Unknown";
+        }
+    }
+
+    ProfileTotals ProfileTotals::since(const ProfileTotals& before) const
+    {
+        ProfileTotals result{.timestamp = timestamp - before.timestamp};
+        for (int i = 0; i < profilePhaseCount; ++i)
+        {
+            result.nanoseconds[i] = nanoseconds[i] - before.nanoseconds[i];
+            result.counts[i] = counts[i] - before.counts[i];
+        }
+
+        return result;
+    }
+
+    ProfileTotals CaptureProfileTotals()
+    {
+        ProfileTotals totals{.timestamp = ProfileTimestamp()};
+
+        std::lock_guard lock{s_registryMutex};
+        for (const auto& buffer : s_threadBuffers)
+        {
+            for (int i = 0; i < profilePhaseCount; ++i)
+            {
+                totals.nanoseconds[i] += buffer->nanoseconds[i].load(std::memory_order_relaxed);
+                totals.counts[i] += buffer->counts[i].load(std::memory_order_relaxed);
+            }
+        }
+
+        return totals;
+    }
+
+    std::string FormatProfileSummary(const ProfileTotals& interval, int sampleCount)
+    {
+        const double seconds = static_cast<double>(interval.timestamp) * 1e-9;
+        std::string text = formatText("- Throughput = %.0f samples/sec (%.3f s)",
+                                      seconds > 0.0 ? sampleCount / seconds : 0.0,
+                                      seconds);
+
+        // 段階は複数のスレッドで同時に進むので、割合は経過時間ではなく記録した時間の合計に対して求める
+        const uint64_t recorded = std::accumulate(interval.nanoseconds.begin(), interval.nanoseconds.end(), uint64_t{});
+        for (int i = 0; i < profilePhaseCount; ++i)
+        {
+            if (interval.counts[i] == 0) continue;
+
+            const auto phase = static_cast<ProfilePhase>(i);
+            text += formatText("\n- %-19s %5.1f%% (%.3f s, %llu scopes)",
+                               ProfilePhaseName(phase),
+                               100.0 * static_cast<double>(interval.nanoseconds[i]) / static_cast<double>(recorded),
+                               interval.seconds(phase),
+                               static_cast<unsigned long long>(interval.counts[i]));
+        }
+
+        return text;
+    }
+
+    void WriteChromeTrace(const std::string& file, uint64_t sinceTimestamp)
+    {
+        std::ofstream ofs(file);
+        if (!ofs) { throw std::runtime_error("Can't open file for writing: " + file); }
+
+        ofs << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        ofs << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"SimpleOCR\"}}";
+
+        std::lock_guard lock{s_registryMutex};
+        for (const auto& buffer : s_threadBuffers)
+        {
+            // リングバッファは古い区間から上書きされるので、残っている最後の ringCapacity 個だけを読む
+            const uint64_t writeCount = buffer->writeCount.load(std::memory_order_acquire);
+            const uint64_t first = writeCount > ringCapacity ? writeCount - ringCapacity : 0;
+            for (uint64_t i = first; i < writeCount; ++i)
+            {
+                const ProfileEvent& event = buffer->events[i & (ringCapacity - 1)];
+                if (event.begin < sinceTimestamp) continue;
+
+                // ts と dur はマイクロ秒
+                ofs << formatText(",\n{\"name\":\"%s\",\"cat\":\"ocr\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}",
+                                  ProfilePhaseName(event.phase),
+                                  static_cast<double>(event.begin - sinceTimestamp) * 1e-3,
+                                  static_cast<double>(event.duration) * 1e-3,
+                                  buffer->threadId);
+            }
+        }
+
+        ofs << "\n]}\n";
+        if (!ofs) { throw std::runtime_error("Can't write trace file: " + file); }
+    }
+
+    void RecordProfileEvent(ProfilePhase phase, uint64_t begin, uint64_t end) noexcept
+    {
+        ThreadBuffer* buffer = t_owner.buffer;
+        if (not buffer)
+        {
+            // スレッドごとに最初の 1 回だけ、バッファを確保して登録する
+            try
+            {
+                buffer = acquireThreadBuffer();
+            }
+            catch (...)
+            {
+                return;
+            }
+
+            t_owner.buffer = buffer;
+        }
+
+        const uint64_t duration = end - begin;
+        const uint64_t index = buffer->writeCount.load(std::memory_order_relaxed);
+        buffer->events[index & (ringCapacity - 1)] = ProfileEvent{
+            .begin = begin,
+            .duration = static_cast<uint32_t>(std::min<uint64_t>(duration, UINT32_MAX)),
+            .phase = phase
+        };
+
+        buffer->writeCount.store(index + 1, std::memory_order_release);
+
+        const int phaseIndex = static_cast<int>(phase);
+        addRelaxed(buffer->nanoseconds[phaseIndex], duration);
+        addRelaxed(buffer->counts[phaseIndex], 1);
+    }
+}
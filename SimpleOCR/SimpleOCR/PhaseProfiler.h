@@ -0,0 +1,99 @@
+﻿#pragma once
+
+// 学習と評価の各段階にかかる時間を記録する。0 にするとスコープの計測はコンパイル時に取り除かれる
+#ifndef OCR_PROFILE_PHASES
+#define OCR_PROFILE_PHASES 1
+#endif
+
+namespace ocr
+{
+    enum class ProfilePhase : uint8_t
+    {
+        Gather, // バッチの画像を集めて正規化する
+        MakeImageInput, // 1 枚の画像を入力ベクトルにする
+        Forward,
+        Backward,
+        AccumulateGradients,
+        UpdateParameters,
+        Evaluation,
+        Count,
+    };
+
+    constexpr int profilePhaseCount = static_cast<int>(ProfilePhase::Count);
+
+    const char* ProfilePhaseName(ProfilePhase phase);
+
+    /// @brief 計測に使う時刻 (プロセス内で単調増加するナノ秒)
+    inline uint64_t ProfileTimestamp()
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    /// @brief 全スレッドで記録した各段階の時間と回数の合計
+    struct ProfileTotals
+    {
+        uint64_t timestamp{};
+
+        std::array<uint64_t, profilePhaseCount> nanoseconds{};
+
+        std::array<uint64_t, profilePhaseCount> counts{};
+
+        double seconds(ProfilePhase phase) const
+        {
+            return static_cast<double>(nanoseconds[static_cast<int>(phase)]) * 1e-9;
+        }
+
+        /// @brief before から this までの差分
+        ProfileTotals since(const ProfileTotals& before) const;
+    };
+
+    /// @brief 今までに記録した合計を読む。差分を取ると区間 (エポックなど) ごとの内訳になる
+    /// @note OCR_PROFILE_PHASES が 0 のときは時刻以外が 0 になる
+    ProfileTotals CaptureProfileTotals();
+
+    /// @brief 区間の処理速度と、各段階が記録した時間全体に占める割合を複数行の文章にする
+    std::string FormatProfileSummary(const ProfileTotals& interval, int sampleCount);
+
+    /// @brief sinceTimestamp 以降に始まった区間を Chrome / Perfetto の trace event 形式の JSON に書き出す
+    /// @details 各スレッドのリングバッファに残っている分だけが出力される。記録中のスレッドがない間に呼ぶこと
+    void WriteChromeTrace(const std::string& file, uint64_t sinceTimestamp);
+
+    /// @brief 呼び出したスレッドのリングバッファに 1 区間を記録する
+    void RecordProfileEvent(ProfilePhase phase, uint64_t begin, uint64_t end) noexcept;
+
+    /// @brief 生成からデストラクタまでの時間を 1 区間として記録する
+    class ProfileScope
+    {
+    public:
+        explicit ProfileScope(ProfilePhase phase) noexcept :
+            m_phase(phase),
+            m_begin(ProfileTimestamp())
+        {
+        }
+
+        ~ProfileScope()
+        {
+            RecordProfileEvent(m_phase, m_begin, ProfileTimestamp());
+        }
+
+        ProfileScope(const ProfileScope&) = delete;
+
+        ProfileScope& operator=(const ProfileScope&) = delete;
+
+    private:
+        ProfilePhase m_phase;
+
+        uint64_t m_begin;
+    };
+}
+
+#define OCR_PROFILE_CONCAT_IMPL(a, b) a##b
+#define OCR_PROFILE_CONCAT(a, b) OCR_PROFILE_CONCAT_IMPL(a, b)
+
+#if OCR_PROFILE_PHASES
+/// @brief スコープの終わりまでを phase の区間として記録する
+#define OCR_PROFILE_SCOPE(phase) const ::ocr::ProfileScope OCR_PROFILE_CONCAT(profileScope, __LINE__){::ocr::ProfilePhase::phase}
+#else
+#define OCR_PROFILE_SCOPE(phase) static_cast<void>(0)
+#endif
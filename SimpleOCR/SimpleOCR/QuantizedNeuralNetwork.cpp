@@ -0,0 +1,183 @@
+﻿#include "pch.h"
+#include "QuantizedNeuralNetwork.h"
+
+#include "GemmKernel.h"
+
+using namespace ocr;
+
+namespace
+{
+    constexpr float pixelScale = 1.0f / 255.0f;
+
+    template <class F>
+    double measureSeconds(F&& f)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        f();
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count();
+    }
+}
+
+namespace ocr
+{
+    QuantizedNeuralNetworkParameters QuantizeNeuralNetwork(const NeuralNetworkParameters& params)
+    {
+        const int inputCount = params.w1.rows();
+        const int midCount = params.w1.cols();
+
+        QuantizedNeuralNetworkParameters quantized{
+            .inputCount = inputCount,
+            .midCount = midCount,
+            .w1Scales = Array<float>(midCount),
+            .b1 = params.b1,
+            .w2 = params.w2,
+            .b2 = params.b2
+        };
+
+        // 列ごとに倍率を決める (列は中間ノードに対応するので、ノードごとの重みの大きさの違いを吸収できる)
+        Array<float> maxAbs(midCount, 0.0f);
+        for (int i = 0; i < inputCount; ++i)
+        {
+            const float* row = params.w1[i];
+            for (int j = 0; j < midCount; ++j)
+            {
+                maxAbs[j] = std::max(maxAbs[j], std::abs(row[j]));
+            }
+        }
+
+        constexpr float limit = static_cast<float>(quantizedGemmWeightLimit);
+        for (int j = 0; j < midCount; ++j)
+        {
+            quantized.w1Scales[j] = maxAbs[j] > 0.0f ? maxAbs[j] / limit : 1.0f;
+        }
+
+        Array<int8_t> w1(static_cast<size_t>(inputCount) * midCount);
+        for (int i = 0; i < inputCount; ++i)
+        {
+            const float* row = params.w1[i];
+            for (int j = 0; j < midCount; ++j)
+            {
+                const float q = std::round(row[j] / quantized.w1Scales[j]);
+                w1[static_cast<size_t>(i) * midCount + j] = static_cast<int8_t>(std::clamp(q, -limit, limit));
+            }
+        }
+
+        quantized.w1.resize(QuantizedGemmPackedSize(inputCount, midCount));
+        PackQuantizedGemmB(inputCount, midCount, w1.data(), midCount, quantized.w1.data());
+        return quantized;
+    }
+
+    BatchNeuralNetworkOutput QuantizedBatchNeuralNetwork(const PixelBatch& x, const QuantizedNeuralNetworkParameters& params)
+    {
+        BatchNeuralNetworkOutput output{};
+        Array<int32_t> accumulator{};
+        QuantizedBatchNeuralNetwork(x, params, output, accumulator);
+        return output;
+    }
+
+    void QuantizedBatchNeuralNetwork(const PixelBatch& x,
+                                     const QuantizedNeuralNetworkParameters& params,
+                                     BatchNeuralNetworkOutput& output,
+                                     Array<int32_t>& accumulator)
+    {
+        if (x.cols != params.inputCount)
+        {
+            throw std::invalid_argument("Pixel count does not match the quantized network.");
+        }
+
+        // ----------------------------------------------- 入力層 --> 中間層 (整数演算)
+
+        const int packedColumns = QuantizedGemmPackedColumns(params.midCount);
+        accumulator.resize(static_cast<size_t>(x.rows) * packedColumns);
+        QuantizedGemmKernel(x.rows, params.midCount, x.cols,
+                            x.pixels, x.cols,
+                            params.w1.data(),
+                            accumulator.data(), packedColumns);
+
+        // A1 = (X / 255) * W1 + b1 に戻す。画素の 1/255 は重みの倍率と合わせて掛ける
+        output.y1.resize(x.rows, params.midCount);
+        for (int i = 0; i < x.rows; ++i)
+        {
+            const int32_t* ai = accumulator.data() + static_cast<size_t>(i) * packedColumns;
+            float* yi = output.y1[i];
+            for (int j = 0; j < params.midCount; ++j)
+            {
+                yi[j] = static_cast<float>(ai[j]) * (params.w1Scales[j] * pixelScale) + params.b1[j];
+            }
+        }
+
+        // ----------------------------------------------- 中間層 --> 出力層 (float)
+
+        BatchNeuralNetworkFromA1(output, params.w2, params.b2);
+    }
+
+    QuantizationReport CompareQuantizedInference(const DatasetImageList& images,
+                                                 const Array<uint8_t>& labels,
+                                                 const NeuralNetworkParameters& params,
+                                                 int batchSize)
+    {
+        const QuantizedNeuralNetworkParameters quantized = QuantizeNeuralNetwork(params);
+
+        QuantizationReport report{
+            .sampleCount = static_cast<int>(images.size()),
+            .fp32W1Bytes = params.w1.data().size() * sizeof(float),
+            .int8W1Bytes = quantized.w1.size() * sizeof(int8_t) + quantized.w1Scales.size() * sizeof(float)
+        };
+
+        // 両方の出力を残しておき、速度の計測が終わってから比べる
+        Array<BatchNeuralNetworkOutput> fp32Outputs{};
+        Array<BatchNeuralNetworkOutput> int8Outputs{};
+
+        const auto runAll = [&](Array<BatchNeuralNetworkOutput>& outputs, auto&& forward)
+        {
+            outputs.clear();
+            for (size_t first = 0; first < images.size(); first += batchSize)
+            {
+                const size_t count = std::min(static_cast<size_t>(batchSize), images.size() - first);
+                outputs.push_back(forward(images.batch(first, count)));
+            }
+        };
+
+        const double fp32Seconds = measureSeconds([&]
+        {
+            runAll(fp32Outputs, [&](const PixelBatch& x) { return BatchNeuralNetwork(x, params); });
+        });
+
+        const double int8Seconds = measureSeconds([&]
+        {
+            runAll(int8Outputs, [&](const PixelBatch& x) { return QuantizedBatchNeuralNetwork(x, quantized); });
+        });
+
+        report.fp32SamplesPerSecond = report.sampleCount / fp32Seconds;
+        report.int8SamplesPerSecond = report.sampleCount / int8Seconds;
+
+        int fp32Correct{};
+        int int8Correct{};
+        const int batchCount = static_cast<int>(fp32Outputs.size());
+        for (int batch = 0; batch < batchCount; ++batch)
+        {
+            const BatchNeuralNetworkOutput& fp32 = fp32Outputs[batch];
+            const BatchNeuralNetworkOutput& int8 = int8Outputs[batch];
+            for (int i = 0; i < fp32.y2.rows(); ++i)
+            {
+                const int label = labels[static_cast<size_t>(batch) * batchSize + i];
+                const int fp32Label = fp32.maxIndex(i);
+                const int int8Label = int8.maxIndex(i);
+
+                if (fp32Label == label) fp32Correct++;
+                if (int8Label == label) int8Correct++;
+                if (fp32Label != int8Label) report.disagreementCount++;
+
+                for (int j = 0; j < fp32.y2.cols(); ++j)
+                {
+                    report.maxProbabilityError = std::max(report.maxProbabilityError, std::abs(fp32.y2[i][j] - int8.y2[i][j]));
+                }
+            }
+        }
+
+        report.fp32Accuracy = static_cast<float>(fp32Correct) / report.sampleCount;
+        report.int8Accuracy = static_cast<float>(int8Correct) / report.sampleCount;
+        return report;
+    }
+}
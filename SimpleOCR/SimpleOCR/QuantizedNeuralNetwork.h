@@ -0,0 +1,68 @@
+﻿#pragma once
+#include "DatasetImage.h"
+#include "NeuralNetwork.h"
+
+namespace ocr
+{
+    /// @brief 第 1 層の重みを int8 に量子化したパラメータ
+    /// @details 推論の時間の大半を占める w1 だけを量子化し、小さい w2 とバイアスは float のまま持つ
+    struct QuantizedNeuralNetworkParameters
+    {
+        int inputCount{};
+
+        int midCount{};
+
+        Array<int8_t> w1{}; // PackQuantizedGemmB() で詰めた [入力ノード数][中間ノード数]
+
+        Array<float> w1Scales{}; // [中間ノード数] 列ごとの倍率 (w1 ≈ 量子化値 * 倍率)
+
+        Array<float> b1{}; // [中間ノード数]
+
+        Matrix w2{}; // [中間ノード数][出力ノード数]
+
+        Array<float> b2{}; // [出力ノード数]
+    };
+
+    /// @brief 学習済みのパラメータを量子化する (学習後に 1 回だけ行う)
+    /// @details w1 の各列の最大の絶対値を ±quantizedGemmWeightLimit に対応させる対称量子化
+    QuantizedNeuralNetworkParameters QuantizeNeuralNetwork(const NeuralNetworkParameters& params);
+
+    /// @brief uint8 の画素と int8 の w1 を int32 で積和し、倍率を掛けて float に戻してから残りの層を計算する
+    BatchNeuralNetworkOutput QuantizedBatchNeuralNetwork(const PixelBatch& x, const QuantizedNeuralNetworkParameters& params);
+
+    /// @brief QuantizedBatchNeuralNetwork() の結果を output に書き込む (形が同じなら再確保しない)
+    /// @param accumulator 第 1 層の int32 の積和を置く作業領域
+    void QuantizedBatchNeuralNetwork(const PixelBatch& x,
+                                     const QuantizedNeuralNetworkParameters& params,
+                                     BatchNeuralNetworkOutput& output,
+                                     Array<int32_t>& accumulator);
+
+    struct QuantizationReport
+    {
+        int sampleCount{};
+
+        float fp32Accuracy{};
+
+        float int8Accuracy{};
+
+        /// @brief 予測したラベルが float の推論と異なる画像の数
+        int disagreementCount{};
+
+        /// @brief 出力の確率の差の絶対値の最大値
+        float maxProbabilityError{};
+
+        double fp32SamplesPerSecond{};
+
+        double int8SamplesPerSecond{};
+
+        size_t fp32W1Bytes{};
+
+        size_t int8W1Bytes{};
+    };
+
+    /// @brief 同じ画像を float と int8 の両方で推論し、正解率と速度の差を調べる
+    QuantizationReport CompareQuantizedInference(const DatasetImageList& images,
+                                                 const Array<uint8_t>& labels,
+                                                 const NeuralNetworkParameters& params,
+                                                 int batchSize);
+}
@@ -0,0 +1,98 @@
+﻿#include "pch.h"
+#include "SparseInput.h"
+
+namespace ocr
+{
+    void SparseRows::clear(int newCols)
+    {
+        cols = newCols;
+        offsets.resize(1);
+        offsets[0] = 0;
+        indices.clear();
+        values.clear();
+    }
+
+    float SparseRows::density(int firstRow, int rowCount) const
+    {
+        if (rowCount <= 0 || cols <= 0) return 0.0f;
+
+        const int nonZeroCount = offsets[firstRow + rowCount] - offsets[firstRow];
+        return static_cast<float>(nonZeroCount) / (static_cast<float>(rowCount) * cols);
+    }
+
+    void SparseRows::transposeRows(int firstRow, int rowCount, SparseRows& result) const
+    {
+        assert(firstRow >= 0 && firstRow + rowCount <= rows());
+
+        const int begin = offsets[firstRow];
+        const int end = offsets[firstRow + rowCount];
+
+        // 列ごとの要素数を数えて (計数ソート) 転置後の各行の先頭を決める
+        result.cols = rowCount;
+        result.offsets.assign(cols + 1, 0);
+        for (int p = begin; p < end; ++p)
+        {
+            ++result.offsets[indices[p] + 1];
+        }
+
+        for (int i = 0; i < cols; ++i)
+        {
+            result.offsets[i + 1] += result.offsets[i];
+        }
+
+        // 要素数はバッチごとに変わるので、最初に密な場合の大きさまで確保して以降の再確保を避ける
+        const size_t capacity = static_cast<size_t>(rowCount) * cols;
+        result.indices.reserve(capacity);
+        result.values.reserve(capacity);
+
+        // offsets[column] を書き込み位置として使い、行の昇順に詰めていく
+        result.indices.resize(end - begin);
+        result.values.resize(end - begin);
+        for (int row = 0; row < rowCount; ++row)
+        {
+            for (int p = offsets[firstRow + row]; p < offsets[firstRow + row + 1]; ++p)
+            {
+                const int destination = result.offsets[indices[p]]++;
+                result.indices[destination] = row;
+                result.values[destination] = values[p];
+            }
+        }
+
+        // 書き込み位置は次の行の先頭まで進んでいるので、1 つずらして戻す
+        for (int i = cols; i > 0; --i)
+        {
+            result.offsets[i] = result.offsets[i - 1];
+        }
+
+        result.offsets[0] = 0;
+    }
+
+    ActivePixelIndex::ActivePixelIndex(const DatasetImageList& images) :
+        m_pixelCount(images.property().pixelCount())
+    {
+        if (m_pixelCount > std::numeric_limits<uint16_t>::max() + 1)
+        {
+            throw std::invalid_argument("Image is too large for 16-bit pixel indices.");
+        }
+
+        m_offsets.reserve(images.size() + 1);
+        for (size_t i = 0; i < images.size(); ++i)
+        {
+            const DatasetImage image = images[i];
+            for (int pixel = 0; pixel < m_pixelCount; ++pixel)
+            {
+                if (image[pixel] != 0) m_pixels.push_back(static_cast<uint16_t>(pixel));
+            }
+
+            m_offsets.push_back(static_cast<uint32_t>(m_pixels.size()));
+        }
+    }
+
+    float ActivePixelIndex::density() const
+    {
+        const size_t imageCount = m_offsets.size() - 1;
+        if (imageCount == 0 || m_pixelCount == 0) return 1.0f;
+
+        return static_cast<float>(m_pixels.size()) / (static_cast<float>(imageCount) * m_pixelCount);
+    }
+}
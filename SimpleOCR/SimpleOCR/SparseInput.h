@@ -0,0 +1,87 @@
+﻿#pragma once
+#include <span>
+
+#include "DatasetImage.h"
+
+namespace ocr
+{
+    /// @brief 入力の非ゼロ要素の割合がこれ未満なら、第 1 層を疎なカーネルで計算する
+    /// @details 100 x 784 のバッチで第 1 層の順伝搬と dW1 (疎な転置を含む) を測ると、密な GEMM との交点は 0.35 前後。
+    /// 測定のばらつきと AVX2 での疎なカーネルの幅の狭さを見込んで低めにしている
+    constexpr float sparseInputDensityThreshold = 0.25f;
+
+    inline bool PreferSparseInput(float density)
+    {
+        return density < sparseInputDensityThreshold;
+    }
+
+    /// @brief 行ごとの非ゼロ要素だけを持つ行列 (CSR 形式)
+    /// @details 行の非ゼロ要素は列番号の昇順に並べる。clear() しても確保済みの容量は保たれる
+    struct SparseRows
+    {
+        int cols{};
+
+        Array<int> offsets{0}; // [行数 + 1] i 行目の非ゼロ要素は [offsets[i], offsets[i + 1])
+
+        Array<int> indices{}; // 非ゼロ要素の列番号
+
+        Array<float> values{};
+
+        int rows() const
+        {
+            return static_cast<int>(offsets.size()) - 1;
+        }
+
+        void clear(int newCols);
+
+        /// @brief 現在の行に非ゼロ要素を追加する (列番号の昇順に呼ぶ)
+        void push(int index, float value)
+        {
+            indices.push_back(index);
+            values.push_back(value);
+        }
+
+        /// @brief 現在の行を閉じて次の行に進む
+        void endRow()
+        {
+            offsets.push_back(static_cast<int>(indices.size()));
+        }
+
+        /// @brief [firstRow, firstRow + rowCount) 行のうち非ゼロ要素の割合
+        float density(int firstRow, int rowCount) const;
+
+        /// @brief [firstRow, firstRow + rowCount) 行を転置して result に書き込む ([cols] 行 x [rowCount] 列)
+        void transposeRows(int firstRow, int rowCount, SparseRows& result) const;
+    };
+
+    /// @brief データセットの画像ごとの非ゼロ画素の番号
+    /// @details 一度だけ作ってデータセットと一緒に保持し、バッチを作るたびに画像を走査し直さない
+    class ActivePixelIndex
+    {
+    public:
+        ActivePixelIndex() = default;
+
+        explicit ActivePixelIndex(const DatasetImageList& images);
+
+        bool empty() const
+        {
+            return m_offsets.size() <= 1;
+        }
+
+        /// @brief image 番目の画像の非ゼロ画素の番号 (昇順)
+        std::span<const uint16_t> operator[](size_t image) const
+        {
+            return {m_pixels.data() + m_offsets[image], m_pixels.data() + m_offsets[image + 1]};
+        }
+
+        /// @brief データセット全体で非ゼロ画素が占める割合
+        float density() const;
+
+    private:
+        Array<uint32_t> m_offsets{0};
+
+        Array<uint16_t> m_pixels{};
+
+        int m_pixelCount{};
+    };
+}
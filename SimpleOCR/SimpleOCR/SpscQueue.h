@@ -0,0 +1,70 @@
+﻿#pragma once
+#include <array>
+#include <atomic>
+
+namespace ocr
+{
+    /// @brief 生産者 1 スレッド、消費者 1 スレッド用の固定長ロックフリーキュー
+    /// @details push と pop はロックを取らない。空や満杯で待つときは C++20 の atomic wait を使い、
+    /// 相手側がインデックスを進めるまでスピンせずに眠る。
+    template <class T, size_t Capacity>
+    class SpscQueue
+    {
+        // インデックスが 2^32 で一周しても剰余が連続するように 2 の累乗に限る
+        static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two.");
+
+    public:
+        /// @brief 満杯なら false を返す (生産者スレッドからのみ呼ぶ)
+        bool tryPush(const T& value)
+        {
+            const uint32_t tail = m_tail.load(std::memory_order_relaxed);
+            if (tail - m_head.load(std::memory_order_acquire) == Capacity) return false;
+
+            m_items[tail % Capacity] = value;
+            m_tail.store(tail + 1, std::memory_order_release);
+            m_tail.notify_one();
+            return true;
+        }
+
+        /// @brief 空なら false を返す (消費者スレッドからのみ呼ぶ)
+        bool tryPop(T& value)
+        {
+            const uint32_t head = m_head.load(std::memory_order_relaxed);
+            if (head == m_tail.load(std::memory_order_acquire)) return false;
+
+            value = m_items[head % Capacity];
+            m_head.store(head + 1, std::memory_order_release);
+            m_head.notify_one();
+            return true;
+        }
+
+        void push(const T& value)
+        {
+            while (not tryPush(value))
+            {
+                // 消費者が head を進めるまで待つ
+                m_head.wait(m_tail.load(std::memory_order_relaxed) - Capacity, std::memory_order_acquire);
+            }
+        }
+
+        T pop()
+        {
+            T value;
+            while (not tryPop(value))
+            {
+                // 生産者が tail を進めるまで待つ
+                m_tail.wait(m_head.load(std::memory_order_relaxed), std::memory_order_acquire);
+            }
+
+            return value;
+        }
+
+    private:
+        // 生産者と消費者が書くインデックスは別のキャッシュラインに置く
+        alignas(64) std::atomic<uint32_t> m_head{};
+
+        alignas(64) std::atomic<uint32_t> m_tail{};
+
+        std::array<T, Capacity> m_items{};
+    };
+}
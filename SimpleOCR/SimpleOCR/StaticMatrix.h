@@ -0,0 +1,76 @@
+﻿#pragma once
+#include "Matrix.h"
+
+namespace ocr
+{
+    /// @brief 形をコンパイル時に決めた行優先の行列
+    /// @details ループの回数が定数になるので、コンパイラが展開とベクトル化をできる。形の検査は Matrix との変換時だけ行う
+    /// @note 要素を直接持つので、大きな行列 (784 x 128 など) はスタックに置かず std::make_unique で確保すること
+    template <int Rows, int Cols>
+    struct StaticMatrix
+    {
+        static_assert(Rows > 0 && Cols > 0, "Matrix dimensions must be positive.");
+
+        static constexpr int rowCount = Rows;
+
+        static constexpr int colCount = Cols;
+
+        static constexpr int rows()
+        {
+            return Rows;
+        }
+
+        static constexpr int cols()
+        {
+            return Cols;
+        }
+
+        const std::array<float, Rows * Cols>& data() const
+        {
+            return m_data;
+        }
+
+        std::array<float, Rows * Cols>& data()
+        {
+            return m_data;
+        }
+
+        float* operator[](int index)
+        {
+            return &m_data[index * Cols];
+        }
+
+        const float* operator[](int index) const
+        {
+            return &m_data[index * Cols];
+        }
+
+        /// @brief 同じ形の Matrix から要素をコピーする
+        void assign(const Matrix& matrix)
+        {
+            if (matrix.rows() != Rows || matrix.cols() != Cols)
+            {
+                throw std::invalid_argument("Matrix dimensions do not match the static shape.");
+            }
+
+            for (int i = 0; i < Rows; ++i)
+            {
+                std::copy_n(matrix[i], Cols, (*this)[i]);
+            }
+        }
+
+        Matrix toMatrix() const
+        {
+            Matrix result(Rows, Cols);
+            for (int i = 0; i < Rows; ++i)
+            {
+                std::copy_n((*this)[i], Cols, result[i]);
+            }
+
+            return result;
+        }
+
+    private:
+        alignas(64) std::array<float, Rows * Cols> m_data{};
+    };
+}
@@ -0,0 +1,245 @@
+﻿#pragma once
+#include "NeuralNetwork.h"
+#include "StaticMatrix.h"
+
+namespace ocr
+{
+    struct NetworkTopology
+    {
+        int inputCount;
+
+        int midCount;
+
+        int outputCount;
+    };
+
+    /// @brief EntryPoint が学習する MNIST のネットワーク。Matrix の形がこれと一致する層は、形を固定した実装で計算する
+    constexpr NetworkTopology mnistTopology{
+        .inputCount = 28 * 28,
+        .midCount = 128,
+        .outputCount = 10
+    };
+
+    /// @brief 全結合層 a[Out] = x[In] * w[In][Out] + b[Out]
+    /// @param w 行優先の [In][Out] (Matrix や StaticMatrix の先頭)
+    template <int In, int Out>
+    void StaticDenseLayer(const float* x, const float* w, const float* b, float* a)
+    {
+        // Out 個の和をレジスタに置いたまま、w を行方向に連続して読む
+        float sum[Out];
+        for (int j = 0; j < Out; ++j)
+        {
+            sum[j] = b[j];
+        }
+
+        for (int i = 0; i < In; ++i)
+        {
+            // 入力層では画素の大半が 0 なので、その行の読み込みを飛ばす
+            const float xi = x[i];
+            if (xi == 0.0f) continue;
+
+            const float* row = w + i * Out;
+            for (int j = 0; j < Out; ++j)
+            {
+                sum[j] += xi * row[j];
+            }
+        }
+
+        for (int j = 0; j < Out; ++j)
+        {
+            a[j] = sum[j];
+        }
+    }
+
+    template <int N>
+    void StaticSigmoid(float* a)
+    {
+        for (int i = 0; i < N; ++i)
+        {
+            a[i] = 1.0f / (1.0f + std::exp(-a[i]));
+        }
+    }
+
+    template <int N>
+    void StaticSoftmax(float* a)
+    {
+        float alpha = a[0];
+        for (int i = 1; i < N; ++i)
+        {
+            alpha = std::max(alpha, a[i]);
+        }
+
+        float sum{};
+        for (int i = 0; i < N; ++i)
+        {
+            a[i] = std::exp(a[i] - alpha);
+            sum += a[i];
+        }
+
+        const float inverse = 1.0f / sum;
+        for (int i = 0; i < N; ++i)
+        {
+            a[i] *= inverse;
+        }
+    }
+
+    /// @brief softmax とクロスエントロピーの逆伝搬 dA2 = (Y2 - T) / batches
+    /// @return このサンプルのクロスエントロピー誤差
+    template <int Out>
+    float StaticOutputDeltas(const float* y2, int trueLabel, float batches, float* da2)
+    {
+        assert(trueLabel >= 0 && trueLabel < Out);
+
+        for (int j = 0; j < Out; ++j)
+        {
+            const float trueY = j == trueLabel ? 1.0f : 0.0f;
+            da2[j] = (y2[j] - trueY) / batches;
+        }
+
+        return -std::log(y2[trueLabel] + 1e-7f);
+    }
+
+    /// @brief result[Cols][Rows] = a[Rows][Cols]^T
+    template <int Rows, int Cols>
+    void StaticTranspose(const float* a, float* result)
+    {
+        for (int i = 0; i < Rows; ++i)
+        {
+            for (int j = 0; j < Cols; ++j)
+            {
+                result[j * Rows + i] = a[i * Cols + j];
+            }
+        }
+    }
+
+    /// @brief sigmoid の逆伝搬 dA1 = (dA2 * W2^T) ⊙ Y1 ⊙ (1 - Y1)
+    /// @param w2Transposed 行優先の W2^T [Out][Mid]。Mid 個の和を連続した行から足し込めるように転置して渡す
+    template <int Mid, int Out>
+    void StaticHiddenDeltas(const float* da2, const float* w2Transposed, const float* y1, float* da1)
+    {
+        float sum[Mid]{};
+        for (int j = 0; j < Out; ++j)
+        {
+            const float delta = da2[j];
+            const float* row = w2Transposed + j * Mid;
+            for (int i = 0; i < Mid; ++i)
+            {
+                sum[i] += delta * row[i];
+            }
+        }
+
+        for (int i = 0; i < Mid; ++i)
+        {
+            da1[i] = sum[i] * y1[i] * (1.0f - y1[i]);
+        }
+    }
+
+    /// @brief c[Rows][Cols] += a[Rows]^T * b[Cols] (勾配 dW = x^T * dA の 1 サンプル分)
+    /// @details a が 0 の行は変わらないので飛ばす (入力層では画素の大半が 0)
+    template <int Rows, int Cols>
+    void StaticAddOuterProduct(const float* a, const float* b, float* c)
+    {
+        for (int i = 0; i < Rows; ++i)
+        {
+            const float ai = a[i];
+            if (ai == 0.0f) continue;
+
+            float* row = c + i * Cols;
+            for (int j = 0; j < Cols; ++j)
+            {
+                row[j] += ai * b[j];
+            }
+        }
+    }
+
+    /// @brief NeuralNetworkParameters の形を固定した版
+    /// @note 第 1 層の重みを直接持つので std::make_unique で確保すること
+    template <int In, int Mid, int Out>
+    struct StaticNeuralNetworkParameters
+    {
+        StaticMatrix<In, Mid> w1;
+
+        std::array<float, Mid> b1{};
+
+        StaticMatrix<Mid, Out> w2;
+
+        std::array<float, Out> b2{};
+
+        /// @brief 同じ形の NeuralNetworkParameters から値をコピーする
+        void assign(const NeuralNetworkParameters& params)
+        {
+            if (params.b1.size() != Mid || params.b2.size() != Out)
+            {
+                throw std::invalid_argument("Bias sizes do not match the static shape.");
+            }
+
+            w1.assign(params.w1);
+            std::copy(params.b1.begin(), params.b1.end(), b1.begin());
+            w2.assign(params.w2);
+            std::copy(params.b2.begin(), params.b2.end(), b2.begin());
+        }
+    };
+
+    template <int Mid, int Out>
+    struct StaticNeuralNetworkOutput
+    {
+        std::array<float, Mid> y1{};
+
+        std::array<float, Out> y2{};
+
+        int maxIndex() const
+        {
+            return static_cast<int>(std::max_element(y2.begin(), y2.end()) - y2.begin());
+        }
+    };
+
+    /// @brief 1 サンプルの順伝搬 (NeuralNetwork() と同じ計算を、形を固定して行う)
+    template <int In, int Mid, int Out>
+    void StaticNeuralNetwork(const float* x,
+                             const StaticNeuralNetworkParameters<In, Mid, Out>& params,
+                             StaticNeuralNetworkOutput<Mid, Out>& output)
+    {
+        StaticDenseLayer<In, Mid>(x, params.w1[0], params.b1.data(), output.y1.data());
+        StaticSigmoid<Mid>(output.y1.data());
+
+        StaticDenseLayer<Mid, Out>(output.y1.data(), params.w2[0], params.b2.data(), output.y2.data());
+        StaticSoftmax<Out>(output.y2.data());
+    }
+
+    /// @brief 1 サンプルを逆伝搬し、勾配を gradient に足し込む (BackPropagation() と AccumulateGradients() に相当)
+    /// @return このサンプルのクロスエントロピー誤差
+    template <int In, int Mid, int Out>
+    float StaticBackPropagation(const float* x,
+                                int trueLabel,
+                                float batches,
+                                const StaticNeuralNetworkParameters<In, Mid, Out>& params,
+                                StaticNeuralNetworkParameters<In, Mid, Out>& gradient)
+    {
+        StaticNeuralNetworkOutput<Mid, Out> output{};
+        StaticNeuralNetwork(x, params, output);
+
+        float da2[Out];
+        const float crossEntropyError = StaticOutputDeltas<Out>(output.y2.data(), trueLabel, batches, da2);
+
+        float w2Transposed[Out * Mid];
+        StaticTranspose<Mid, Out>(params.w2[0], w2Transposed);
+
+        float da1[Mid];
+        StaticHiddenDeltas<Mid, Out>(da2, w2Transposed, output.y1.data(), da1);
+
+        StaticAddOuterProduct<Mid, Out>(output.y1.data(), da2, gradient.w2[0]);
+        StaticAddOuterProduct<In, Mid>(x, da1, gradient.w1[0]);
+
+        for (int j = 0; j < Out; ++j)
+        {
+            gradient.b2[j] += da2[j];
+        }
+
+        for (int j = 0; j < Mid; ++j)
+        {
+            gradient.b1[j] += da1[j];
+        }
+
+        return crossEntropyError;
+    }
+}
@@ -0,0 +1,117 @@
+﻿#include "pch.h"
+#include "ThreadPool.h"
+
+namespace ocr
+{
+    ThreadPool::ThreadPool(int threadCount)
+    {
+        if (threadCount <= 0)
+        {
+            throw std::invalid_argument("Thread count must be positive.");
+        }
+
+        for (int i = 1; i < threadCount; ++i)
+        {
+            m_threads.emplace_back([this]() { workerLoop(); });
+        }
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stopping = true;
+        }
+
+        m_wakeUp.notify_all();
+
+        for (auto& thread : m_threads)
+        {
+            thread.join();
+        }
+    }
+
+    void ThreadPool::run(int count, TaskFunction task, const void* context)
+    {
+        if (count <= 0) return;
+
+        if (m_threads.empty() || count == 1)
+        {
+            for (int i = 0; i < count; ++i)
+            {
+                task(context, i);
+            }
+
+            return;
+        }
+
+        {
+            std::lock_guard lock(m_mutex);
+            m_task = task;
+            m_taskContext = context;
+            m_taskCount = count;
+            m_nextIndex = 0;
+            m_activeWorkers = static_cast<int>(m_threads.size());
+            m_exception = nullptr;
+            ++m_generation;
+        }
+
+        m_wakeUp.notify_all();
+
+        runTasks();
+
+        std::unique_lock lock(m_mutex);
+        m_finished.wait(lock, [this]() { return m_activeWorkers == 0; });
+        m_task = nullptr;
+        m_taskContext = nullptr;
+
+        if (m_exception)
+        {
+            std::rethrow_exception(std::exchange(m_exception, nullptr));
+        }
+    }
+
+    void ThreadPool::workerLoop()
+    {
+        uint64_t seenGeneration{};
+        while (true)
+        {
+            {
+                std::unique_lock lock(m_mutex);
+                m_wakeUp.wait(lock, [&]() { return m_stopping || m_generation != seenGeneration; });
+                if (m_stopping) return;
+
+                seenGeneration = m_generation;
+            }
+
+            runTasks();
+
+            {
+                std::lock_guard lock(m_mutex);
+                if (--m_activeWorkers == 0)
+                {
+                    m_finished.notify_one();
+                }
+            }
+        }
+    }
+
+    void ThreadPool::runTasks()
+    {
+        while (true)
+        {
+            const int index = m_nextIndex.fetch_add(1);
+            if (index >= m_taskCount) return;
+
+            try
+            {
+                m_task(m_taskContext, index);
+            }
+            catch (...)
+            {
+                std::lock_guard lock(m_mutex);
+                if (not m_exception) m_exception = std::current_exception();
+            }
+        }
+    }
+}
@@ -0,0 +1,68 @@
+﻿#pragma once
+#include "TY/Array.h"
+
+namespace ocr
+{
+    using namespace TY;
+
+    /// @brief 常駐するワーカースレッドで添字ごとの処理を並列に実行する
+    class ThreadPool
+    {
+    public:
+        /// @param threadCount 呼び出し元スレッドを含めた並列数
+        explicit ThreadPool(int threadCount);
+
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        int threadCount() const
+        {
+            return static_cast<int>(m_threads.size()) + 1;
+        }
+
+        /// @brief func(index) を index = 0 .. count - 1 について実行し、すべて終わるまで待つ
+        /// @note 呼び出し元スレッドも処理に参加する。タスク内の例外は呼び出し元で再送出される
+        /// @details func は参照で渡すだけで、std::function のようにキャプチャを複製しない (ヒープ確保をしない)
+        template <class F>
+        void parallelFor(int count, const F& func)
+        {
+            run(count, [](const void* context, int index) { (*static_cast<const F*>(context))(index); }, &func);
+        }
+
+    private:
+        using TaskFunction = void (*)(const void* context, int index);
+
+        void run(int count, TaskFunction task, const void* context);
+
+        void workerLoop();
+
+        void runTasks();
+
+        Array<std::thread> m_threads{};
+
+        std::mutex m_mutex{};
+
+        std::condition_variable m_wakeUp{};
+
+        std::condition_variable m_finished{};
+
+        TaskFunction m_task{};
+
+        const void* m_taskContext{};
+
+        int m_taskCount{};
+
+        std::atomic<int> m_nextIndex{};
+
+        int m_activeWorkers{};
+
+        uint64_t m_generation{};
+
+        bool m_stopping{};
+
+        std::exception_ptr m_exception{};
+    };
+}
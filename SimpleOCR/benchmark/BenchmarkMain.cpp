@@ -0,0 +1,673 @@
+﻿#include "pch.h"
+#include "MicroBenchmark.h"
+
+#include "Activation.h"
+#include "BackPropagation.h"
+#include "BatchEvaluator.h"
+#include "BatchPrefetcher.h"
+#include "DataParallelTrainer.h"
+#include "DatasetLoader.h"
+#include "GemmKernel.h"
+#include "Gradient.h"
+#include "LinearAlgebraBackend.h"
+#include "NP.h"
+#include "Optimizer.h"
+#include "HalfNeuralNetwork.h"
+#include "QuantizedNeuralNetwork.h"
+#include "SparseInput.h"
+#include "StaticNeuralNetwork.h"
+
+using namespace ocr;
+
+namespace
+{
+    constexpr float learningRate = 0.01f;
+
+    /// @brief 合成したデータセットの非ゼロ画素の割合 (MNIST の学習データとほぼ同じ)
+    constexpr float syntheticPixelDensity = 0.19f;
+
+    struct NetworkShape
+    {
+        const char* name;
+
+        Size imageSize;
+
+        int midCount;
+
+        int outCount;
+
+        int batchSize;
+
+        int imageCount;
+    };
+
+    /// @brief 実際の 784/128/10 と、それを拡大した形
+    constexpr NetworkShape networkShapes[] = {
+        {"mnist", Size{28, 28}, 128, 10, 100, 60000},
+        {"large", Size{64, 48}, 512, 100, 256, 10000},
+    };
+
+    struct Options
+    {
+        std::string jsonFile{};
+
+        std::string filter{};
+
+        std::string shape{};
+
+        std::string datasetDirectory{};
+
+        double minSeconds = 0.2;
+
+        int threadCount = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    };
+
+    /// @brief 1 つの形について、計測で使い回すデータとパラメータ
+    struct Fixture
+    {
+        NetworkShape shape{};
+
+        int inputCount{};
+
+        DatasetImageList images{};
+
+        Array<uint8_t> labels{};
+
+        ActivePixelIndex activePixels{};
+
+        NeuralNetworkParameters params{};
+
+        QuantizedNeuralNetworkParameters quantizedParams{};
+
+        std::array<HalfNeuralNetworkParameters, 2> halfParams{}; // FP16, BF16
+
+        BatchBackPropagationInput batch{};
+
+        Array<float> x{}; // 先頭の画像 (1 サンプルの関数用)
+
+        size_t paramCount() const
+        {
+            return params.w1.data().size() + params.b1.size() + params.w2.data().size() + params.b2.size();
+        }
+
+        double forwardFlops() const
+        {
+            return 2.0 * (static_cast<double>(inputCount) * shape.midCount + static_cast<double>(shape.midCount) * shape.outCount);
+        }
+
+        /// @brief dW1 = x^T * dA1, dW2 = y1^T * dA2, dY1 = dA2 * W2^T
+        double backwardFlops() const
+        {
+            return 2.0 * (static_cast<double>(inputCount) * shape.midCount + 2.0 * shape.midCount * shape.outCount);
+        }
+    };
+
+    void printUsage()
+    {
+        std::cerr <<
+            "Usage: SimpleOCRBenchmark [options]\n"
+            "  --json FILE        write results as JSON\n"
+            "  --filter TEXT      run only benchmarks whose name contains TEXT\n"
+            "  --shape NAME       run only one shape (mnist, large)\n"
+            "  --min-time SEC     minimum measured time per benchmark (default 0.2)\n"
+            "  --threads N        threads for the trainer and evaluator\n"
+            "  --dataset DIR      use MNIST train images from DIR for the mnist shape\n";
+    }
+
+    std::optional<Options> parseOptions(int argc, char** argv)
+    {
+        Options options{};
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string_view arg = argv[i];
+            const bool hasValue = i + 1 < argc;
+            if (arg == "--json" && hasValue) options.jsonFile = argv[++i];
+            else if (arg == "--filter" && hasValue) options.filter = argv[++i];
+            else if (arg == "--shape" && hasValue) options.shape = argv[++i];
+            else if (arg == "--min-time" && hasValue) options.minSeconds = std::stod(argv[++i]);
+            else if (arg == "--threads" && hasValue) options.threadCount = std::max(1, std::stoi(argv[++i]));
+            else if (arg == "--dataset" && hasValue) options.datasetDirectory = argv[++i];
+            else return std::nullopt;
+        }
+
+        return options;
+    }
+
+    DatasetImageList makeSyntheticImages(const NetworkShape& shape, std::mt19937& random)
+    {
+        const DatasetImageProperty property{.size = shape.imageSize};
+        std::uniform_real_distribution<float> uniform{0.0f, 1.0f};
+        std::uniform_int_distribution<int> pixel{1, 255};
+
+        Array<uint8_t> pixels(static_cast<size_t>(shape.imageCount) * property.pixelCount());
+        for (auto& value : pixels)
+        {
+            value = uniform(random) < syntheticPixelDensity ? static_cast<uint8_t>(pixel(random)) : 0;
+        }
+
+        return DatasetImageList::FromPixels(std::move(pixels), property);
+    }
+
+    std::unique_ptr<Fixture> makeFixture(const NetworkShape& shape, const Options& options)
+    {
+        auto fixture = std::make_unique<Fixture>();
+        fixture->shape = shape;
+
+        std::mt19937 random{12345};
+        if (not options.datasetDirectory.empty() && std::string_view{shape.name} == "mnist")
+        {
+            fixture->images = LoadMnistImages(options.datasetDirectory + "/train-images.idx3-ubyte");
+            fixture->labels = LoadMnistLabels(options.datasetDirectory + "/train-labels.idx1-ubyte", fixture->images);
+            fixture->shape.imageCount = static_cast<int>(fixture->images.size());
+        }
+        else
+        {
+            fixture->images = makeSyntheticImages(shape, random);
+            fixture->labels.resize(shape.imageCount);
+            for (auto& label : fixture->labels)
+            {
+                label = static_cast<uint8_t>(random() % shape.outCount);
+            }
+        }
+
+        const int inputCount = fixture->images.property().pixelCount();
+        fixture->inputCount = inputCount;
+        fixture->activePixels = ActivePixelIndex{fixture->images};
+
+        std::uniform_real_distribution<float> weight{-1.0f, 1.0f};
+        NeuralNetworkParameters& params = fixture->params;
+        params.w1 = Matrix(inputCount, shape.midCount);
+        params.b1 = Array<float>(shape.midCount);
+        params.w2 = Matrix(shape.midCount, shape.outCount);
+        params.b2 = Array<float>(shape.outCount);
+        const auto fillRandom = [&](auto& values)
+        {
+            for (auto& value : values)
+            {
+                value = weight(random) * 0.1f;
+            }
+        };
+
+        fillRandom(params.w1.data());
+        fillRandom(params.b1);
+        fillRandom(params.w2.data());
+        fillRandom(params.b2);
+
+        fixture->quantizedParams = QuantizeNeuralNetwork(params);
+        fixture->halfParams[0] = MakeHalfNeuralNetwork(params, HalfFormat::Float16);
+        fixture->halfParams[1] = MakeHalfNeuralNetwork(params, HalfFormat::BFloat16);
+
+        // 先頭のバッチを float の行列として作る (疎な入力も付けて、学習と同じ経路を通す)
+        BatchBackPropagationInput& batch = fixture->batch;
+        batch.x = Matrix(shape.batchSize, inputCount);
+        batch.trueLabels.resize(shape.batchSize);
+        batch.batches = shape.batchSize;
+        batch.sparseX.clear(inputCount);
+        for (int i = 0; i < shape.batchSize; ++i)
+        {
+            const DatasetImage image = fixture->images[i];
+            for (int j = 0; j < inputCount; ++j)
+            {
+                batch.x[i][j] = image[j] / 255.0f;
+                if (image[j] != 0) batch.sparseX.push(j, batch.x[i][j]);
+            }
+
+            batch.sparseX.endRow();
+            batch.trueLabels[i] = fixture->labels[i];
+        }
+
+        fixture->x.assign(batch.x[0], batch.x[0] + inputCount);
+        return fixture;
+    }
+
+    /// @brief 1 つの形について、NP の各関数、順伝搬、逆伝搬、勾配の更新、学習ステップ、1 エポックの計測を並べる
+    Array<BenchmarkCase> makeBenchmarkCases(Fixture& f, const Options& options)
+    {
+        const std::string shape = f.shape.name;
+        const double in = f.inputCount;
+        const double mid = f.shape.midCount;
+        const double batchSize = f.shape.batchSize;
+        const double out = f.shape.outCount;
+        const double paramBytes = static_cast<double>(f.paramCount()) * sizeof(float);
+        const double paramFlops = static_cast<double>(f.paramCount());
+
+        // 計測する関数の戻り値は共有の変数へ書き、最適化で消されないようにする
+        auto vector = std::make_shared<Array<float>>();
+        auto matrix = std::make_shared<Matrix>();
+        auto scalar = std::make_shared<float>();
+
+        const Array<float> midA(f.shape.midCount, 0.5f);
+        const Array<float> midB(f.shape.midCount, 0.25f);
+        const Matrix w1Transposed = f.params.w1.transposed();
+        const Matrix hidden(f.shape.batchSize, f.shape.midCount);
+        const PixelBatch pixels = f.images.batch(0, f.shape.batchSize);
+
+        Array<BenchmarkCase> cases{};
+        const auto add = [&](std::string name, double flops, double bytes, double samples, std::function<void()> run)
+        {
+            cases.push_back(BenchmarkCase{
+                .name = std::move(name),
+                .shape = shape,
+                .flopsPerOp = flops,
+                .bytesPerOp = bytes,
+                .samplesPerOp = samples,
+                .run = std::move(run)
+            });
+        };
+
+        // ----------------------------------------------- NP
+
+        add("NP::Subtract", mid, 12 * mid, 0, [=] { *vector = NP::Subtract(midA, midB); });
+        add("NP::Divide", mid, 8 * mid, 0, [=] { *vector = NP::Divide(midA, 3.0f); });
+        add("NP::DorProduct", 2 * mid, 8 * mid, 0, [=] { *scalar = NP::DorProduct(midA, midB); });
+        add("NP::HadamardProduct", mid, 12 * mid, 0, [=] { *vector = NP::HadamardProduct(midA, midB); });
+
+        // 逆伝搬の要素ごとの演算の連鎖: 途中の配列を作る NP 関数の組み合わせと、1 回のループにまとめた式
+        add("NP chain: (a - b) / n", 2 * mid, 20 * mid, 0, [=]
+        {
+            *vector = NP::Divide(NP::Subtract(midA, midB), 3.0f);
+        });
+        add("NP::Lazy: (a - b) / n", 2 * mid, 12 * mid, 0, [=]
+        {
+            NP::Evaluate((NP::Lazy(midA) - NP::Lazy(midB)) / 3.0f, *vector);
+        });
+        add("NP chain: a * b * (1 - b)", 3 * mid, 36 * mid, 0, [=]
+        {
+            *vector = NP::HadamardProduct(midA, NP::HadamardProduct(midB, NP::Subtract(Array<float>(midB.size(), 1.0f), midB)));
+        });
+        add("NP::Lazy: a * b * (1 - b)", 3 * mid, 12 * mid, 0, [=]
+        {
+            const NP::ArrayExpression b = NP::Lazy(midB);
+            NP::Evaluate(NP::Lazy(midA) * (b * (1.0f - b)), *vector);
+        });
+        add("NP::OuterProduct", in * mid, 4 * (in + mid + in * mid), 0, [=, &f]
+        {
+            *matrix = NP::OuterProduct(f.x, midA);
+        });
+        add("NP::VecMat", 2 * in * mid, 4 * (in + in * mid + mid), 0, [=, &f]
+        {
+            *matrix = NP::VecMat(f.x, f.params.w1);
+        });
+        add("NP::MatVec", 2 * in * mid, 4 * (in + in * mid + mid), 0, [=, &f]
+        {
+            *matrix = NP::MatVec(w1Transposed, f.x);
+        });
+        add("NP::GEMM (vector)", 2 * in * mid, 4 * (in + in * mid + mid), 0, [=, &f]
+        {
+            vector->assign(f.shape.midCount, 0.0f);
+            NP::GEMM(f.x, f.params.w1, *vector);
+        });
+        add("NP::MatMul", 2 * batchSize * in * mid, 4 * (batchSize * in + in * mid + batchSize * mid), 0, [=, &f]
+        {
+            *matrix = NP::MatMul(f.batch.x, f.params.w1);
+        });
+        add("NP::GEMM (matrix)", 2 * batchSize * in * mid, 4 * (batchSize * in + in * mid + 2 * batchSize * mid), 0, [=, &f]
+        {
+            matrix->resize(f.shape.batchSize, f.shape.midCount);
+            NP::GEMM(f.batch.x, f.params.w1, *matrix);
+        });
+        add("NP::GEMM (uint8)", 2 * batchSize * in * mid, batchSize * in + 4 * (in * mid + 2 * batchSize * mid), 0, [=, &f]
+        {
+            matrix->resize(f.shape.batchSize, f.shape.midCount);
+            NP::GEMM(pixels, 1.0f / 255.0f, f.params.w1, *matrix);
+        });
+
+        // バックエンドごとの順伝搬 (X * W1) と逆伝搬 (X^T * dA1) の行列積。このビルドで使えるものだけを測る
+        for (const LinearAlgebraBackend backend : {LinearAlgebraBackend::Scalar, LinearAlgebraBackend::Simd, LinearAlgebraBackend::Blas})
+        {
+            if (not IsLinearAlgebraBackendAvailable(backend)) continue;
+
+            const std::string suffix = std::string(" (") + LinearAlgebraBackendName(backend) + ")";
+            add("BackendGemm X * W1" + suffix, 2 * batchSize * in * mid, 4 * (batchSize * in + in * mid + 2 * batchSize * mid), 0, [=, &f]
+            {
+                matrix->resize(f.shape.batchSize, f.shape.midCount);
+                BackendGemm(backend, Transpose::No, Transpose::No,
+                            f.shape.batchSize, f.shape.midCount, f.inputCount,
+                            f.batch.x[0], f.inputCount,
+                            f.params.w1[0], f.shape.midCount,
+                            (*matrix)[0], f.shape.midCount);
+            });
+            add("BackendGemm X^T * dA1" + suffix, 2 * batchSize * in * mid, 4 * (batchSize * in + batchSize * mid + 2 * in * mid), 0, [=, &f]
+            {
+                matrix->resize(f.inputCount, f.shape.midCount);
+                BackendGemm(backend, Transpose::Yes, Transpose::No,
+                            f.inputCount, f.shape.midCount, f.shape.batchSize,
+                            f.batch.x[0], f.inputCount,
+                            hidden[0], f.shape.midCount,
+                            (*matrix)[0], f.shape.midCount);
+            });
+        }
+
+        // 重みの行の並べ方ごとの行列積。Padded は W1 と dW1 の行の先頭同士をキャッシュラインの奇数倍だけ離し、
+        // 列方向に読み書きするときに行が L1 の同じセットに集まらないようにする
+        for (const MatrixLayout layout : {MatrixLayout::Packed, MatrixLayout::Padded})
+        {
+            auto w1 = std::make_shared<Matrix>(f.inputCount, f.shape.midCount, layout);
+            auto dw1 = std::make_shared<Matrix>(f.inputCount, f.shape.midCount, layout);
+            for (int i = 0; i < w1->rows(); ++i)
+            {
+                std::copy_n(f.params.w1[i], f.shape.midCount, (*w1)[i]);
+            }
+
+            const std::string suffix = std::string(" (") + MatrixLayoutName(layout) + ")";
+            add("NP::GEMM X * W1" + suffix, 2 * batchSize * in * mid, 4 * (batchSize * in + in * mid + 2 * batchSize * mid), 0, [=, &f]
+            {
+                matrix->resize(f.shape.batchSize, f.shape.midCount);
+                NP::GEMM(f.batch.x, *w1, *matrix);
+            });
+            add("NP::GEMM X^T * dA1 -> dW1" + suffix, 2 * batchSize * in * mid, 4 * (batchSize * in + batchSize * mid + 2 * in * mid), 0, [=, &f]
+            {
+                NP::GEMM(f.batch.x.transposedView(), hidden, *dw1);
+            });
+            add("NP::GEMM dA1 * W1^T" + suffix, 2 * batchSize * in * mid, 4 * (batchSize * mid + in * mid + 2 * batchSize * in), 0, [=, &f]
+            {
+                matrix->resize(f.shape.batchSize, f.inputCount);
+                NP::GEMM(hidden, w1->transposedView(), *matrix);
+            });
+        }
+
+        // 逆伝搬の転置を含む積: 転置した行列を作ってから掛けるものと、転置フラグで元の行列を読むもの
+        const Array<float> outA(f.shape.outCount, 0.125f);
+        add("NP::VecMat (W2.transposed())", 2 * mid * out, 4 * (2 * mid * out + out + mid), 0, [=, &f]
+        {
+            *matrix = NP::VecMat(outA, f.params.w2.transposed());
+        });
+        add("NP::VecMat (W2.transposedView())", 2 * mid * out, 4 * (mid * out + out + mid), 0, [=, &f]
+        {
+            *matrix = NP::VecMat(outA, f.params.w2.transposedView());
+        });
+        add("NP::GEMM X^T * dA1 (transposed())", 2 * batchSize * in * mid, 4 * (2 * batchSize * in + batchSize * mid + 2 * in * mid), 0, [=, &f]
+        {
+            matrix->resize(f.inputCount, f.shape.midCount);
+            NP::GEMM(f.batch.x.transposed(), hidden, *matrix);
+        });
+        add("NP::GEMM X^T * dA1 (transposedView())", 2 * batchSize * in * mid, 4 * (batchSize * in + batchSize * mid + 2 * in * mid), 0, [=, &f]
+        {
+            matrix->resize(f.inputCount, f.shape.midCount);
+            NP::GEMM(f.batch.x.transposedView(), hidden, *matrix);
+        });
+
+        // ミニバッチの前半の行だけを使う積: 行をコピーして切り出すものと、元の行列のビューを渡すもの
+        const int halfBatch = f.shape.batchSize / 2;
+        const double half = halfBatch;
+        add("NP::GEMM X[rows] * W1 (sliceRows())", 2 * half * in * mid, 4 * (2 * half * in + in * mid + 2 * half * mid), 0, [=, &f]
+        {
+            matrix->resize(halfBatch, f.shape.midCount);
+            NP::GEMM(f.batch.x.sliceRows(0, halfBatch), f.params.w1, *matrix);
+        });
+        add("NP::GEMM X[rows] * W1 (rowRange())", 2 * half * in * mid, 4 * (half * in + in * mid + 2 * half * mid), 0, [=, &f]
+        {
+            matrix->resize(halfBatch, f.shape.midCount);
+            NP::GEMM(f.batch.x.rowRange(0, halfBatch), f.params.w1, *matrix);
+        });
+        add("NP::ColumnSum", batchSize * mid, 4 * (batchSize * mid + mid), 0, [=] { *vector = NP::ColumnSum(hidden); });
+        add("NP::ColumnSum (in-place)", batchSize * mid, 4 * (batchSize * mid + mid), 0, [=]
+        {
+            NP::ColumnSum(hidden, *vector);
+        });
+
+        // ----------------------------------------------- 活性化関数と損失
+
+        // A1 と A2 に近い値の行列。毎回コピーしてから書き換える (コピーの分も時間とバイト数に含む)
+        Matrix hiddenA(f.shape.batchSize, f.shape.midCount);
+        Matrix outputA(f.shape.batchSize, f.shape.outCount);
+        Matrix probabilities(f.shape.batchSize, f.shape.outCount);
+        for (auto* values : {&hiddenA.data(), &outputA.data()})
+        {
+            for (size_t i = 0; i < values->size(); ++i)
+            {
+                (*values)[i] = static_cast<float>(static_cast<int>(i * 7919 % 1601) - 800) / 100.0f;
+            }
+        }
+
+        probabilities = outputA;
+        SoftmaxRowsInPlace(probabilities, ActivationMode::Exact);
+
+        for (const ActivationMode mode : {ActivationMode::Exact, ActivationMode::Fast})
+        {
+            const std::string suffix = std::string(" (") + ActivationModeName(mode) + ")";
+            add("SigmoidInPlace" + suffix, batchSize * mid, 12 * batchSize * mid, batchSize, [=]
+            {
+                *matrix = hiddenA;
+                SigmoidInPlace(*matrix, mode);
+            });
+            add("SoftmaxRowsInPlace" + suffix, 3 * batchSize * out, 12 * batchSize * out, batchSize, [=]
+            {
+                *matrix = outputA;
+                SoftmaxRowsInPlace(*matrix, mode);
+            });
+            add("LogSoftmaxRowsInPlace" + suffix, 3 * batchSize * out, 12 * batchSize * out, batchSize, [=]
+            {
+                *matrix = outputA;
+                LogSoftmaxRowsInPlace(*matrix, mode);
+            });
+            add("CrossEntropyError" + suffix, batchSize, 4 * batchSize, batchSize, [=, &f]
+            {
+                *scalar = CrossEntropyError(probabilities, f.batch.trueLabels.data(), mode);
+            });
+        }
+
+        // ----------------------------------------------- 順伝搬
+
+        auto output = std::make_shared<BatchNeuralNetworkOutput>();
+        auto accumulator = std::make_shared<Array<int32_t>>();
+
+        add("NeuralNetwork (CPU, 1 sample)", f.forwardFlops(), 4 * in + paramBytes, 1, [&f]
+        {
+            const NeuralNetworkOutput result = NeuralNetwork(f.x, f.params);
+            assert(not result.y2.empty());
+        });
+        add("BatchNeuralNetwork (float)", batchSize * f.forwardFlops(), 4 * batchSize * in + paramBytes, batchSize, [=, &f]
+        {
+            BatchNeuralNetwork(f.batch.x, 0, f.shape.batchSize, f.params, *output);
+        });
+        add("BatchNeuralNetwork (uint8)", batchSize * f.forwardFlops(), batchSize * in + paramBytes, batchSize, [=, &f]
+        {
+            BatchNeuralNetwork(pixels, f.params, *output);
+        });
+        add("QuantizedBatchNeuralNetwork", batchSize * f.forwardFlops(), batchSize * in + in * mid + 4 * mid * f.shape.outCount,
+            batchSize, [=, &f]
+        {
+            QuantizedBatchNeuralNetwork(pixels, f.quantizedParams, *output, *accumulator);
+        });
+        for (const HalfNeuralNetworkParameters& halfParams : f.halfParams)
+        {
+            add(std::string("HalfBatchNeuralNetwork (") + HalfFormatName(halfParams.w1.format) + ")",
+                batchSize * f.forwardFlops(), batchSize * in + 2 * in * mid + 4 * mid * f.shape.outCount,
+                batchSize, [=, &halfParams]
+            {
+                HalfBatchNeuralNetwork(pixels, halfParams, *output);
+            });
+        }
+
+        // ----------------------------------------------- 逆伝搬と勾配の更新
+
+        const double trainFlops = f.forwardFlops() + f.backwardFlops();
+        auto gradient = std::make_shared<NeuralNetworkParameters>(MakeZeroGradient(f.params));
+        const BackPropagationInput sampleInput{
+            .x = f.x,
+            .params = f.params,
+            .trueLabel = f.batch.trueLabels[0],
+            .batches = f.shape.batchSize
+        };
+        auto sampleGradient = std::make_shared<BackPropagationOutput>(BackPropagation(sampleInput));
+        auto workspace = std::make_shared<BatchBackPropagationWorkspace>();
+
+        add("BackPropagation (CPU, 1 sample)", trainFlops, 4 * in + 2 * paramBytes, 1, [=, &f]
+        {
+            const BackPropagationInput input{
+                .x = f.x,
+                .params = f.params,
+                .trueLabel = f.batch.trueLabels[0],
+                .batches = f.shape.batchSize
+            };
+            *sampleGradient = BackPropagation(input);
+        });
+
+        if (f.inputCount == mnistTopology.inputCount &&
+            f.shape.midCount == mnistTopology.midCount &&
+            f.shape.outCount == mnistTopology.outputCount)
+        {
+            // 同じ計算を、形を固定したテンプレートで行った場合
+            constexpr int staticIn = mnistTopology.inputCount;
+            constexpr int staticMid = mnistTopology.midCount;
+            constexpr int staticOut = mnistTopology.outputCount;
+            using StaticParameters = StaticNeuralNetworkParameters<staticIn, staticMid, staticOut>;
+
+            auto staticParams = std::make_shared<StaticParameters>();
+            staticParams->assign(f.params);
+            auto staticGradient = std::make_shared<StaticParameters>();
+            auto staticOutput = std::make_shared<StaticNeuralNetworkOutput<staticMid, staticOut>>();
+
+            add("StaticNeuralNetwork (1 sample)", f.forwardFlops(), 4 * in + paramBytes, 1, [=, &f]
+            {
+                StaticNeuralNetwork(f.x.data(), *staticParams, *staticOutput);
+            });
+            add("StaticBackPropagation (1 sample)", trainFlops, 4 * in + 2 * paramBytes, 1, [=, &f]
+            {
+                StaticBackPropagation(f.x.data(), f.batch.trueLabels[0], f.shape.batchSize, *staticParams, *staticGradient);
+            });
+        }
+        add("BatchBackPropagation", batchSize * trainFlops, 4 * batchSize * in + 2 * paramBytes, batchSize, [=, &f]
+        {
+            BatchBackPropagation(f.batch, 0, f.shape.batchSize, f.params, *workspace);
+        });
+        add("AccumulateGradients", paramFlops, 3 * paramBytes, 0, [=]
+        {
+            AccumulateGradients(*gradient, *sampleGradient);
+        });
+        add("ApplyGradients", 2 * paramFlops, 3 * paramBytes, 0, [=, &f]
+        {
+            ApplyGradients(f.params, *gradient, 0.0f);
+        });
+        for (const OptimizerType type : {OptimizerType::Momentum, OptimizerType::Adam})
+        {
+            // 状態 (Momentum は 1 つ、Adam は 2 つ) の読み書きが、パラメータと勾配に加わる
+            const int stateCount = type == OptimizerType::Adam ? 2 : 1;
+            auto optimizer = std::make_shared<Optimizer>(DefaultOptimizerSettings(type), f.params);
+            add(std::string("Optimizer::apply (") + OptimizerName(type) + ")",
+                (type == OptimizerType::Adam ? 10 : 4) * paramFlops, (3 + 2 * stateCount) * paramBytes, 0, [=, &f]
+            {
+                optimizer->apply(f.params, *gradient);
+            });
+        }
+
+        // ----------------------------------------------- 学習ステップ、評価、1 エポック
+
+        auto trainer = std::make_shared<DataParallelTrainer>(options.threadCount);
+        auto evaluator = std::make_shared<BatchEvaluator>(options.threadCount);
+
+        add("DataParallelTrainer::trainStep", batchSize * trainFlops + 2 * paramFlops, 4 * batchSize * in + 3 * paramBytes,
+            batchSize, [=, &f]
+        {
+            trainer->trainStep(f.batch, f.params, learningRate);
+        });
+        for (const HalfNeuralNetworkParameters& halfParams : f.halfParams)
+        {
+            // 順伝搬は半精度の W1 を読み、更新した行を変換し直す分だけ書き込みが増える
+            auto halfW1 = std::make_shared<HalfMatrix>(halfParams.w1);
+            add(std::string("DataParallelTrainer::trainStep (") + HalfFormatName(halfW1->format) + " W1)",
+                batchSize * trainFlops + 2 * paramFlops, 4 * batchSize * in + 3 * paramBytes + 2 * in * mid,
+                batchSize, [=, &f]
+            {
+                trainer->trainStep(f.batch, f.params, learningRate, halfW1.get());
+            });
+        }
+        for (const OptimizerType type : {OptimizerType::Momentum, OptimizerType::Adam})
+        {
+            // W1 の行ブロックごとに勾配を作り、キャッシュに載ったまま状態と一緒に更新する
+            const int stateCount = type == OptimizerType::Adam ? 2 : 1;
+            auto optimizer = std::make_shared<Optimizer>(DefaultOptimizerSettings(type), f.params);
+            add(std::string("DataParallelTrainer::trainStep (") + OptimizerName(type) + ")",
+                batchSize * trainFlops + 2 * paramFlops, 4 * batchSize * in + (3 + 2 * stateCount) * paramBytes,
+                batchSize, [=, &f]
+            {
+                trainer->trainStep(f.batch, f.params, *optimizer);
+            });
+        }
+
+        const int evaluationCount = std::min(f.shape.imageCount, 10000);
+        const DatasetImageList evaluationImages{
+            nullptr, f.images.pixels(), static_cast<size_t>(evaluationCount), f.images.property()
+        };
+        add("BatchEvaluator::evaluate", evaluationCount * f.forwardFlops(), evaluationCount * in + paramBytes,
+            evaluationCount, [=, &f]
+        {
+            const EvaluationResult result = evaluator->evaluate(evaluationImages, f.labels, f.params);
+            assert(result.sampleCount == evaluationCount);
+        });
+
+        const int batchesPerEpoch = f.shape.imageCount / f.shape.batchSize;
+        const double epochSamples = static_cast<double>(batchesPerEpoch) * f.shape.batchSize;
+        add("Epoch (prefetch + trainStep)", epochSamples * trainFlops + batchesPerEpoch * 2 * paramFlops,
+            epochSamples * in + batchesPerEpoch * 3 * paramBytes, epochSamples, [=, &f]
+        {
+            BatchPrefetcher prefetcher{f.images, f.labels, f.shape.batchSize, &f.activePixels};
+            for (int batch = 0; batch < prefetcher.batchesPerEpoch(); ++batch)
+            {
+                trainer->trainStep(prefetcher.acquire(), f.params, learningRate);
+                prefetcher.release();
+            }
+        });
+
+        return cases;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const std::optional<Options> options = parseOptions(argc, argv);
+    if (not options)
+    {
+        printUsage();
+        return 1;
+    }
+
+    const BenchmarkEnvironment environment{
+        .gemmKernel = GemmKernelName(GetGemmKernelType()),
+        .quantizedGemmKernel = QuantizedGemmKernelName(GetQuantizedGemmKernelType()),
+        .threadCount = options->threadCount,
+        .minSeconds = options->minSeconds
+    };
+
+    std::cout << "GEMM kernel: " << environment.gemmKernel
+        << ", INT8 kernel: " << environment.quantizedGemmKernel
+        << ", threads: " << environment.threadCount << "\n";
+
+    Array<BenchmarkResult> results{};
+    try
+    {
+        for (const NetworkShape& shape : networkShapes)
+        {
+            if (not options->shape.empty() && options->shape != shape.name) continue;
+
+            const auto fixture = makeFixture(shape, *options);
+            for (const BenchmarkCase& benchmark : makeBenchmarkCases(*fixture, *options))
+            {
+                if (not options->filter.empty() && benchmark.name.find(options->filter) == std::string::npos) continue;
+
+                results.push_back(RunBenchmark(benchmark, options->minSeconds));
+                PrintBenchmarkResult(std::cout, results.back());
+            }
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Benchmark failed: " << e.what() << "\n";
+        return 1;
+    }
+
+    if (not options->jsonFile.empty())
+    {
+        std::ofstream ofs(options->jsonFile);
+        if (!ofs)
+        {
+            std::cerr << "Can't open file for writing: " << options->jsonFile << "\n";
+            return 1;
+        }
+
+        WriteBenchmarkJson(ofs, environment, results);
+    }
+
+    return 0;
+}
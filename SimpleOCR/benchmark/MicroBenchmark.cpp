@@ -0,0 +1,110 @@
+﻿#include "pch.h"
+#include "MicroBenchmark.h"
+
+using namespace ocr;
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    double measureSeconds(const std::function<void()>& run, int64_t iterations)
+    {
+        const auto start = Clock::now();
+        for (int64_t i = 0; i < iterations; ++i)
+        {
+            run();
+        }
+
+        const std::chrono::duration<double> elapsed = Clock::now() - start;
+        return elapsed.count();
+    }
+
+    /// @brief printf 形式で整形する (ヘッドレスのビルドは <format> のない GCC 12 でも通るようにする)
+    template <class... Args>
+    std::string formatText(const char* format, Args... args)
+    {
+        char buffer[512]{};
+        std::snprintf(buffer, sizeof(buffer), format, args...);
+        return buffer;
+    }
+
+    std::string escapeJson(const std::string& text)
+    {
+        std::string escaped{};
+        for (const char c : text)
+        {
+            if (c == '"' || c == '\\') escaped += '\\';
+            escaped += c;
+        }
+
+        return escaped;
+    }
+}
+
+namespace ocr
+{
+    BenchmarkResult RunBenchmark(const BenchmarkCase& benchmark, double minSeconds)
+    {
+        // ウォームアップ: 作業領域の確保やページフォールトを計測から外す
+        benchmark.run();
+
+        int64_t iterations = 1;
+        double seconds = measureSeconds(benchmark.run, iterations);
+        while (seconds < minSeconds)
+        {
+            // 残り時間に収まりそうな回数まで一気に増やす (最大 10 倍)
+            const double scale = seconds > 0.0 ? std::min(10.0, 1.2 * minSeconds / seconds) : 10.0;
+            iterations = std::max(iterations + 1, static_cast<int64_t>(iterations * scale));
+            seconds = measureSeconds(benchmark.run, iterations);
+        }
+
+        const double secondsPerOp = seconds / iterations;
+        return BenchmarkResult{
+            .name = benchmark.name,
+            .shape = benchmark.shape,
+            .iterations = iterations,
+            .nsPerOp = secondsPerOp * 1e9,
+            .gflops = benchmark.flopsPerOp / secondsPerOp * 1e-9,
+            .gbPerSecond = benchmark.bytesPerOp / secondsPerOp * 1e-9,
+            .samplesPerSecond = benchmark.samplesPerOp / secondsPerOp
+        };
+    }
+
+    void PrintBenchmarkResult(std::ostream& os, const BenchmarkResult& result)
+    {
+        os << formatText("%-36s %-7s %14.1f ns/op %9.2f GFLOP/s %8.2f GB/s %14.0f samples/s\n",
+                         result.name.c_str(),
+                         result.shape.c_str(),
+                         result.nsPerOp,
+                         result.gflops,
+                         result.gbPerSecond,
+                         result.samplesPerSecond);
+    }
+
+    void WriteBenchmarkJson(std::ostream& os, const BenchmarkEnvironment& environment, const Array<BenchmarkResult>& results)
+    {
+        os << "{\n";
+        os << "  \"gemm_kernel\": \"" << escapeJson(environment.gemmKernel) << "\",\n";
+        os << "  \"quantized_gemm_kernel\": \"" << escapeJson(environment.quantizedGemmKernel) << "\",\n";
+        os << "  \"threads\": " << environment.threadCount << ",\n";
+        os << formatText("  \"min_seconds\": %g,\n", environment.minSeconds);
+        os << "  \"results\": [";
+
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            const BenchmarkResult& result = results[i];
+            os << (i == 0 ? "\n" : ",\n");
+            os << "    {\"name\": \"" << escapeJson(result.name) << "\", \"shape\": \"" << escapeJson(result.shape) << "\", ";
+            os << formatText(
+                "\"iterations\": %lld, \"ns_per_op\": %.3f, \"gflops\": %.4f, "
+                "\"gb_per_second\": %.4f, \"samples_per_second\": %.3f}",
+                static_cast<long long>(result.iterations),
+                result.nsPerOp,
+                result.gflops,
+                result.gbPerSecond,
+                result.samplesPerSecond);
+        }
+
+        os << "\n  ]\n}\n";
+    }
+}
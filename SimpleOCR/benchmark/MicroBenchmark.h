@@ -0,0 +1,62 @@
+﻿#pragma once
+#include "TY/Array.h"
+
+namespace ocr
+{
+    using namespace TY;
+
+    /// @brief 1 つの計測対象。1 回の run() あたりの仕事量から GFLOP/s などを求める
+    struct BenchmarkCase
+    {
+        std::string name;
+
+        /// @brief 層の形の名前 ("mnist" など)
+        std::string shape;
+
+        double flopsPerOp;
+
+        /// @brief 1 回あたりに読み書きするバイト数 (キャッシュを考えない最小の量)
+        double bytesPerOp;
+
+        double samplesPerOp;
+
+        std::function<void()> run;
+    };
+
+    struct BenchmarkResult
+    {
+        std::string name;
+
+        std::string shape;
+
+        int64_t iterations;
+
+        double nsPerOp;
+
+        double gflops;
+
+        double gbPerSecond;
+
+        double samplesPerSecond;
+    };
+
+    /// @brief 1 回のウォームアップの後、合計時間が minSeconds を超えるまで回数を倍にしながら計測する
+    BenchmarkResult RunBenchmark(const BenchmarkCase& benchmark, double minSeconds);
+
+    /// @brief 結果を 1 行ずつ表にして書く
+    void PrintBenchmarkResult(std::ostream& os, const BenchmarkResult& result);
+
+    struct BenchmarkEnvironment
+    {
+        std::string gemmKernel;
+
+        std::string quantizedGemmKernel;
+
+        int threadCount;
+
+        double minSeconds;
+    };
+
+    /// @brief ビルド間で比較するための JSON を書く
+    void WriteBenchmarkJson(std::ostream& os, const BenchmarkEnvironment& environment, const Array<BenchmarkResult>& results);
+}
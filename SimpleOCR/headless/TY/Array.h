@@ -0,0 +1,34 @@
+﻿#pragma once
+#include <type_traits>
+#include <vector>
+
+// ヘッドレスのビルドで使う Tsuyu の TY::Array の代わり (コアのコードが使う機能だけを持つ)
+
+namespace TY
+{
+    template <class T>
+    class Array : public std::vector<T>
+    {
+    public:
+        using std::vector<T>::vector;
+
+        /// @brief 各要素に f を適用した配列
+        template <class F>
+        auto map(F f) const
+        {
+            Array<std::invoke_result_t<F&, const T&>> result{};
+            result.reserve(this->size());
+            for (const auto& value : *this)
+            {
+                result.push_back(f(value));
+            }
+
+            return result;
+        }
+
+        size_t size_in_bytes() const
+        {
+            return this->size() * sizeof(T);
+        }
+    };
+}
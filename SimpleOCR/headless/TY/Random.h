@@ -0,0 +1,25 @@
+﻿#pragma once
+#include <algorithm>
+#include <random>
+
+// ヘッドレスのビルドで使う Tsuyu の TY::Random の代わり (コアのコードが使う機能だけを持つ)
+
+namespace TY::Random
+{
+    inline std::mt19937& Engine()
+    {
+        thread_local std::mt19937 engine{std::random_device{}()};
+        return engine;
+    }
+
+    inline float Float(float min, float max)
+    {
+        return std::uniform_real_distribution<float>{min, max}(Engine());
+    }
+
+    template <class Container>
+    void Shuffle(Container& container)
+    {
+        std::shuffle(container.begin(), container.end(), Engine());
+    }
+}
@@ -0,0 +1,13 @@
+﻿#pragma once
+
+// ヘッドレスのビルドで使う Tsuyu の TY::Size の代わり (コアのコードが使う機能だけを持つ)
+
+namespace TY
+{
+    struct Size
+    {
+        int x{};
+
+        int y{};
+    };
+}
@@ -0,0 +1,53 @@
+﻿#pragma once
+
+// ヘッドレス (GPU と描画なし) のビルド用のプリコンパイル済みヘッダ。
+// SimpleOCR/pch.h と違い、Tsuyu エンジン、DirectX、imgui などの外部ライブラリを含まない。
+// CMake のターゲットは OCR_HEADLESS=1 を定義し、GPU のコードをコンパイルから外す。
+// <format> のない GCC 12 でもビルドできるよう、ヘッドレスで使うコードでは std::format を使わない。
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <span>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <iso646.h>
+#include <math.h>
+
+#if defined(__GLIBCXX__)
+// libstdc++ は <cmath> に std::expf / std::logf を宣言しないので、C の関数を持ち込む
+namespace std
+{
+    using ::expf;
+    using ::logf;
+}
+#endif
+
+using namespace std::string_view_literals;
@@ -0,0 +1,173 @@
+﻿#include "pch.h"
+
+#include "GemmKernel.h"
+#include "LinearAlgebraBackend.h"
+#include "TY/Array.h"
+
+using namespace ocr;
+using namespace TY;
+
+// 各 LinearAlgebraBackend と各 GemmKernelType の行列積を、スカラー版の GemmKernel と比べる。
+// 行列の行の間に余りがある (ld > 列数) 格納と、4 通りの転置の組み合わせを確かめる。
+// 余りは NaN で埋めておき、読んではいけない要素を読めば結果が NaN になって分かるようにする。
+
+namespace
+{
+    struct GemmShape
+    {
+        int m{};
+
+        int n{};
+
+        int k{};
+    };
+
+    /// @brief レジスタタイルやベクトルの幅で割り切れない大きさと、ブロックをまたぐ大きさ
+    constexpr GemmShape shapes[] = {
+        {1, 1, 1},
+        {3, 5, 7},
+        {1, 33, 17},
+        {13, 1, 9},
+        {17, 31, 65},
+        {67, 131, 259},
+        {129, 65, 301},
+    };
+
+    /// @brief 行列の行の終わりから次の行の先頭までの余り (要素数)
+    constexpr int rowPadding = 3;
+
+    /// @brief C の余りに置いておき、書き換えられていないことを確かめる値
+    constexpr float guardValue = 12345.0f;
+
+    struct StoredMatrix
+    {
+        int rows{};
+
+        int cols{};
+
+        int ld{};
+
+        Array<float> data{};
+    };
+
+    StoredMatrix makeMatrix(int rows, int cols, float padValue, std::mt19937& engine)
+    {
+        StoredMatrix matrix{.rows = rows, .cols = cols, .ld = cols + rowPadding};
+        matrix.data.assign(static_cast<size_t>(rows) * matrix.ld, padValue);
+
+        std::uniform_real_distribution<float> distribution{-1.0f, 1.0f};
+        for (int i = 0; i < rows; ++i)
+        {
+            for (int j = 0; j < cols; ++j)
+            {
+                matrix.data[static_cast<size_t>(i) * matrix.ld + j] = distribution(engine);
+            }
+        }
+
+        return matrix;
+    }
+
+    const char* transposeName(Transpose transpose)
+    {
+        return transpose == Transpose::Yes ? "T" : "N";
+    }
+
+    /// @brief gemm で計算した C を、同じ入力のスカラー版の結果と比べる。一致しなければ理由を表示して false を返す
+    template <class Gemm>
+    bool checkGemm(const char* name, Transpose transA, Transpose transB, const GemmShape& shape, const Gemm& gemm)
+    {
+        const auto [m, n, k] = shape;
+        std::mt19937 engine{static_cast<unsigned>(m * 10007 + n * 101 + k)};
+
+        const float nan = std::numeric_limits<float>::quiet_NaN();
+        const StoredMatrix a = transA == Transpose::Yes ? makeMatrix(k, m, nan, engine) : makeMatrix(m, k, nan, engine);
+        const StoredMatrix b = transB == Transpose::Yes ? makeMatrix(n, k, nan, engine) : makeMatrix(k, n, nan, engine);
+
+        // C += op(A) * op(B) なので、C にも 0 でない値を入れておく
+        StoredMatrix expected = makeMatrix(m, n, guardValue, engine);
+        StoredMatrix actual = expected;
+
+        GemmKernel(GemmKernelType::Scalar, transA, transB, m, n, k,
+                   a.data.data(), a.ld, b.data.data(), b.ld, expected.data.data(), expected.ld);
+        gemm(transA, transB, m, n, k,
+             a.data.data(), a.ld, b.data.data(), b.ld, actual.data.data(), actual.ld);
+
+        for (int i = 0; i < m; ++i)
+        {
+            for (int j = 0; j < actual.ld; ++j)
+            {
+                const size_t index = static_cast<size_t>(i) * actual.ld + j;
+                const float value = actual.data[index];
+                const float reference = expected.data[index];
+
+                // 和の順序の違いによる誤差は k に比例する程度に収まる
+                const bool inside = j < n;
+                const bool match = inside
+                    ? std::abs(value - reference) <= 1e-5f * (k + std::abs(reference))
+                    : value == guardValue;
+                if (not match)
+                {
+                    std::printf("FAIL %s %s%s m=%d n=%d k=%d: C[%d][%d] = %g, expected %g%s\n",
+                                name, transposeName(transA), transposeName(transB), m, n, k,
+                                i, j, value, inside ? reference : guardValue, inside ? "" : " (row padding)");
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    template <class Gemm>
+    int checkAllShapes(const char* name, const Gemm& gemm)
+    {
+        int failureCount{};
+        int caseCount{};
+        for (const Transpose transA : {Transpose::No, Transpose::Yes})
+        {
+            for (const Transpose transB : {Transpose::No, Transpose::Yes})
+            {
+                for (const GemmShape& shape : shapes)
+                {
+                    caseCount++;
+                    if (not checkGemm(name, transA, transB, shape, gemm)) failureCount++;
+                }
+            }
+        }
+
+        std::printf("%-16s %d / %d cases passed\n", name, caseCount - failureCount, caseCount);
+        return failureCount;
+    }
+}
+
+int main()
+{
+    int failureCount{};
+
+    for (const LinearAlgebraBackend backend : {LinearAlgebraBackend::Scalar, LinearAlgebraBackend::Simd, LinearAlgebraBackend::Blas})
+    {
+        if (not IsLinearAlgebraBackendAvailable(backend))
+        {
+            std::printf("%-16s not available in this build, skipped\n", LinearAlgebraBackendName(backend));
+            continue;
+        }
+
+        failureCount += checkAllShapes(LinearAlgebraBackendName(backend), [backend](auto... args)
+        {
+            BackendGemm(backend, args...);
+        });
+    }
+
+    // Simd は cpuid で選んだカーネルしか通らないので、この CPU で動く他のカーネルも直接確かめる
+    for (const GemmKernelType type : {GemmKernelType::Avx2, GemmKernelType::Avx512})
+    {
+        if (type > GetGemmKernelType()) continue;
+
+        failureCount += checkAllShapes(GemmKernelName(type), [type](auto... args)
+        {
+            GemmKernel(type, args...);
+        });
+    }
+
+    return failureCount == 0 ? 0 : 1;
+}
@@ -0,0 +1,158 @@
+﻿#include "pch.h"
+
+#include "BatchPrefetcher.h"
+#include "DataParallelTrainer.h"
+#include "Optimizer.h"
+#include "SparseInput.h"
+
+using namespace ocr;
+
+// 同じ初期値と同じ種のバッチ順で、W1, W2 を MatrixLayout::Packed と Padded に置いて学習を進め、
+// 一定の手数の後のパラメータがビット単位で一致することを確かめる。
+// 行の余り (Padded の stride - cols) は学習の間も 0 のままであることも確かめる。
+
+namespace
+{
+    constexpr DatasetImageProperty imageProperty{.size = {28, 28}};
+
+    constexpr int imageCount = 300;
+
+    constexpr int midCount = 128;
+
+    constexpr int outputCount = 10;
+
+    constexpr int batchSize = 50;
+
+    /// @brief 1 エポック (6 バッチ) を越え、シャッフルし直した後のバッチも通る手数
+    constexpr int stepCount = 8;
+
+    constexpr uint32_t shuffleSeed = 7;
+
+    /// @brief 非ゼロの画素が density の割合で散らばった画像と、そのラベルを作る
+    DatasetImageList makeImages(float density, Array<uint8_t>& labels)
+    {
+        std::mt19937 engine{static_cast<uint32_t>(density * 1000)};
+        std::bernoulli_distribution active{density};
+        std::uniform_int_distribution<int> pixel{1, 255};
+        std::uniform_int_distribution<int> label{0, outputCount - 1};
+
+        Array<uint8_t> pixels(static_cast<size_t>(imageCount) * imageProperty.pixelCount());
+        std::generate(pixels.begin(), pixels.end(), [&] { return static_cast<uint8_t>(active(engine) ? pixel(engine) : 0); });
+
+        labels.resize(imageCount);
+        std::generate(labels.begin(), labels.end(), [&] { return static_cast<uint8_t>(label(engine)); });
+
+        return DatasetImageList::FromPixels(std::move(pixels), imageProperty);
+    }
+
+    NeuralNetworkParameters makeParameters(MatrixLayout layout)
+    {
+        std::mt19937 engine{1};
+        std::uniform_real_distribution<float> distribution{-0.1f, 0.1f};
+        const auto random = [&] { return distribution(engine); };
+
+        NeuralNetworkParameters params{
+            .w1 = Matrix(imageProperty.pixelCount(), midCount, layout),
+            .b1 = Array<float>(midCount),
+            .w2 = Matrix(midCount, outputCount, layout),
+            .b2 = Array<float>(outputCount),
+        };
+
+        // 並べ方によらず同じ値になるよう、行ごとに列の範囲だけを埋める
+        for (int i = 0; i < params.w1.rows(); ++i) std::generate_n(params.w1[i], params.w1.cols(), random);
+        std::generate(params.b1.begin(), params.b1.end(), random);
+        for (int i = 0; i < params.w2.rows(); ++i) std::generate_n(params.w2[i], params.w2.cols(), random);
+        std::generate(params.b2.begin(), params.b2.end(), random);
+
+        return params;
+    }
+
+    /// @brief 各行の列の範囲がビット単位で一致し、padded の行の余りが 0 のままか
+    bool sameMatrix(const char* name, const Matrix& packed, const Matrix& padded)
+    {
+        for (int i = 0; i < packed.rows(); ++i)
+        {
+            if (std::memcmp(packed[i], padded[i], sizeof(float) * packed.cols()) != 0)
+            {
+                std::printf("  %s row %d differs between the layouts\n", name, i);
+                return false;
+            }
+
+            if (std::any_of(padded[i] + padded.cols(), padded[i] + padded.stride(), [](float value) { return value != 0.0f; }))
+            {
+                std::printf("  %s row %d has non-zero padding\n", name, i);
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool sameArray(const char* name, const Array<float>& packed, const Array<float>& padded)
+    {
+        if (std::memcmp(packed.data(), padded.data(), sizeof(float) * packed.size()) != 0)
+        {
+            std::printf("  %s differs between the layouts\n", name);
+            return false;
+        }
+
+        return true;
+    }
+
+    bool checkLayouts(OptimizerType optimizerType, int threadCount, float density)
+    {
+        Array<uint8_t> labels{};
+        const DatasetImageList images = makeImages(density, labels);
+        const ActivePixelIndex activePixels{images};
+
+        NeuralNetworkParameters packed = makeParameters(MatrixLayout::Packed);
+        NeuralNetworkParameters padded = makeParameters(MatrixLayout::Padded);
+
+        DataParallelTrainer packedTrainer{threadCount};
+        DataParallelTrainer paddedTrainer{threadCount};
+        Optimizer packedOptimizer{DefaultOptimizerSettings(optimizerType), packed};
+        Optimizer paddedOptimizer{DefaultOptimizerSettings(optimizerType), padded};
+
+        // 同じ種の 2 つのプリフェッチャーは同じ順でバッチを作る
+        BatchPrefetcher packedBatches{images, labels, batchSize, &activePixels, shuffleSeed};
+        BatchPrefetcher paddedBatches{images, labels, batchSize, &activePixels, shuffleSeed};
+
+        for (int step = 0; step < stepCount; ++step)
+        {
+            packedTrainer.trainStep(packedBatches.acquire(), packed, packedOptimizer);
+            paddedTrainer.trainStep(paddedBatches.acquire(), padded, paddedOptimizer);
+            packedBatches.release();
+            paddedBatches.release();
+        }
+
+        std::printf("%-8s threads %d, %s input: ", OptimizerName(optimizerType), threadCount,
+                    PreferSparseInput(activePixels.density()) ? "sparse" : "dense");
+
+        const bool same =
+            sameMatrix("W1", packed.w1, padded.w1) &&
+            sameArray("b1", packed.b1, padded.b1) &&
+            sameMatrix("W2", packed.w2, padded.w2) &&
+            sameArray("b2", packed.b2, padded.b2);
+
+        std::printf("%s\n", same ? "identical" : "FAIL");
+        return same;
+    }
+}
+
+int main()
+{
+    int failureCount{};
+
+    for (const OptimizerType optimizerType : {OptimizerType::Sgd, OptimizerType::Momentum, OptimizerType::Adam})
+    {
+        for (const int threadCount : {1, 3})
+        {
+            for (const float density : {0.15f, 0.6f})
+            {
+                if (not checkLayouts(optimizerType, threadCount, density)) failureCount++;
+            }
+        }
+    }
+
+    return failureCount == 0 ? 0 : 1;
+}
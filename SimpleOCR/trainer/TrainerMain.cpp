@@ -0,0 +1,430 @@
+﻿#include "pch.h"
+
+#include "ApplicationSettings.h"
+#include "BatchEvaluator.h"
+#include "BatchPrefetcher.h"
+#include "DataParallelTrainer.h"
+#include "DatasetLoader.h"
+#include "GemmKernel.h"
+#include "HalfNeuralNetwork.h"
+#include "LinearAlgebraBackend.h"
+#include "ModelFile.h"
+#include "Optimizer.h"
+#include "PhaseProfiler.h"
+#include "SparseInput.h"
+
+using namespace ocr;
+
+namespace
+{
+    constexpr int labelCount = 10;
+
+    struct Options
+    {
+        std::string trainImages = "asset/dataset/train-images.idx3-ubyte";
+
+        std::string trainLabels = "asset/dataset/train-labels.idx1-ubyte";
+
+        std::string testImages = "asset/dataset/t10k-images.idx3-ubyte";
+
+        std::string testLabels = "asset/dataset/t10k-labels.idx1-ubyte";
+
+        int epochCount = 5;
+
+        int batchSize = 100;
+
+        OptimizerType optimizer = OptimizerType::Sgd;
+
+        /// @brief 指定がなければ optimizer の標準の学習率 (DefaultOptimizerSettings()) を使う
+        std::optional<float> learningRate{};
+
+        /// @brief テストの正解率が初めてこの値に届いたときの、学習にかかった時間とエポックを表示する
+        float targetAccuracy = 0.97f;
+
+        int midCount = 128;
+
+        int threadCount = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+
+        uint32_t seed = std::random_device{}();
+
+        std::string loadFile{};
+
+        std::string saveFile{};
+
+        std::string traceFile{};
+
+        ActivationMode activationMode = ActivationMode::Exact;
+
+        LinearAlgebraBackend backend = LinearAlgebraBackend::Simd;
+
+        /// @brief W1, W2 とその勾配の行の並べ方
+        MatrixLayout weightLayout = MatrixLayout::Packed;
+
+        /// @brief 設定すると、順伝搬と評価で W1 をこの形式で読む (更新は float のマスターに対して行う)
+        std::optional<HalfFormat> halfWeights{};
+    };
+
+    void printUsage()
+    {
+        std::cerr <<
+            "Usage: SimpleOCRTrainer [options]\n"
+            "  --dataset DIR          read the four MNIST files from DIR (default asset/dataset)\n"
+            "  --train-images FILE    IDX training images\n"
+            "  --train-labels FILE    IDX training labels\n"
+            "  --test-images FILE     IDX test images\n"
+            "  --test-labels FILE     IDX test labels\n"
+            "  --epochs N             number of epochs (default 5)\n"
+            "  --batch-size N         mini-batch size (default 100)\n"
+            "  --optimizer NAME       sgd, momentum or adam (default sgd)\n"
+            "  --learning-rate X      learning rate (default 0.01, or 0.001 for adam)\n"
+            "  --target-accuracy X    report the training time to reach this test accuracy (default 0.97)\n"
+            "  --hidden N             hidden layer size (default 128)\n"
+            "  --threads N            threads for training and evaluation\n"
+            "  --seed N               seed for the initial weights and the batch order\n"
+            "  --load FILE            start from a saved model instead of random weights\n"
+            "  --save FILE            save the trained model\n"
+            "  --trace FILE           write a Chrome/Perfetto trace of the training phases\n"
+            "  --activation MODE      exact (libm expf/logf) or fast (SIMD approximations) for sigmoid, softmax and loss\n"
+            "  --half-weights FORMAT  keep a fp16 or bf16 copy of W1 for the forward pass (fp32 master for updates)\n"
+            "  --backend NAME         scalar, simd or blas (if built with a system CBLAS) for the float GEMMs (default simd)\n"
+            "  --padded-weights       pad the rows of W1, W2 and their gradients to whole, cache-set-friendly cache-line strides\n";
+    }
+
+    std::optional<Options> parseOptions(int argc, char** argv)
+    {
+        Options options{};
+        // 数値として読めない値は、他の不正な引数と同じく使い方を表示させる
+        try
+        {
+            for (int i = 1; i < argc; ++i)
+            {
+                const std::string_view arg = argv[i];
+                const bool hasValue = i + 1 < argc;
+                if (arg == "--dataset" && hasValue)
+                {
+                    const std::string directory = argv[++i];
+                    options.trainImages = directory + "/train-images.idx3-ubyte";
+                    options.trainLabels = directory + "/train-labels.idx1-ubyte";
+                    options.testImages = directory + "/t10k-images.idx3-ubyte";
+                    options.testLabels = directory + "/t10k-labels.idx1-ubyte";
+                }
+                else if (arg == "--train-images" && hasValue) options.trainImages = argv[++i];
+                else if (arg == "--train-labels" && hasValue) options.trainLabels = argv[++i];
+                else if (arg == "--test-images" && hasValue) options.testImages = argv[++i];
+                else if (arg == "--test-labels" && hasValue) options.testLabels = argv[++i];
+                else if (arg == "--epochs" && hasValue) options.epochCount = std::max(1, std::stoi(argv[++i]));
+                else if (arg == "--batch-size" && hasValue) options.batchSize = std::max(1, std::stoi(argv[++i]));
+                else if (arg == "--learning-rate" && hasValue) options.learningRate = std::stof(argv[++i]);
+                else if (arg == "--target-accuracy" && hasValue) options.targetAccuracy = std::stof(argv[++i]);
+                else if (arg == "--hidden" && hasValue) options.midCount = std::max(1, std::stoi(argv[++i]));
+                else if (arg == "--threads" && hasValue) options.threadCount = std::max(1, std::stoi(argv[++i]));
+                else if (arg == "--seed" && hasValue) options.seed = static_cast<uint32_t>(std::stoul(argv[++i]));
+                else if (arg == "--load" && hasValue) options.loadFile = argv[++i];
+                else if (arg == "--save" && hasValue) options.saveFile = argv[++i];
+                else if (arg == "--trace" && hasValue) options.traceFile = argv[++i];
+                else if (arg == "--padded-weights") options.weightLayout = MatrixLayout::Padded;
+                else if (arg == "--optimizer" && hasValue)
+                {
+                    const std::string_view name = argv[++i];
+                    if (name == "sgd") options.optimizer = OptimizerType::Sgd;
+                    else if (name == "momentum") options.optimizer = OptimizerType::Momentum;
+                    else if (name == "adam") options.optimizer = OptimizerType::Adam;
+                    else return std::nullopt;
+                }
+                else if (arg == "--activation" && hasValue)
+                {
+                    const std::string_view mode = argv[++i];
+                    if (mode == "exact") options.activationMode = ActivationMode::Exact;
+                    else if (mode == "fast") options.activationMode = ActivationMode::Fast;
+                    else return std::nullopt;
+                }
+                else if (arg == "--backend" && hasValue)
+                {
+                    const std::string_view name = argv[++i];
+                    if (name == "scalar") options.backend = LinearAlgebraBackend::Scalar;
+                    else if (name == "simd") options.backend = LinearAlgebraBackend::Simd;
+                    else if (name == "blas") options.backend = LinearAlgebraBackend::Blas;
+                    else return std::nullopt;
+                }
+                else if (arg == "--half-weights" && hasValue)
+                {
+                    const std::string_view format = argv[++i];
+                    if (format == "fp16") options.halfWeights = HalfFormat::Float16;
+                    else if (format == "bf16") options.halfWeights = HalfFormat::BFloat16;
+                    else return std::nullopt;
+                }
+                else return std::nullopt;
+            }
+        }
+        catch (const std::invalid_argument&)
+        {
+            return std::nullopt;
+        }
+        catch (const std::out_of_range&)
+        {
+            return std::nullopt;
+        }
+
+        return options;
+    }
+
+    /// @brief GUI の学習と同じく、全パラメータを [-1, 1) の一様乱数で初期化する
+    NeuralNetworkParameters makeRandomParameters(int inputCount, const Options& options)
+    {
+        std::mt19937 random{options.seed};
+        std::uniform_real_distribution<float> weight{-1.0f, 1.0f};
+
+        const auto fillRandom = [&](float* values, int count)
+        {
+            std::generate_n(values, count, [&] { return weight(random); });
+        };
+
+        // 行の末尾の隙間は 0 のまま残す
+        const auto fillRandomMatrix = [&](Matrix& w)
+        {
+            for (int i = 0; i < w.rows(); ++i)
+            {
+                fillRandom(w[i], w.cols());
+            }
+        };
+
+        NeuralNetworkParameters params{};
+        params.w1 = Matrix(inputCount, options.midCount, options.weightLayout);
+        params.b1 = Array<float>(options.midCount);
+        params.w2 = Matrix(options.midCount, labelCount, options.weightLayout);
+        params.b2 = Array<float>(labelCount);
+
+        fillRandomMatrix(params.w1);
+        fillRandom(params.b1.data(), options.midCount);
+        fillRandomMatrix(params.w2);
+        fillRandom(params.b2.data(), labelCount);
+        return params;
+    }
+
+    double secondsSince(std::chrono::steady_clock::time_point start)
+    {
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count();
+    }
+
+    int train(const Options& options)
+    {
+        const DatasetImageList trainImages = LoadMnistImages(options.trainImages);
+        const Array<uint8_t> trainLabels = LoadMnistLabels(options.trainLabels, trainImages);
+        const DatasetImageList testImages = LoadMnistImages(options.testImages);
+        const Array<uint8_t> testLabels = LoadMnistLabels(options.testLabels, testImages);
+
+        const int inputCount = trainImages.property().pixelCount();
+        if (testImages.property().pixelCount() != inputCount)
+        {
+            throw std::runtime_error("Training and test images have different sizes.");
+        }
+
+        NeuralNetworkParameters params{};
+        if (options.loadFile.empty())
+        {
+            params = makeRandomParameters(inputCount, options);
+        }
+        else
+        {
+            params = MappedModel{options.loadFile}.toParameters(options.weightLayout);
+            if (params.w1.rows() != inputCount)
+            {
+                throw std::runtime_error("Model input size does not match the dataset: " + options.loadFile);
+            }
+
+            if (params.w2.cols() != labelCount)
+            {
+                throw std::runtime_error("Model output count does not match the " + std::to_string(labelCount) + " labels: " + options.loadFile);
+            }
+        }
+
+        // 順伝搬と逆伝搬は活性化関数の計算方法と行列積のバックエンドを ApplicationSettings から読む
+        g_applicationSettings.activationMode = options.activationMode;
+
+        if (not IsLinearAlgebraBackendAvailable(options.backend))
+        {
+            throw std::runtime_error(std::string{"Linear algebra backend is not available in this build: "} +
+                                     LinearAlgebraBackendName(options.backend));
+        }
+
+        g_applicationSettings.linearAlgebraBackend = options.backend;
+
+        // 他のバックエンドでは順伝搬が半精度の W1 を読まず、指定が黙って無視されるので受け付けない
+        if (options.halfWeights && not SupportsSparseAndHalfKernels(options.backend))
+        {
+            throw std::runtime_error(std::string{"--half-weights requires the simd backend, not "} +
+                                     LinearAlgebraBackendName(options.backend));
+        }
+
+        OptimizerSettings optimizerSettings = DefaultOptimizerSettings(options.optimizer);
+        if (options.learningRate)
+        {
+            optimizerSettings.learningRate = *options.learningRate;
+        }
+
+        std::printf("Train: %zu images, test: %zu images, network: %d-%d-%d, batch: %d, threads: %d, GEMM kernel: %s, W1: %s, "
+                    "optimizer: %s (learning rate %g), activation: %s, backend: %s, weights: %s\n",
+                    trainImages.size(),
+                    testImages.size(),
+                    inputCount,
+                    params.w1.cols(),
+                    params.w2.cols(),
+                    options.batchSize,
+                    options.threadCount,
+                    GemmKernelName(GetGemmKernelType()),
+                    options.halfWeights ? HalfFormatName(*options.halfWeights) : "FP32",
+                    OptimizerName(optimizerSettings.type),
+                    optimizerSettings.learningRate,
+                    ActivationModeName(options.activationMode),
+                    LinearAlgebraBackendName(options.backend),
+                    MatrixLayoutName(options.weightLayout));
+
+        // 半精度の W1 は float のマスターから作り、以降は trainStep() が更新した行ごとに変換し直す
+        HalfNeuralNetworkParameters halfParams{};
+        if (options.halfWeights)
+        {
+            ConvertToHalfMatrix(params.w1, *options.halfWeights, halfParams.w1);
+        }
+
+        const ActivePixelIndex activePixels{trainImages};
+        DataParallelTrainer trainer{options.threadCount};
+        Optimizer optimizer{optimizerSettings, params};
+        BatchEvaluator evaluator{options.threadCount};
+        auto prefetcher = std::make_unique<BatchPrefetcher>(trainImages, trainLabels, options.batchSize, &activePixels, options.seed);
+
+        const int sampleCount = prefetcher->batchesPerEpoch() * options.batchSize;
+        const uint64_t traceStart = ProfileTimestamp();
+
+        // 評価の時間を除いた、学習だけの累計時間
+        double totalTrainSeconds = 0.0;
+        bool reachedTarget = false;
+
+        for (int epoch = 0; epoch < options.epochCount; ++epoch)
+        {
+#if OCR_PROFILE_PHASES
+            const ProfileTotals profileBefore = CaptureProfileTotals();
+#endif
+
+            const auto start = std::chrono::steady_clock::now();
+
+            float totalLoss = 0.0f;
+            for (int batch = 0; batch < prefetcher->batchesPerEpoch(); ++batch)
+            {
+                totalLoss += trainer.trainStep(prefetcher->acquire(),
+                                               params,
+                                               optimizer,
+                                               options.halfWeights ? &halfParams.w1 : nullptr);
+                prefetcher->release();
+            }
+
+            const double trainSeconds = secondsSince(start);
+            totalTrainSeconds += trainSeconds;
+
+            EvaluationResult evaluation{};
+            if (options.halfWeights)
+            {
+                halfParams.b1 = params.b1;
+                halfParams.w2 = params.w2;
+                halfParams.b2 = params.b2;
+                evaluation = evaluator.evaluate(testImages, testLabels, halfParams);
+            }
+            else
+            {
+                evaluation = evaluator.evaluate(testImages, testLabels, params);
+            }
+
+            std::printf("Epoch %d/%d: loss = %.6f, test accuracy = %.2f%%, %.0f samples/sec (%.2f s), evaluation %.1f ms\n",
+                        epoch + 1,
+                        options.epochCount,
+                        totalLoss / static_cast<float>(sampleCount),
+                        evaluation.accuracy() * 100.0f,
+                        sampleCount / trainSeconds,
+                        trainSeconds,
+                        evaluation.elapsedSeconds * 1000.0);
+
+            if (not reachedTarget && evaluation.accuracy() >= options.targetAccuracy)
+            {
+                reachedTarget = true;
+                std::printf("Reached %.2f%% test accuracy after epoch %d in %.2f s of training\n",
+                            options.targetAccuracy * 100.0f,
+                            epoch + 1,
+                            totalTrainSeconds);
+            }
+
+#if OCR_PROFILE_PHASES
+            std::printf("%s\n", FormatProfileSummary(CaptureProfileTotals().since(profileBefore), sampleCount).c_str());
+#endif
+            std::fflush(stdout);
+        }
+
+        if (not reachedTarget)
+        {
+            std::printf("Did not reach %.2f%% test accuracy in %d epochs (%.2f s of training)\n",
+                        options.targetAccuracy * 100.0f,
+                        options.epochCount,
+                        totalTrainSeconds);
+        }
+
+        // 生産者スレッドを止めてから、記録が止まったリングバッファを読む
+        prefetcher.reset();
+
+        if (options.halfWeights)
+        {
+            // 学習した float のマスターを、テストセットで fp16 / bf16 の推論と比べる
+            const HalfPrecisionReport report = CompareHalfPrecisionInference(testImages, testLabels, params, options.batchSize);
+            std::printf("Inference: FP32 %.2f%% (%.0f samples/sec, W1 %.1f KB)\n",
+                        report.fp32Accuracy * 100.0f,
+                        report.fp32SamplesPerSecond,
+                        report.fp32W1Bytes / 1024.0);
+            for (const HalfPrecisionResult& result : report.results)
+            {
+                std::printf("Inference: %s %.2f%% (%+.2f pt, %d / %d predictions differ, max probability error %.5f), "
+                            "%.0f samples/sec (x%.2f), W1 %.1f KB\n",
+                            HalfFormatName(result.format),
+                            result.accuracy * 100.0f,
+                            (result.accuracy - report.fp32Accuracy) * 100.0f,
+                            result.disagreementCount,
+                            report.sampleCount,
+                            result.maxProbabilityError,
+                            result.samplesPerSecond,
+                            result.samplesPerSecond / report.fp32SamplesPerSecond,
+                            result.w1Bytes / 1024.0);
+            }
+        }
+
+        if (not options.traceFile.empty())
+        {
+            WriteChromeTrace(options.traceFile, traceStart);
+            std::printf("Saved trace to %s\n", options.traceFile.c_str());
+        }
+
+        if (not options.saveFile.empty())
+        {
+            SaveModel(options.saveFile, params);
+            std::printf("Saved model to %s\n", options.saveFile.c_str());
+        }
+
+        return 0;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const std::optional<Options> options = parseOptions(argc, argv);
+    if (not options)
+    {
+        printUsage();
+        return 1;
+    }
+
+    try
+    {
+        return train(*options);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Training failed: " << e.what() << "\n";
+        return 1;
+    }
+}